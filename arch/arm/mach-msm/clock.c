@@ -21,6 +21,7 @@
 #include <linux/err.h>
 #include <linux/clk.h>
 #include <linux/slab.h>
+#include <linux/completion.h>
 #include <linux/spinlock.h>
 #include <linux/fs.h>
 #include <linux/debugfs.h>
@@ -679,29 +680,60 @@ static int param_get_min_axi(char *buffer, struct kernel_param *kp)
 module_param_call(min_axi_khz, param_set_min_axi,
 	param_get_min_axi, &min_axi_khz, S_IWUSR | S_IRUGO);
 
+static void clock_late_off_done(struct msm_proc_comm_req *req)
+{
+	complete(req->context);
+}
+
 /* The bootloader and/or AMSS may have left various clocks enabled.
  * Disable any clocks that belong to us (CLKFLAG_AUTO_OFF) but have
- * not been explicitly enabled by a clk_enable() call.
+ * not been explicitly enabled by a clk_enable() call.  The disables
+ * are handed to proc_comm as one batch, so the modem round trips are
+ * waited for with interrupts on; proc_comm runs them before any later
+ * clk_enable() gets to the modem.
  */
 static int __init clock_late_init(void)
 {
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct msm_proc_comm_req *reqs;
 	unsigned long flags;
 	struct clk *clk;
 	struct hlist_node *pos;
+	LIST_HEAD(batch);
 	unsigned count = 0;
+	unsigned n = 0;
 
 	mutex_lock(&clocks_mutex);
+	hlist_for_each_entry(clk, pos, &clocks, list)
+		if (clk->flags & CLKFLAG_AUTO_OFF)
+			n++;
+	reqs = n ? kcalloc(n, sizeof(*reqs), GFP_KERNEL) : NULL;
+
+	spin_lock_irqsave(&clocks_lock, flags);
 	hlist_for_each_entry(clk, pos, &clocks, list) {
-		if (clk->flags & CLKFLAG_AUTO_OFF) {
-			spin_lock_irqsave(&clocks_lock, flags);
-			if (!clk->count) {
-				count++;
-				pc_clk_disable(clk->id);
-			}
-			spin_unlock_irqrestore(&clocks_lock, flags);
+		if (!(clk->flags & CLKFLAG_AUTO_OFF) || clk->count)
+			continue;
+		if (reqs) {
+			reqs[count].cmd = PCOM_CLKCTL_RPC_DISABLE;
+			reqs[count].data1 = clk->id;
+			list_add_tail(&reqs[count].list, &batch);
+		} else {
+			pc_clk_disable(clk->id);
 		}
+		count++;
+	}
+	if (reqs && count) {
+		reqs[count - 1].done = clock_late_off_done;
+		reqs[count - 1].context = &done;
+		msm_proc_comm_submit(&batch);
 	}
+	spin_unlock_irqrestore(&clocks_lock, flags);
 	mutex_unlock(&clocks_mutex);
+
+	if (reqs && count)
+		wait_for_completion(&done);
+	kfree(reqs);
+
 	pr_info("clock_late_init() disabled %d unused clocks\n", count);
 
 	clock_debug_init();
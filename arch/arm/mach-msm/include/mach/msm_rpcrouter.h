@@ -354,6 +354,39 @@ int xdr_send_array(struct msm_rpc_xdr *xdr, void **addr, uint32_t *size,
 int xdr_recv_array(struct msm_rpc_xdr *xdr, void **addr, uint32_t *size,
 		   uint32_t maxsize, uint32_t elm_size, void *xdr_op);
 
+/*
+ * Table-driven marshalling of fixed-layout argument structs.  Each
+ * entry describes one scalar member, which goes on the wire as one XDR
+ * word; the whole struct is bounds-checked and copied in one pass.
+ */
+enum {
+	XDR_FIELD_UINT32,
+	XDR_FIELD_INT32,
+	XDR_FIELD_UINT16,
+	XDR_FIELD_INT16,
+	XDR_FIELD_UINT8,
+	XDR_FIELD_INT8,
+};
+
+struct msm_rpc_xdr_field {
+	uint16_t offset;
+	uint16_t type;
+};
+
+#define XDR_FIELD(_struct, _member, _type) \
+	{ .offset = offsetof(_struct, _member), .type = XDR_FIELD_##_type }
+
+int xdr_send_struct(struct msm_rpc_xdr *xdr, const void *obj,
+		    const struct msm_rpc_xdr_field *fields,
+		    unsigned int nfields);
+int xdr_recv_struct(struct msm_rpc_xdr *xdr, void *obj,
+		    const struct msm_rpc_xdr_field *fields,
+		    unsigned int nfields);
+int xdr_recv_struct_array(struct msm_rpc_xdr *xdr, void *obj,
+			  uint32_t elm_size, uint32_t count,
+			  const struct msm_rpc_xdr_field *fields,
+			  unsigned int nfields);
+
 int xdr_recv_req(struct msm_rpc_xdr *xdr, struct rpc_request_hdr *req);
 int xdr_recv_reply(struct msm_rpc_xdr *xdr, struct rpc_reply_hdr *reply);
 int xdr_start_request(struct msm_rpc_xdr *xdr, uint32_t prog,
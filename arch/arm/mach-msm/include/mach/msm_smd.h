@@ -54,6 +54,30 @@ int smd_read_avail(smd_channel_t *ch);
 */
 int smd_cur_packet_size(smd_channel_t *ch);
 
+/* Returns 1 if the channel preserves write boundaries, 0 for a stream */
+int smd_is_packet_channel(smd_channel_t *ch);
+
+/* Zero-copy access to the fifos.  The caller gets a pointer into
+** shared memory and must serialize against other readers or writers
+** of the channel, as with smd_read() and smd_write().
+**
+** smd_begin_read() returns the number of contiguous bytes readable
+** at *data (never past the end of the current packet) without
+** consuming them; smd_end_read() consumes len of them.  Loop if the
+** data wraps around the end of the fifo.
+**
+** smd_write_reserve() returns the number of contiguous bytes that
+** may be filled at *data, at most len.  On a packet channel len is
+** the size of the whole packet on the first call, the header is
+** written then, and -ENOMEM is returned if the packet does not fit.
+** smd_write_commit() hands len filled bytes to the other side, which
+** is only notified once a packet is complete.
+*/
+int smd_begin_read(smd_channel_t *ch, void **data);
+int smd_end_read(smd_channel_t *ch, int len);
+int smd_write_reserve(smd_channel_t *ch, void **data, int len);
+int smd_write_commit(smd_channel_t *ch, int len);
+
 /* used for tty unthrottling and the like -- causes the notify()
 ** callback to be called from the same lock context as is used
 ** when it is called from channel updates
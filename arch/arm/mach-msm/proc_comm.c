@@ -19,6 +19,11 @@
 #include <linux/io.h>
 #include <linux/spinlock.h>
 #include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/workqueue.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <mach/msm_iomap.h>
 #include <mach/system.h>
 
@@ -54,6 +59,25 @@ static inline void notify_other_proc_comm(void)
 
 static DEFINE_SPINLOCK(proc_comm_lock);
 
+/*
+ * Asynchronous commands wait on proc_comm_queue, in order.  The one the
+ * modem is working on is proc_comm_inflight; commands that are done
+ * wait on proc_comm_done for the worker to call ->done.  Lock order is
+ * proc_comm_lock, then proc_comm_queue_lock.
+ */
+static LIST_HEAD(proc_comm_queue);
+static LIST_HEAD(proc_comm_done);
+static DEFINE_SPINLOCK(proc_comm_queue_lock);
+static struct workqueue_struct *proc_comm_wq;
+static struct msm_proc_comm_req *proc_comm_inflight;
+static ktime_t proc_comm_inflight_start;
+
+static void proc_comm_do_work(struct work_struct *work);
+static DECLARE_WORK(proc_comm_work, proc_comm_do_work);
+
+/* The worker polls without sleeping for this long, then sleeps */
+#define PROC_COMM_SPIN_US	20
+
 void msm_pm_flush_console(void);
 
 /* The higher level SMD support will install this to
@@ -103,6 +127,179 @@ static int proc_comm_wait_for(void __iomem *addr, unsigned value)
 	}
 }
 
+enum {
+	PCOM_LAT_SYNC,
+	PCOM_LAT_ASYNC,
+	PCOM_LAT_NUM
+};
+
+/*
+ * Round trip times, from issuing the command to seeing it done, for
+ * synchronous and asynchronous commands.  Bucket n counts times in
+ * [2^(n-1), 2^n) microseconds; the last bucket is open-ended.
+ * Updated under proc_comm_lock.
+ */
+#if defined(CONFIG_DEBUG_FS)
+#define PCOM_LAT_BUCKETS	16
+
+static unsigned int proc_comm_hist[PCOM_LAT_NUM][PCOM_LAT_BUCKETS];
+static s64 proc_comm_max_us[PCOM_LAT_NUM];
+
+static inline ktime_t proc_comm_lat_start(void)
+{
+	return ktime_get();
+}
+
+static void proc_comm_lat_end(int kind, ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	unsigned int b = 0;
+
+	if (us > 0)
+		b = min_t(unsigned int, fls64(us), PCOM_LAT_BUCKETS - 1);
+	proc_comm_hist[kind][b]++;
+	if (us > proc_comm_max_us[kind])
+		proc_comm_max_us[kind] = us;
+}
+#else
+static inline ktime_t proc_comm_lat_start(void)
+{
+	return ktime_set(0, 0);
+}
+
+static inline void proc_comm_lat_end(int kind, ktime_t start) {}
+#endif
+
+/*
+ * Write a command to the shared registers and tell the modem.  Called
+ * with proc_comm_lock held; returns -EAGAIN if the modem crashed.
+ */
+static int proc_comm_start(unsigned cmd, unsigned data1, unsigned data2)
+{
+	void __iomem *base = MSM_SHARED_RAM_BASE;
+
+	if (proc_comm_wait_for(base + MDM_STATUS, PCOM_READY))
+		return -EAGAIN;
+
+	writel(cmd, base + APP_COMMAND);
+	writel(data1, base + APP_DATA1);
+	writel(data2, base + APP_DATA2);
+
+	notify_other_proc_comm();
+	return 0;
+}
+
+/* Read back the result of a finished command, under proc_comm_lock */
+static int proc_comm_result(unsigned *data1, unsigned *data2)
+{
+	void __iomem *base = MSM_SHARED_RAM_BASE;
+
+	if (readl(base + APP_STATUS) == PCOM_CMD_FAIL)
+		return -EIO;
+
+	if (data1)
+		*data1 = readl(base + APP_DATA1);
+	if (data2)
+		*data2 = readl(base + APP_DATA2);
+	return 0;
+}
+
+/*
+ * Run one command on the shared registers.  Called with proc_comm_lock
+ * held; returns -EAGAIN if the modem crashed under us.
+ */
+static int proc_comm_xfer(int kind, unsigned cmd,
+			  unsigned *data1, unsigned *data2)
+{
+	void __iomem *base = MSM_SHARED_RAM_BASE;
+	ktime_t start;
+	int ret;
+
+	start = proc_comm_lat_start();
+	ret = proc_comm_start(cmd, data1 ? *data1 : 0, data2 ? *data2 : 0);
+	if (ret)
+		return ret;
+
+	if (proc_comm_wait_for(base + APP_COMMAND, PCOM_CMD_DONE))
+		return -EAGAIN;
+
+	ret = proc_comm_result(data1, data2);
+	proc_comm_lat_end(kind, start);
+	return ret;
+}
+
+/* Hand a finished asynchronous command to the worker for ->done */
+static void proc_comm_retire(struct msm_proc_comm_req *req, int ret)
+{
+	req->ret = ret;
+	spin_lock(&proc_comm_queue_lock);
+	list_add_tail(&req->list, &proc_comm_done);
+	spin_unlock(&proc_comm_queue_lock);
+}
+
+/*
+ * Finish the command in flight, @ret being -EAGAIN if the modem crashed
+ * while it was outstanding.  Called with proc_comm_lock held.
+ */
+static void proc_comm_finish(int ret)
+{
+	void __iomem *base = MSM_SHARED_RAM_BASE;
+	struct msm_proc_comm_req *req = proc_comm_inflight;
+
+	if (!ret) {
+		ret = proc_comm_result(&req->data1, &req->data2);
+		proc_comm_lat_end(PCOM_LAT_ASYNC, proc_comm_inflight_start);
+	}
+	writel(PCOM_CMD_IDLE, base + APP_COMMAND);
+	proc_comm_inflight = NULL;
+	proc_comm_retire(req, ret);
+}
+
+static struct msm_proc_comm_req *proc_comm_dequeue(void)
+{
+	struct msm_proc_comm_req *req = NULL;
+
+	spin_lock(&proc_comm_queue_lock);
+	if (!list_empty(&proc_comm_queue)) {
+		req = list_first_entry(&proc_comm_queue,
+				       struct msm_proc_comm_req, list);
+		list_del_init(&req->list);
+	}
+	spin_unlock(&proc_comm_queue_lock);
+	return req;
+}
+
+/*
+ * Commands are run in the order they were issued, whichever way.  A
+ * synchronous caller therefore first finishes the asynchronous command
+ * in flight and runs any still queued, leaving only their ->done to the
+ * worker.  Called with proc_comm_lock held.
+ */
+static void proc_comm_catch_up(void)
+{
+	void __iomem *base = MSM_SHARED_RAM_BASE;
+	struct msm_proc_comm_req *req;
+	int retired = 0;
+	int ret;
+
+	if (proc_comm_inflight) {
+		proc_comm_finish(proc_comm_wait_for(base + APP_COMMAND,
+						    PCOM_CMD_DONE));
+		retired = 1;
+	}
+
+	while ((req = proc_comm_dequeue())) {
+		ret = proc_comm_xfer(PCOM_LAT_ASYNC, req->cmd,
+				     &req->data1, &req->data2);
+		writel(PCOM_CMD_IDLE, base + APP_COMMAND);
+		proc_comm_retire(req, ret);
+		retired = 1;
+	}
+
+	if (retired)
+		queue_work(proc_comm_wq, &proc_comm_work);
+}
+
 int msm_proc_comm(unsigned cmd, unsigned *data1, unsigned *data2)
 {
 	void __iomem *base = MSM_SHARED_RAM_BASE;
@@ -111,37 +308,240 @@ int msm_proc_comm(unsigned cmd, unsigned *data1, unsigned *data2)
 
 	spin_lock_irqsave(&proc_comm_lock, flags);
 
-	for (;;) {
-		if (proc_comm_wait_for(base + MDM_STATUS, PCOM_READY))
-			continue;
+	proc_comm_catch_up();
+
+	do {
+		ret = proc_comm_xfer(PCOM_LAT_SYNC, cmd, data1, data2);
+	} while (ret == -EAGAIN);
+
+	writel(PCOM_CMD_IDLE, base + APP_COMMAND);
+
+	spin_unlock_irqrestore(&proc_comm_lock, flags);
+
+	return ret;
+}
 
-		writel(cmd, base + APP_COMMAND);
-		writel(data1 ? *data1 : 0, base + APP_DATA1);
-		writel(data2 ? *data2 : 0, base + APP_DATA2);
+/*
+ * Wait for the modem to finish @req without holding proc_comm_lock,
+ * polling briefly and then sleeping.  Returns early if a synchronous
+ * caller has finished @req for us in the meantime.
+ */
+static int proc_comm_poll(struct msm_proc_comm_req *req)
+{
+	void __iomem *base = MSM_SHARED_RAM_BASE;
+	unsigned int spins = PROC_COMM_SPIN_US;
 
-		notify_other_proc_comm();
+	for (;;) {
+		if (ACCESS_ONCE(proc_comm_inflight) != req)
+			return 0;
+		if (readl(base + APP_COMMAND) == PCOM_CMD_DONE)
+			return 0;
 
-		if (proc_comm_wait_for(base + APP_COMMAND, PCOM_CMD_DONE))
-			continue;
+		if (msm_check_for_modem_crash)
+			if (msm_check_for_modem_crash())
+				return -EAGAIN;
 
-		if (readl(base + APP_STATUS) != PCOM_CMD_FAIL) {
-			if (data1)
-				*data1 = readl(base + APP_DATA1);
-			if (data2)
-				*data2 = readl(base + APP_DATA2);
-			ret = 0;
+		if (spins) {
+			spins--;
+			udelay(1);
 		} else {
-			ret = -EIO;
+			usleep_range(50, 100);
 		}
-		break;
 	}
+}
 
-	writel(PCOM_CMD_IDLE, base + APP_COMMAND);
+/*
+ * Start the next queued command and wait for it with interrupts on;
+ * proc_comm_lock is only held to write the command and to read back
+ * the result.  Unlike a synchronous caller, a command is not retried
+ * after a modem crash; it fails with -EAGAIN instead.  Returns 0 once
+ * the queue is empty.
+ */
+static int proc_comm_run_next(void)
+{
+	struct msm_proc_comm_req *req;
+	unsigned long flags;
+	int ret;
 
+	spin_lock_irqsave(&proc_comm_lock, flags);
+	req = proc_comm_dequeue();
+	if (!req) {
+		spin_unlock_irqrestore(&proc_comm_lock, flags);
+		return 0;
+	}
+
+	proc_comm_inflight_start = proc_comm_lat_start();
+	ret = proc_comm_start(req->cmd, req->data1, req->data2);
+	if (ret) {
+		proc_comm_retire(req, ret);
+		spin_unlock_irqrestore(&proc_comm_lock, flags);
+		return 1;
+	}
+	proc_comm_inflight = req;
 	spin_unlock_irqrestore(&proc_comm_lock, flags);
 
-	return ret;
+	ret = proc_comm_poll(req);
+
+	spin_lock_irqsave(&proc_comm_lock, flags);
+	if (proc_comm_inflight == req)
+		proc_comm_finish(ret);
+	spin_unlock_irqrestore(&proc_comm_lock, flags);
+	return 1;
+}
+
+/* Call ->done for the finished commands, in order */
+static void proc_comm_complete(void)
+{
+	struct msm_proc_comm_req *req;
+	unsigned long flags;
+
+	for (;;) {
+		spin_lock_irqsave(&proc_comm_queue_lock, flags);
+		if (list_empty(&proc_comm_done)) {
+			spin_unlock_irqrestore(&proc_comm_queue_lock, flags);
+			break;
+		}
+		req = list_first_entry(&proc_comm_done,
+				       struct msm_proc_comm_req, list);
+		list_del_init(&req->list);
+		spin_unlock_irqrestore(&proc_comm_queue_lock, flags);
+
+		if (req->done)
+			req->done(req);
+	}
+}
+
+static void proc_comm_do_work(struct work_struct *work)
+{
+	int more;
+
+	do {
+		more = proc_comm_run_next();
+		proc_comm_complete();
+	} while (more);
+}
+
+/**
+ * msm_proc_comm_submit - queue a batch of proc_comm commands
+ * @reqs: list of struct msm_proc_comm_req, emptied on return
+ *
+ * The commands are run in order by a worker thread, which waits for
+ * the modem with interrupts enabled, and ->done is called in that
+ * thread as each one completes, with ->ret, ->data1 and ->data2
+ * holding the result.  ->ret is -EAGAIN if the modem crashed while the
+ * command was outstanding.  A later msm_proc_comm() call runs after
+ * every command submitted before it.  May be called from atomic
+ * context; before the worker exists the commands are run synchronously.
+ */
+void msm_proc_comm_submit(struct list_head *reqs)
+{
+	struct msm_proc_comm_req *req, *next;
+	unsigned long flags;
+
+	if (!proc_comm_wq) {
+		list_for_each_entry_safe(req, next, reqs, list) {
+			list_del_init(&req->list);
+			req->ret = msm_proc_comm(req->cmd, &req->data1,
+						 &req->data2);
+			if (req->done)
+				req->done(req);
+		}
+		return;
+	}
+
+	spin_lock_irqsave(&proc_comm_queue_lock, flags);
+	list_splice_tail_init(reqs, &proc_comm_queue);
+	spin_unlock_irqrestore(&proc_comm_queue_lock, flags);
+
+	queue_work(proc_comm_wq, &proc_comm_work);
+}
+
+/**
+ * msm_proc_comm_async - queue a single proc_comm command
+ * @req: the command; see msm_proc_comm_submit()
+ */
+void msm_proc_comm_async(struct msm_proc_comm_req *req)
+{
+	LIST_HEAD(reqs);
+
+	list_add_tail(&req->list, &reqs);
+	msm_proc_comm_submit(&reqs);
+}
+
+#if defined(CONFIG_DEBUG_FS)
+static int proc_comm_latency_show(struct seq_file *s, void *data)
+{
+	static const char * const names[] = { "sync", "async" };
+	unsigned long flags;
+	unsigned int b;
+	int kind;
+
+	/* Bucket n: [2^(n-1), 2^n) us */
+	spin_lock_irqsave(&proc_comm_lock, flags);
+	for (kind = 0; kind < PCOM_LAT_NUM; kind++) {
+		seq_printf(s, "%-5s max_us %lld:", names[kind],
+			   proc_comm_max_us[kind]);
+		for (b = 0; b < PCOM_LAT_BUCKETS; b++)
+			seq_printf(s, " %u", proc_comm_hist[kind][b]);
+		seq_putc(s, '\n');
+	}
+	spin_unlock_irqrestore(&proc_comm_lock, flags);
+	return 0;
+}
+
+static int proc_comm_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, proc_comm_latency_show, NULL);
+}
+
+static ssize_t proc_comm_latency_write(struct file *file,
+				       const char __user *ubuf,
+				       size_t count, loff_t *ppos)
+{
+	unsigned long flags;
+
+	/* Any write clears the histogram */
+	spin_lock_irqsave(&proc_comm_lock, flags);
+	memset(proc_comm_hist, 0, sizeof(proc_comm_hist));
+	memset(proc_comm_max_us, 0, sizeof(proc_comm_max_us));
+	spin_unlock_irqrestore(&proc_comm_lock, flags);
+	return count;
+}
+
+static const struct file_operations proc_comm_latency_ops = {
+	.open		= proc_comm_latency_open,
+	.read		= seq_read,
+	.write		= proc_comm_latency_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void proc_comm_debugfs_init(void)
+{
+	struct dentry *dent;
+
+	dent = debugfs_create_dir("proc_comm", 0);
+	if (IS_ERR(dent))
+		return;
+
+	debugfs_create_file("latency", 0644, dent, NULL,
+			    &proc_comm_latency_ops);
+}
+#else
+static void proc_comm_debugfs_init(void) {}
+#endif
+
+static int __init proc_comm_init(void)
+{
+	proc_comm_wq = create_singlethread_workqueue("proc_comm");
+	if (!proc_comm_wq)
+		pr_err("proc_comm: no workqueue, async commands run "
+		       "synchronously\n");
+
+	proc_comm_debugfs_init();
+	return 0;
 }
+arch_initcall(proc_comm_init);
 
 /*
  * We need to wait for the ARM9 to at least partially boot
@@ -17,6 +17,7 @@
 #define _ARCH_ARM_MACH_MSM_PROC_COMM_H_
 
 #include <linux/init.h>
+#include <linux/list.h>
 
 enum {
 	PCOM_CMD_IDLE = 0x0,
@@ -273,4 +274,18 @@ void msm_proc_comm_reset_modem_now(void);
 int msm_proc_comm(unsigned cmd, unsigned *data1, unsigned *data2);
 void __init proc_comm_boot_wait(void);
 
+/* A command for msm_proc_comm_async() or msm_proc_comm_submit() */
+struct msm_proc_comm_req {
+	struct list_head list;
+	unsigned cmd;
+	unsigned data1;			/* in and out */
+	unsigned data2;			/* in and out */
+	int ret;
+	void (*done)(struct msm_proc_comm_req *req);
+	void *context;
+};
+
+void msm_proc_comm_async(struct msm_proc_comm_req *req);
+void msm_proc_comm_submit(struct list_head *reqs);
+
 #endif
@@ -122,14 +122,17 @@ static struct dentry *stats_dentry;
 #define RMT_STORAGE_EVENT_CB_TYPE_PROC          3
 #define RMT_STORAGE_READ_IOVEC_CB_TYPE_PROC     4
 
+static const struct msm_rpc_xdr_field rmt_storage_send_sts_xdr[] = {
+	XDR_FIELD(struct rmt_storage_send_sts, handle, UINT32),
+	XDR_FIELD(struct rmt_storage_send_sts, err_code, UINT32),
+	XDR_FIELD(struct rmt_storage_send_sts, data, UINT32),
+};
+
 static int rmt_storage_send_sts_arg(struct msm_rpc_client *client,
 				struct msm_rpc_xdr *xdr, void *data)
 {
-	struct rmt_storage_send_sts *args = data;
-
-	xdr_send_uint32(xdr, &args->handle);
-	xdr_send_uint32(xdr, &args->err_code);
-	xdr_send_uint32(xdr, &args->data);
+	xdr_send_struct(xdr, data, rmt_storage_send_sts_xdr,
+			ARRAY_SIZE(rmt_storage_send_sts_xdr));
 	return 0;
 }
 
@@ -230,6 +233,24 @@ struct rmt_storage_event_params {
 	} params;
 };
 
+static const struct msm_rpc_xdr_field rmt_storage_rw_block_xdr[] = {
+	XDR_FIELD(struct rmt_storage_rw_block_args, handle, UINT32),
+	XDR_FIELD(struct rmt_storage_rw_block_args, data_phy_addr, UINT32),
+	XDR_FIELD(struct rmt_storage_rw_block_args, sector_addr, UINT32),
+	XDR_FIELD(struct rmt_storage_rw_block_args, num_sector, UINT32),
+};
+
+static const struct msm_rpc_xdr_field rmt_storage_user_data_xdr[] = {
+	XDR_FIELD(struct rmt_storage_user_data_args, handle, UINT32),
+	XDR_FIELD(struct rmt_storage_user_data_args, data, UINT32),
+};
+
+static const struct msm_rpc_xdr_field rmt_storage_iovec_xdr[] = {
+	XDR_FIELD(struct rmt_storage_iovec_desc, sector_addr, UINT32),
+	XDR_FIELD(struct rmt_storage_iovec_desc, data_phy_addr, UINT32),
+	XDR_FIELD(struct rmt_storage_iovec_desc, num_sector, UINT32),
+};
+
 static int rmt_storage_parse_params(struct msm_rpc_xdr *xdr,
 		struct rmt_storage_event_params *event)
 {
@@ -244,16 +265,10 @@ static int rmt_storage_parse_params(struct msm_rpc_xdr *xdr,
 		break;
 	}
 
-	case RMT_STORAGE_EVNT_WRITE_BLOCK: {
-		struct rmt_storage_rw_block_args *args;
-		args = &event->params.block;
-
-		xdr_recv_uint32(xdr, &args->handle);
-		xdr_recv_uint32(xdr, &args->data_phy_addr);
-		xdr_recv_uint32(xdr, &args->sector_addr);
-		xdr_recv_uint32(xdr, &args->num_sector);
-		break;
-	}
+	case RMT_STORAGE_EVNT_WRITE_BLOCK:
+		return xdr_recv_struct(xdr, &event->params.block,
+				       rmt_storage_rw_block_xdr,
+				       ARRAY_SIZE(rmt_storage_rw_block_xdr));
 
 	case RMT_STORAGE_EVNT_GET_DEV_ERROR: {
 		struct rmt_storage_get_err_args *args;
@@ -263,14 +278,10 @@ static int rmt_storage_parse_params(struct msm_rpc_xdr *xdr,
 		break;
 	}
 
-	case RMT_STORAGE_EVNT_SEND_USER_DATA: {
-		struct rmt_storage_user_data_args *args;
-		args = &event->params.user_data;
-
-		xdr_recv_uint32(xdr, &args->handle);
-		xdr_recv_uint32(xdr, &args->data);
-		break;
-	}
+	case RMT_STORAGE_EVNT_SEND_USER_DATA:
+		return xdr_recv_struct(xdr, &event->params.user_data,
+				       rmt_storage_user_data_xdr,
+				       ARRAY_SIZE(rmt_storage_user_data_xdr));
 
 	default:
 		pr_err("%s: unknown event %d\n", __func__, event->type);
@@ -427,7 +438,7 @@ static int rmt_storage_event_write_iovec_cb(
 
 	xdr_recv_uint32(xdr, &event_type);
 	if (event_type != RMT_STORAGE_EVNT_WRITE_IOVEC)
-		return -1;
+		return -EINVAL;
 
 	pr_info("%s: write iovec callback received\n", __func__);
 	xdr_recv_uint32(xdr, &event_args->handle);
@@ -438,16 +449,18 @@ static int rmt_storage_event_write_iovec_cb(
 	stats = &client_stats[event_args->handle - 1];
 	stats->wr_stats.start = ktime_get();
 #endif
+	if (ent > RMT_STORAGE_MAX_IOVEC_XFR_CNT ||
+	    xdr_recv_struct_array(xdr, event_args->xfer_desc,
+				  sizeof(*xfer), ent, rmt_storage_iovec_xdr,
+				  ARRAY_SIZE(rmt_storage_iovec_xdr)))
+		return -EINVAL;
+
 	for (i = 0; i < ent; i++) {
 		xfer = &event_args->xfer_desc[i];
-		xdr_recv_uint32(xdr, &xfer->sector_addr);
-		xdr_recv_uint32(xdr, &xfer->data_phy_addr);
-		xdr_recv_uint32(xdr, &xfer->num_sector);
-
 		if (xfer->data_phy_addr < _rmc->rmt_shrd_mem.start ||
 		   xfer->data_phy_addr > (_rmc->rmt_shrd_mem.start +
 		   _rmc->rmt_shrd_mem.size))
-			return -1;
+			return -EINVAL;
 
 		pr_debug("sec_addr = %u, data_addr = %x, num_sec = %d\n",
 			xfer->sector_addr, xfer->data_phy_addr,
@@ -485,12 +498,14 @@ static int rmt_storage_event_read_iovec_cb(
 	stats = &client_stats[event_args->handle - 1];
 	stats->rd_stats.start = ktime_get();
 #endif
+	if (ent > RMT_STORAGE_MAX_IOVEC_XFR_CNT ||
+	    xdr_recv_struct_array(xdr, event_args->xfer_desc,
+				  sizeof(*xfer), ent, rmt_storage_iovec_xdr,
+				  ARRAY_SIZE(rmt_storage_iovec_xdr)))
+		return -EINVAL;
+
 	for (i = 0; i < ent; i++) {
 		xfer = &event_args->xfer_desc[i];
-		xdr_recv_uint32(xdr, &xfer->sector_addr);
-		xdr_recv_uint32(xdr, &xfer->data_phy_addr);
-		xdr_recv_uint32(xdr, &xfer->num_sector);
-
 		if (xfer->data_phy_addr < _rmc->rmt_shrd_mem.start ||
 		   xfer->data_phy_addr > (_rmc->rmt_shrd_mem.start +
 		   _rmc->rmt_shrd_mem.size))
@@ -822,13 +837,16 @@ struct rmt_storage_reg_cb_args {
 	uint32_t cb_id;
 };
 
+static const struct msm_rpc_xdr_field rmt_storage_reg_cb_xdr[] = {
+	XDR_FIELD(struct rmt_storage_reg_cb_args, event, UINT32),
+	XDR_FIELD(struct rmt_storage_reg_cb_args, cb_id, UINT32),
+};
+
 static int rmt_storage_arg_cb(struct msm_rpc_client *client,
 		struct msm_rpc_xdr *xdr, void *data)
 {
-	struct rmt_storage_reg_cb_args *args = data;
-
-	xdr_send_uint32(xdr, &args->event);
-	xdr_send_uint32(xdr, &args->cb_id);
+	xdr_send_struct(xdr, data, rmt_storage_reg_cb_xdr,
+			ARRAY_SIZE(rmt_storage_reg_cb_xdr));
 	return 0;
 }
 
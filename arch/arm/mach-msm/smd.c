@@ -26,6 +26,8 @@
 #include <linux/slab.h>
 #include <linux/debugfs.h>
 #include <linux/delay.h>
+#include <linux/log2.h>
+#include <linux/hrtimer.h>
 
 #include <mach/msm_smd.h>
 #include <mach/system.h>
@@ -122,9 +124,9 @@ static int check_for_modem_crash(void)
 	return 0;
 }
 
-/* the spinlock is used to synchronize between the
- * irq handler and code that mutates the channel
- * list or fiddles with channel state
+/* the spinlock protects the channel lists and the open
+ * masks; the state of each channel is protected by its
+ * own ch->lock, which the irq handlers take one at a time
  */
 DEFINE_SPINLOCK(smd_lock);
 DEFINE_SPINLOCK(smem_lock);
@@ -140,10 +142,44 @@ static int smd_initialized;
 LIST_HEAD(smd_ch_closed_list);
 LIST_HEAD(smd_ch_list_modem);
 LIST_HEAD(smd_ch_list_dsp);
+LIST_HEAD(smd_ch_list_loopback);
 
 static unsigned char smd_ch_allocated[64];
 static struct work_struct probe_work;
 
+/* every channel ever allocated, by cid; entries are never freed */
+static struct smd_channel *smd_ch_tbl[SMD_CH_SLOTS];
+
+/* open channels per edge, and channels with events to deliver */
+enum {
+	SMD_EDGE_MODEM,
+	SMD_EDGE_DSP,
+	SMD_EDGE_LOOPBACK,
+	SMD_NUM_EDGES,
+};
+static DECLARE_BITMAP(smd_ch_open_modem, SMD_CH_SLOTS);
+static DECLARE_BITMAP(smd_ch_open_dsp, SMD_CH_SLOTS);
+static DECLARE_BITMAP(smd_ch_open_loopback, SMD_CH_SLOTS);
+static DECLARE_BITMAP(smd_ch_pending, SMD_CH_SLOTS);
+
+static unsigned long *smd_ch_open[SMD_NUM_EDGES] = {
+	[SMD_EDGE_MODEM] = smd_ch_open_modem,
+	[SMD_EDGE_DSP] = smd_ch_open_dsp,
+	[SMD_EDGE_LOOPBACK] = smd_ch_open_loopback,
+};
+
+static int smd_ch_edge(struct smd_channel *ch)
+{
+	switch (ch->type & SMD_TYPE_MASK) {
+	case SMD_TYPE_APPS_MODEM:
+		return SMD_EDGE_MODEM;
+	case SMD_TYPE_LOOPBACK:
+		return SMD_EDGE_LOOPBACK;
+	default:
+		return SMD_EDGE_DSP;
+	}
+}
+
 /* how many bytes are available for reading */
 static int smd_stream_read_avail(struct smd_channel *ch)
 {
@@ -307,8 +343,12 @@ static void do_smd_probe(void)
 	}
 }
 
-static void smd_state_change(struct smd_channel *ch,
-			     unsigned last, unsigned next)
+/*
+ * Track a state change of the remote side and return the event to
+ * report for it.  Called with ch->lock held.
+ */
+static unsigned smd_state_change(struct smd_channel *ch,
+				 unsigned last, unsigned next)
 {
 	ch->last_state = next;
 
@@ -320,117 +360,183 @@ static void smd_state_change(struct smd_channel *ch,
 	case SMD_SS_OPENED:
 		if (ch->send->state != SMD_SS_OPENED)
 			ch_set_state(ch, SMD_SS_OPENED);
-		ch->notify(ch->priv, SMD_EVENT_OPEN);
-		break;
+		return SMD_EVENT_OPEN;
 	case SMD_SS_FLUSHING:
 	case SMD_SS_RESET:
 		/* we should force them to close? */
 	default:
-		ch->notify(ch->priv, SMD_EVENT_CLOSE);
+		return SMD_EVENT_CLOSE;
+	}
+}
+
+/* does the channel have anything for us?  no locking, it only peeks */
+static inline int smd_need_int(struct smd_channel *ch)
+{
+	if (ch_is_open(ch)) {
+		if (ch->recv->fHEAD || ch->recv->fTAIL || ch->recv->fSTATE)
+			return 1;
 	}
+	if (ch->recv->state != ch->last_state)
+		return 1;
+	return 0;
 }
 
-static void handle_smd_irq(struct list_head *list, void (*notify)(void))
+/*
+ * Deliver the events waiting on @ch.  A channel is dispatched by one
+ * cpu at a time; whoever finds it busy asks the current dispatcher to
+ * go around once more.  The notify callback runs without ch->lock, so
+ * it is free to read from or write to the channel.
+ *
+ * Returns 1 if flags set by the remote side were consumed.
+ */
+static int smd_dispatch_channel(struct smd_channel *ch)
 {
+	void (*notify)(void *priv, unsigned flags);
 	unsigned long flags;
-	struct smd_channel *ch;
-	int do_notify = 0;
-	unsigned ch_flags;
-	unsigned tmp;
+	unsigned state, event;
+	int data, consumed = 0;
+	void *priv;
+
+	spin_lock_irqsave(&ch->lock, flags);
+	if (ch->dispatching) {
+		ch->redispatch = 1;
+		spin_unlock_irqrestore(&ch->lock, flags);
+		return 0;
+	}
+	ch->dispatching = 1;
+
+	do {
+		ch->redispatch = 0;
+		data = ch->kicked;
+		ch->kicked = 0;
 
-	spin_lock_irqsave(&smd_lock, flags);
-	list_for_each_entry(ch, list, ch_list) {
-		ch_flags = 0;
 		if (ch_is_open(ch)) {
 			if (ch->recv->fHEAD) {
 				ch->recv->fHEAD = 0;
-				ch_flags |= 1;
-				do_notify |= 1;
+				data = consumed = 1;
 			}
 			if (ch->recv->fTAIL) {
 				ch->recv->fTAIL = 0;
-				ch_flags |= 2;
-				do_notify |= 1;
+				data = consumed = 1;
 			}
 			if (ch->recv->fSTATE) {
 				ch->recv->fSTATE = 0;
-				ch_flags |= 4;
-				do_notify |= 1;
+				data = consumed = 1;
 			}
 		}
-		tmp = ch->recv->state;
-		if (tmp != ch->last_state)
-			smd_state_change(ch, ch->last_state, tmp);
-		if (ch_flags) {
+
+		event = 0;
+		state = ch->recv->state;
+		if (state != ch->last_state)
+			event = smd_state_change(ch, ch->last_state, state);
+		if (data)
 			ch->update_state(ch);
-			ch->notify(ch->priv, SMD_EVENT_DATA);
+
+		notify = ch->notify;
+		priv = ch->priv;
+		spin_unlock_irqrestore(&ch->lock, flags);
+
+		if (event)
+			notify(priv, event);
+		if (data)
+			notify(priv, SMD_EVENT_DATA);
+
+		spin_lock_irqsave(&ch->lock, flags);
+	} while (ch->redispatch);
+
+	ch->dispatching = 0;
+	spin_unlock_irqrestore(&ch->lock, flags);
+
+	return consumed;
+}
+
+/* mark the open channels of @edge that have events, return how many */
+static int smd_scan_edge(int edge)
+{
+	struct smd_channel *ch;
+	int n, count = 0;
+
+	for_each_set_bit(n, smd_ch_open[edge], SMD_CH_SLOTS) {
+		ch = smd_ch_tbl[n];
+		if (smd_need_int(ch)) {
+			set_bit(n, smd_ch_pending);
+			count++;
 		}
 	}
-	if (do_notify)
-		notify();
-	spin_unlock_irqrestore(&smd_lock, flags);
+
+	return count;
+}
+
+static void smd_dispatch_pending(void)
+{
+	struct smd_channel *ch;
+	int kick_modem = 0;
+	int kick_dsp = 0;
+	int n;
+
+	for_each_set_bit(n, smd_ch_pending, SMD_CH_SLOTS) {
+		if (!test_and_clear_bit(n, smd_ch_pending))
+			continue;
+		ch = smd_ch_tbl[n];
+		if (!smd_dispatch_channel(ch))
+			continue;
+
+		switch (smd_ch_edge(ch)) {
+		case SMD_EDGE_MODEM:
+			kick_modem = 1;
+			break;
+		case SMD_EDGE_DSP:
+			kick_dsp = 1;
+			break;
+		}
+	}
+
+	if (kick_modem)
+		notify_modem_smd();
+	if (kick_dsp)
+		notify_dsp_smd();
+}
+
+static void handle_smd_irq(int edge)
+{
+	if (smd_scan_edge(edge))
+		smd_dispatch_pending();
 	do_smd_probe();
 }
 
 static irqreturn_t smd_modem_irq_handler(int irq, void *data)
 {
-	handle_smd_irq(&smd_ch_list_modem, notify_modem_smd);
+	handle_smd_irq(SMD_EDGE_MODEM);
 	return IRQ_HANDLED;
 }
 
 #if defined(CONFIG_QDSP6)
 static irqreturn_t smd_dsp_irq_handler(int irq, void *data)
 {
-	handle_smd_irq(&smd_ch_list_dsp, notify_dsp_smd);
+	handle_smd_irq(SMD_EDGE_DSP);
 	return IRQ_HANDLED;
 }
 #endif
 
-static void smd_fake_irq_handler(unsigned long arg)
+static void smd_dispatch_tasklet_fn(unsigned long arg)
 {
-	handle_smd_irq(&smd_ch_list_modem, notify_modem_smd);
-	handle_smd_irq(&smd_ch_list_dsp, notify_dsp_smd);
+	smd_dispatch_pending();
 }
 
-static DECLARE_TASKLET(smd_fake_irq_tasklet, smd_fake_irq_handler, 0);
-
-static inline int smd_need_int(struct smd_channel *ch)
-{
-	if (ch_is_open(ch)) {
-		if (ch->recv->fHEAD || ch->recv->fTAIL || ch->recv->fSTATE)
-			return 1;
-		if (ch->recv->state != ch->last_state)
-			return 1;
-	}
-	return 0;
-}
+static DECLARE_TASKLET(smd_dispatch_tasklet, smd_dispatch_tasklet_fn, 0);
 
 void smd_sleep_exit(void)
 {
-	unsigned long flags;
-	struct smd_channel *ch;
-	int need_int = 0;
+	int need_int;
 
-	spin_lock_irqsave(&smd_lock, flags);
-	list_for_each_entry(ch, &smd_ch_list_modem, ch_list) {
-		if (smd_need_int(ch)) {
-			need_int = 1;
-			break;
-		}
-	}
-	list_for_each_entry(ch, &smd_ch_list_dsp, ch_list) {
-		if (smd_need_int(ch)) {
-			need_int = 1;
-			break;
-		}
-	}
-	spin_unlock_irqrestore(&smd_lock, flags);
+	need_int = smd_scan_edge(SMD_EDGE_MODEM);
+	need_int += smd_scan_edge(SMD_EDGE_DSP);
 	do_smd_probe();
 
 	if (need_int) {
 		if (msm_smd_debug_mask & MSM_SMD_DEBUG)
 			pr_info("smd_sleep_exit need interrupt\n");
-		tasklet_schedule(&smd_fake_irq_tasklet);
+		tasklet_schedule(&smd_dispatch_tasklet);
 	}
 }
 
@@ -438,21 +544,17 @@ void smd_sleep_exit(void)
 void smd_kick(smd_channel_t *ch)
 {
 	unsigned long flags;
-	unsigned tmp;
 
-	spin_lock_irqsave(&smd_lock, flags);
+	spin_lock_irqsave(&ch->lock, flags);
 	ch->update_state(ch);
-	tmp = ch->recv->state;
-	if (tmp != ch->last_state) {
-		ch->last_state = tmp;
-		if (tmp == SMD_SS_OPENED)
-			ch->notify(ch->priv, SMD_EVENT_OPEN);
-		else
-			ch->notify(ch->priv, SMD_EVENT_CLOSE);
-	}
-	ch->notify(ch->priv, SMD_EVENT_DATA);
+	ch->kicked = 1;
+	spin_unlock_irqrestore(&ch->lock, flags);
+
+	/* never preempted mid-dispatch, smd_close() relies on it */
+	local_bh_disable();
+	smd_dispatch_channel(ch);
+	local_bh_enable();
 	ch->notify_other_cpu();
-	spin_unlock_irqrestore(&smd_lock, flags);
 }
 
 static int smd_is_packet(int chn, unsigned type)
@@ -470,16 +572,14 @@ static int smd_is_packet(int chn, unsigned type)
 		return 0;
 }
 
-static int smd_stream_write(smd_channel_t *ch, const void *_data, int len)
+/* copy into the fifo without notifying the other side */
+static int ch_write(smd_channel_t *ch, const void *_data, int len)
 {
 	void *ptr;
 	const unsigned char *buf = _data;
 	unsigned xfer;
 	int orig_len = len;
 
-	if (len < 0)
-		return -EINVAL;
-
 	while ((xfer = ch_write_buffer(ch, &ptr)) != 0) {
 		if (!ch_is_open(ch))
 			break;
@@ -493,9 +593,20 @@ static int smd_stream_write(smd_channel_t *ch, const void *_data, int len)
 			break;
 	}
 
+	return orig_len - len;
+}
+
+static int smd_stream_write(smd_channel_t *ch, const void *data, int len)
+{
+	int r;
+
+	if (len < 0)
+		return -EINVAL;
+
+	r = ch_write(ch, data, len);
 	ch->notify_other_cpu();
 
-	return orig_len - len;
+	return r;
 }
 
 static int smd_packet_write(smd_channel_t *ch, const void *_data, int len)
@@ -511,8 +622,10 @@ static int smd_packet_write(smd_channel_t *ch, const void *_data, int len)
 	hdr[0] = len;
 	hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
 
-	smd_stream_write(ch, hdr, sizeof(hdr));
-	smd_stream_write(ch, _data, len);
+	/* one interrupt for the whole packet */
+	ch_write(ch, hdr, sizeof(hdr));
+	ch_write(ch, _data, len);
+	ch->notify_other_cpu();
 
 	return len;
 }
@@ -546,10 +659,10 @@ static int smd_packet_read(smd_channel_t *ch, void *data, int len)
 	if (r > 0)
 		ch->notify_other_cpu();
 
-	spin_lock_irqsave(&smd_lock, flags);
+	spin_lock_irqsave(&ch->lock, flags);
 	ch->current_packet -= r;
 	update_packet_state(ch);
-	spin_unlock_irqrestore(&smd_lock, flags);
+	spin_unlock_irqrestore(&ch->lock, flags);
 
 	return r;
 }
@@ -558,12 +671,18 @@ static int smd_alloc_channel(const char *name, uint32_t cid, uint32_t type)
 {
 	struct smd_channel *ch;
 
+	if (cid >= SMD_CHANNELS) {
+		pr_err("smd_alloc_channel() bad cid %d\n", cid);
+		return -1;
+	}
+
 	ch = kzalloc(sizeof(struct smd_channel), GFP_KERNEL);
 	if (ch == 0) {
 		pr_err("smd_alloc_channel() out of memory\n");
 		return -1;
 	}
 	ch->n = cid;
+	spin_lock_init(&ch->lock);
 
 	if (_smd_alloc_channel(ch)) {
 		kfree(ch);
@@ -604,6 +723,66 @@ static int smd_alloc_channel(const char *name, uint32_t cid, uint32_t type)
 	pr_info("smd_alloc_channel() cid=%02d size=%05d '%s'\n",
 		ch->n, ch->fifo_size, ch->name);
 
+	smd_ch_tbl[ch->n] = ch;
+
+	mutex_lock(&smd_creation_mutex);
+	list_add(&ch->ch_list, &smd_ch_closed_list);
+	mutex_unlock(&smd_creation_mutex);
+
+	platform_device_register(&ch->pdev);
+	return 0;
+}
+
+#ifdef CONFIG_MSM_SMD_LOOPBACK
+/*
+ * A stream channel whose two halves are the same piece of local
+ * memory: everything written to it is read back.  It goes through
+ * the same dispatch path as the modem channels, with the "interrupt"
+ * raised by marking it pending, so SMD clients and the dispatch code
+ * can be exercised without a modem.
+ */
+static struct smd_half_channel smd_loopback_ctl;
+static unsigned char smd_loopback_data[SMD_BUF_SIZE];
+
+static void notify_loopback_smd(void)
+{
+	set_bit(SMD_LOOPBACK_CID, smd_ch_pending);
+	tasklet_schedule(&smd_dispatch_tasklet);
+}
+
+static int smd_alloc_loopback_channel(void)
+{
+	struct smd_channel *ch;
+
+	ch = kzalloc(sizeof(struct smd_channel), GFP_KERNEL);
+	if (ch == 0) {
+		pr_err("smd_alloc_loopback_channel() out of memory\n");
+		return -1;
+	}
+	ch->n = SMD_LOOPBACK_CID;
+	spin_lock_init(&ch->lock);
+
+	ch->send = &smd_loopback_ctl;
+	ch->recv = &smd_loopback_ctl;
+	ch->send_data = smd_loopback_data;
+	ch->recv_data = smd_loopback_data;
+	ch->fifo_size = SMD_BUF_SIZE;
+	ch->fifo_mask = ch->fifo_size - 1;
+	ch->type = SMD_TYPE_LOOPBACK | SMD_KIND_STREAM;
+	ch->notify_other_cpu = notify_loopback_smd;
+
+	ch->read = smd_stream_read;
+	ch->write = smd_stream_write;
+	ch->read_avail = smd_stream_read_avail;
+	ch->write_avail = smd_stream_write_avail;
+	ch->update_state = update_stream_state;
+
+	strcpy(ch->name, "LOCAL_LOOPBACK");
+	ch->pdev.name = ch->name;
+	ch->pdev.id = -1;
+
+	smd_ch_tbl[ch->n] = ch;
+
 	mutex_lock(&smd_creation_mutex);
 	list_add(&ch->ch_list, &smd_ch_closed_list);
 	mutex_unlock(&smd_creation_mutex);
@@ -611,6 +790,78 @@ static int smd_alloc_channel(const char *name, uint32_t cid, uint32_t type)
 	platform_device_register(&ch->pdev);
 	return 0;
 }
+#else
+static inline int smd_alloc_loopback_channel(void)
+{
+	return 0;
+}
+#endif
+
+#ifdef CONFIG_MSM_SMD_TEST
+/*
+ * Channels in local memory whose other end is played by smd_test.c,
+ * which raises their "interrupt" with smd_test_signal().  Like the
+ * loopback channel they sit on the loopback edge, so the modem is
+ * never notified for them.
+ */
+int smd_test_channel_add(unsigned n, const char *name, int packet,
+			 struct smd_half_channel *send,
+			 struct smd_half_channel *recv,
+			 unsigned char *send_data, unsigned char *recv_data,
+			 unsigned fifo_size, void (*notify_other_cpu)(void))
+{
+	struct smd_channel *ch;
+
+	if (n >= SMD_TEST_CHANNELS || smd_ch_tbl[SMD_TEST_CID(n)] ||
+	    !is_power_of_2(fifo_size))
+		return -EINVAL;
+
+	ch = kzalloc(sizeof(struct smd_channel), GFP_KERNEL);
+	if (ch == 0)
+		return -ENOMEM;
+	ch->n = SMD_TEST_CID(n);
+	spin_lock_init(&ch->lock);
+
+	ch->send = send;
+	ch->recv = recv;
+	ch->send_data = send_data;
+	ch->recv_data = recv_data;
+	ch->fifo_size = fifo_size;
+	ch->fifo_mask = fifo_size - 1;
+	ch->notify_other_cpu = notify_other_cpu;
+
+	if (packet) {
+		ch->type = SMD_TYPE_LOOPBACK | SMD_KIND_PACKET;
+		ch->read = smd_packet_read;
+		ch->write = smd_packet_write;
+		ch->read_avail = smd_packet_read_avail;
+		ch->write_avail = smd_packet_write_avail;
+		ch->update_state = update_packet_state;
+	} else {
+		ch->type = SMD_TYPE_LOOPBACK | SMD_KIND_STREAM;
+		ch->read = smd_stream_read;
+		ch->write = smd_stream_write;
+		ch->read_avail = smd_stream_read_avail;
+		ch->write_avail = smd_stream_write_avail;
+		ch->update_state = update_stream_state;
+	}
+
+	strlcpy(ch->name, name, sizeof(ch->name));
+	smd_ch_tbl[ch->n] = ch;
+
+	mutex_lock(&smd_creation_mutex);
+	list_add(&ch->ch_list, &smd_ch_closed_list);
+	mutex_unlock(&smd_creation_mutex);
+
+	return 0;
+}
+
+void smd_test_signal(unsigned n)
+{
+	set_bit(SMD_TEST_CID(n), smd_ch_pending);
+	tasklet_schedule(&smd_dispatch_tasklet);
+}
+#endif
 
 static void smd_channel_probe_worker(struct work_struct *work)
 {
@@ -687,20 +938,16 @@ int smd_open(const char *name, smd_channel_t **_ch,
 	if (notify == 0)
 		notify = do_nothing_notify;
 
+	spin_lock_irqsave(&ch->lock, flags);
 	ch->notify = notify;
 	ch->current_packet = 0;
 	ch->last_state = SMD_SS_CLOSED;
 	ch->priv = priv;
+	ch->kicked = 0;
+	ch->write_remaining = 0;
 
 	*_ch = ch;
 
-	spin_lock_irqsave(&smd_lock, flags);
-
-	if ((ch->type & SMD_TYPE_MASK) == SMD_TYPE_APPS_MODEM)
-		list_add(&ch->ch_list, &smd_ch_list_modem);
-	else
-		list_add(&ch->ch_list, &smd_ch_list_dsp);
-
 	/* If the remote side is CLOSING, we need to get it to
 	 * move to OPENING (which we'll do by moving from CLOSED to
 	 * OPENING) and then get it to move from OPENING to
@@ -715,7 +962,22 @@ int smd_open(const char *name, smd_channel_t **_ch,
 	} else {
 		ch_set_state(ch, SMD_SS_OPENED);
 	}
+	spin_unlock_irqrestore(&ch->lock, flags);
+
+	spin_lock_irqsave(&smd_lock, flags);
+	switch (smd_ch_edge(ch)) {
+	case SMD_EDGE_MODEM:
+		list_add(&ch->ch_list, &smd_ch_list_modem);
+		break;
+	case SMD_EDGE_LOOPBACK:
+		list_add(&ch->ch_list, &smd_ch_list_loopback);
+		break;
+	default:
+		list_add(&ch->ch_list, &smd_ch_list_dsp);
+	}
+	set_bit(ch->n, smd_ch_open[smd_ch_edge(ch)]);
 	spin_unlock_irqrestore(&smd_lock, flags);
+
 	smd_kick(ch);
 
 	return 0;
@@ -731,11 +993,19 @@ int smd_close(smd_channel_t *ch)
 		return -1;
 
 	spin_lock_irqsave(&smd_lock, flags);
-	ch->notify = do_nothing_notify;
+	clear_bit(ch->n, smd_ch_open[smd_ch_edge(ch)]);
 	list_del(&ch->ch_list);
-	ch_set_state(ch, SMD_SS_CLOSED);
 	spin_unlock_irqrestore(&smd_lock, flags);
 
+	spin_lock_irqsave(&ch->lock, flags);
+	ch->notify = do_nothing_notify;
+	ch_set_state(ch, SMD_SS_CLOSED);
+	spin_unlock_irqrestore(&ch->lock, flags);
+
+	/* let a callback already running on another cpu finish */
+	while (!in_interrupt() && ACCESS_ONCE(ch->dispatching))
+		cpu_relax();
+
 	mutex_lock(&smd_creation_mutex);
 	list_add(&ch->ch_list, &smd_ch_closed_list);
 	mutex_unlock(&smd_creation_mutex);
@@ -757,9 +1027,9 @@ int smd_write_atomic(smd_channel_t *ch, const void *data, int len)
 {
 	unsigned long flags;
 	int res;
-	spin_lock_irqsave(&smd_lock, flags);
+	spin_lock_irqsave(&ch->lock, flags);
 	res = ch->write(ch, data, len);
-	spin_unlock_irqrestore(&smd_lock, flags);
+	spin_unlock_irqrestore(&ch->lock, flags);
 	return res;
 }
 
@@ -788,6 +1058,99 @@ int smd_cur_packet_size(smd_channel_t *ch)
 	return ch->current_packet;
 }
 
+static int ch_is_packet(struct smd_channel *ch)
+{
+	return ch->read == smd_packet_read;
+}
+
+int smd_is_packet_channel(smd_channel_t *ch)
+{
+	return ch_is_packet(ch);
+}
+
+int smd_begin_read(smd_channel_t *ch, void **data)
+{
+	int n;
+
+	n = ch_read_buffer(ch, data);
+	if (ch_is_packet(ch) && n > ch->current_packet)
+		n = ch->current_packet;
+
+	return n;
+}
+
+int smd_end_read(smd_channel_t *ch, int len)
+{
+	unsigned long flags;
+
+	if (len < 0 || len > ch->read_avail(ch))
+		return -EINVAL;
+	if (len == 0)
+		return 0;
+
+	ch_read_done(ch, len);
+	ch->notify_other_cpu();
+
+	if (ch_is_packet(ch)) {
+		spin_lock_irqsave(&ch->lock, flags);
+		ch->current_packet -= len;
+		update_packet_state(ch);
+		spin_unlock_irqrestore(&ch->lock, flags);
+	}
+
+	return len;
+}
+
+int smd_write_reserve(smd_channel_t *ch, void **data, int len)
+{
+	unsigned hdr[5];
+	int n;
+
+	if (!ch_is_open(ch))
+		return 0;
+
+	if (ch_is_packet(ch)) {
+		if (ch->write_remaining == 0) {
+			if (len <= 0)
+				return -EINVAL;
+			if (smd_stream_write_avail(ch) < len + SMD_HEADER_SIZE)
+				return -ENOMEM;
+
+			hdr[0] = len;
+			hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
+			ch_write(ch, hdr, sizeof(hdr));
+			ch->write_remaining = len;
+		}
+		len = ch->write_remaining;
+	} else if (len < 0)
+		return -EINVAL;
+
+	n = ch_write_buffer(ch, data);
+	return n < len ? n : len;
+}
+
+int smd_write_commit(smd_channel_t *ch, int len)
+{
+	void *ptr;
+
+	if (len < 0 || len > ch_write_buffer(ch, &ptr))
+		return -EINVAL;
+
+	if (ch_is_packet(ch)) {
+		if (len > ch->write_remaining)
+			return -EINVAL;
+		ch_write_done(ch, len);
+		ch->write_remaining -= len;
+		if (ch->write_remaining == 0)
+			ch->notify_other_cpu();
+	} else if (len) {
+		ch_write_done(ch, len);
+		ch->notify_other_cpu();
+	}
+
+	return len;
+}
+
 
 /* ------------------------------------------------------------------------- */
 
@@ -833,6 +1196,122 @@ void *smem_find(unsigned id, unsigned size_in)
 	return ptr;
 }
 
+/*
+ * State callbacks are registered for a mask of bits of one item and
+ * only run when one of those bits changed.  They run from a tasklet,
+ * so interrupts arriving back to back are handled in a single pass
+ * over the states.
+ */
+struct smsm_state_cb {
+	struct list_head list;
+	enum smsm_state_item item;
+	uint32_t mask;
+	void (*notify)(void *data, uint32_t old_state, uint32_t new_state);
+	void *data;
+};
+
+static LIST_HEAD(smsm_cb_list);
+static DEFINE_SPINLOCK(smsm_cb_lock);
+static uint32_t smsm_last_state[SMSM_STATE_COUNT];
+
+struct smsm_stats smsm_stats;
+
+static void smsm_cb_tasklet_fn(unsigned long arg)
+{
+	uint32_t old_state[SMSM_STATE_COUNT];
+	uint32_t new_state[SMSM_STATE_COUNT];
+	struct smsm_state_cb *cb;
+	unsigned long flags;
+	uint32_t changed;
+	int n;
+
+	spin_lock_irqsave(&smsm_cb_lock, flags);
+	smsm_stats.dispatches++;
+	for (n = 0; n < SMSM_STATE_COUNT; n++) {
+		old_state[n] = smsm_last_state[n];
+		new_state[n] = raw_smsm_get_state(n);
+		smsm_last_state[n] = new_state[n];
+	}
+
+	list_for_each_entry(cb, &smsm_cb_list, list) {
+		changed = old_state[cb->item] ^ new_state[cb->item];
+		if (!(changed & cb->mask)) {
+			smsm_stats.cb_skipped++;
+			continue;
+		}
+		smsm_stats.cb_calls++;
+		cb->notify(cb->data, old_state[cb->item],
+			   new_state[cb->item]);
+	}
+	spin_unlock_irqrestore(&smsm_cb_lock, flags);
+}
+
+static DECLARE_TASKLET(smsm_cb_tasklet, smsm_cb_tasklet_fn, 0);
+
+/**
+ * smsm_state_cb_register - call @notify when bits of an smsm state change
+ * @item: the state to watch
+ * @mask: the bits of interest
+ * @notify: called with the old and new state, from a tasklet, with
+ *	a spinlock held: it may not sleep or (de)register callbacks
+ * @data: passed to @notify
+ */
+int smsm_state_cb_register(enum smsm_state_item item, uint32_t mask,
+	void (*notify)(void *data, uint32_t old_state, uint32_t new_state),
+	void *data)
+{
+	struct smsm_state_cb *cb;
+	unsigned long flags;
+	int n;
+
+	if (item >= SMSM_STATE_COUNT || !mask || !notify)
+		return -EINVAL;
+
+	cb = kmalloc(sizeof(*cb), GFP_KERNEL);
+	if (!cb)
+		return -ENOMEM;
+
+	cb->item = item;
+	cb->mask = mask;
+	cb->notify = notify;
+	cb->data = data;
+
+	spin_lock_irqsave(&smsm_cb_lock, flags);
+	/*
+	 * Nothing samples the states while no callback is registered, so
+	 * start from what they are now rather than report stale changes.
+	 */
+	if (list_empty(&smsm_cb_list))
+		for (n = 0; n < SMSM_STATE_COUNT; n++)
+			smsm_last_state[n] = raw_smsm_get_state(n);
+	list_add_tail(&cb->list, &smsm_cb_list);
+	spin_unlock_irqrestore(&smsm_cb_lock, flags);
+
+	return 0;
+}
+
+int smsm_state_cb_deregister(enum smsm_state_item item, uint32_t mask,
+	void (*notify)(void *data, uint32_t old_state, uint32_t new_state),
+	void *data)
+{
+	struct smsm_state_cb *cb;
+	unsigned long flags;
+
+	spin_lock_irqsave(&smsm_cb_lock, flags);
+	list_for_each_entry(cb, &smsm_cb_list, list) {
+		if (cb->item == item && cb->mask == mask &&
+		    cb->notify == notify && cb->data == data) {
+			list_del(&cb->list);
+			spin_unlock_irqrestore(&smsm_cb_lock, flags);
+			kfree(cb);
+			return 0;
+		}
+	}
+	spin_unlock_irqrestore(&smsm_cb_lock, flags);
+
+	return -ENOENT;
+}
+
 static irqreturn_t smsm_irq_handler(int irq, void *data)
 {
 	unsigned long flags;
@@ -850,16 +1329,61 @@ static irqreturn_t smsm_irq_handler(int irq, void *data)
 
 	do_smd_probe();
 
+	smsm_stats.irqs++;
+	if (!list_empty(&smsm_cb_list))
+		tasklet_schedule(&smsm_cb_tasklet);
+
 	spin_unlock_irqrestore(&smem_lock, flags);
 	return IRQ_HANDLED;
 }
 
-int smsm_change_state(enum smsm_state_item item,
-		      uint32_t clear_mask, uint32_t set_mask)
+/*
+ * smsm_change_state_deferred() leaves the other processors to be
+ * interrupted up to smsm_coalesce_us later, so that several deferred
+ * changes made in a row, and any immediate change made meanwhile,
+ * share one interrupt.  A deferred change that leaves the state as it
+ * was raises none.
+ */
+static int smsm_coalesce_us = 100;
+module_param(smsm_coalesce_us, int, S_IRUGO | S_IWUSR);
+
+static struct hrtimer smsm_notify_timer;
+static int smsm_notify_pending;
+
+/* Called with smem_lock held */
+static void smsm_notify_now(void)
+{
+	if (smsm_notify_pending) {
+		smsm_notify_pending = 0;
+		smsm_stats.notify_avoided++;
+		hrtimer_try_to_cancel(&smsm_notify_timer);
+	}
+	smsm_stats.notify_sent++;
+	notify_other_smsm();
+}
+
+static enum hrtimer_restart smsm_notify_timer_fn(struct hrtimer *timer)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&smem_lock, flags);
+	if (smsm_notify_pending) {
+		smsm_notify_pending = 0;
+		smsm_stats.notify_sent++;
+		notify_other_smsm();
+	}
+	spin_unlock_irqrestore(&smem_lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
+static int __smsm_change_state(enum smsm_state_item item,
+			       uint32_t clear_mask, uint32_t set_mask,
+			       int defer)
 {
 	unsigned long addr = smd_info.state + item * 4;
 	unsigned long flags;
-	unsigned state;
+	unsigned old, state;
 
 	if (!smd_info.ready)
 		return -EIO;
@@ -869,18 +1393,42 @@ int smsm_change_state(enum smsm_state_item item,
 	if (raw_smsm_get_state(SMSM_STATE_MODEM) & SMSM_RESET)
 		handle_modem_crash();
 
-	state = (readl(addr) & ~clear_mask) | set_mask;
+	old = readl(addr);
+	state = (old & ~clear_mask) | set_mask;
 	writel(state, addr);
 
 	if (msm_smd_debug_mask & MSM_SMSM_DEBUG)
 		pr_info("smsm_change_state %d %x\n", item, state);
-	notify_other_smsm();
+
+	if (!defer || smsm_coalesce_us <= 0) {
+		smsm_notify_now();
+	} else if (state == old || smsm_notify_pending) {
+		smsm_stats.notify_avoided++;
+	} else {
+		smsm_notify_pending = 1;
+		hrtimer_start(&smsm_notify_timer,
+			      ns_to_ktime(smsm_coalesce_us * 1000LL),
+			      HRTIMER_MODE_REL);
+	}
 
 	spin_unlock_irqrestore(&smem_lock, flags);
 
 	return 0;
 }
 
+int smsm_change_state(enum smsm_state_item item,
+		      uint32_t clear_mask, uint32_t set_mask)
+{
+	return __smsm_change_state(item, clear_mask, set_mask, 0);
+}
+
+/* For changes the other side need not see at once, see above */
+int smsm_change_state_deferred(enum smsm_state_item item,
+			       uint32_t clear_mask, uint32_t set_mask)
+{
+	return __smsm_change_state(item, clear_mask, set_mask, 1);
+}
+
 uint32_t smsm_get_state(enum smsm_state_item item)
 {
 	unsigned long flags;
@@ -952,6 +1500,11 @@ int smd_core_init(void)
 		}
 	}
 
+	for (r = 0; r < SMSM_STATE_COUNT; r++)
+		smsm_last_state[r] = raw_smsm_get_state(r);
+	hrtimer_init(&smsm_notify_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	smsm_notify_timer.function = smsm_notify_timer_fn;
+
 	smd_info.ready = 1;
 
 	r = request_irq(INT_A9_M2A_0, smd_modem_irq_handler,
@@ -985,11 +1538,11 @@ int smd_core_init(void)
 	/* check for any SMD channels that may already exist */
 	do_smd_probe();
 
-	/* indicate that we're up and running */
-	smsm_change_state(SMSM_STATE_APPS,
-			  ~0, SMSM_INIT | SMSM_SMDINIT | SMSM_RPCINIT | SMSM_RUN);
+	/* indicate that we're up and running, with a single interrupt */
+	smsm_change_state_deferred(SMSM_STATE_APPS, ~0,
+			SMSM_INIT | SMSM_SMDINIT | SMSM_RPCINIT | SMSM_RUN);
 #ifdef CONFIG_ARCH_MSM_SCORPION
-	smsm_change_state(SMSM_STATE_APPS_DEM, ~0, 0);
+	smsm_change_state_deferred(SMSM_STATE_APPS_DEM, ~0, 0);
 #endif
 
 	pr_info("smd_core_init() done\n");
@@ -1017,6 +1570,9 @@ static int __devinit msm_smd_probe(struct platform_device *pdev)
 
 	do_smd_probe();
 
+	if (smd_alloc_loopback_channel())
+		pr_err("smd: cannot create loopback channel\n");
+
 	msm_check_for_modem_crash = check_for_modem_crash;
 
 	msm_init_last_radio_log(THIS_MODULE);
@@ -99,6 +99,13 @@ static int debug_read_stat(char *buf, int max)
 		       raw_smsm_get_state(SMSM_STATE_POWER_MASTER_DEM),
 		       raw_smsm_get_state(SMSM_STATE_TIME_MASTER_DEM));
 #endif
+	i += scnprintf(buf + i, max - i, "smsm irqs: %lu dispatches: %lu "
+		       "callbacks: %lu skipped: %lu\n",
+		       smsm_stats.irqs, smsm_stats.dispatches,
+		       smsm_stats.cb_calls, smsm_stats.cb_skipped);
+	i += scnprintf(buf + i, max - i, "smsm notify sent: %lu "
+		       "avoided: %lu\n",
+		       smsm_stats.notify_sent, smsm_stats.notify_avoided);
 	if (msg) {
 		msg[SZ_DIAG_ERR_MSG - 1] = 0;
 		i += scnprintf(buf + i, max - i, "diag: '%s'\n", msg);
@@ -140,6 +147,8 @@ static int debug_read_ch(char *buf, int max)
 		i += dump_ch(buf + i, max - i, ch);
 	list_for_each_entry(ch, &smd_ch_list_modem, ch_list)
 		i += dump_ch(buf + i, max - i, ch);
+	list_for_each_entry(ch, &smd_ch_list_loopback, ch_list)
+		i += dump_ch(buf + i, max - i, ch);
 	list_for_each_entry(ch, &smd_ch_closed_list, ch_list)
 		i += dump_ch(buf + i, max - i, ch);
 	spin_unlock_irqrestore(&smd_lock, flags);
@@ -148,6 +148,24 @@ enum smsm_state_item {
 
 void *smem_alloc(unsigned id, unsigned size);
 int smsm_change_state(enum smsm_state_item item, uint32_t clear_mask, uint32_t set_mask);
+int smsm_change_state_deferred(enum smsm_state_item item,
+			       uint32_t clear_mask, uint32_t set_mask);
+int smsm_state_cb_register(enum smsm_state_item item, uint32_t mask,
+	void (*notify)(void *data, uint32_t old_state, uint32_t new_state),
+	void *data);
+int smsm_state_cb_deregister(enum smsm_state_item item, uint32_t mask,
+	void (*notify)(void *data, uint32_t old_state, uint32_t new_state),
+	void *data);
+
+struct smsm_stats {
+	unsigned long irqs;		/* smsm interrupts received */
+	unsigned long dispatches;	/* passes over the callbacks */
+	unsigned long cb_calls;
+	unsigned long cb_skipped;	/* none of their bits changed */
+	unsigned long notify_sent;	/* interrupts raised */
+	unsigned long notify_avoided;	/* state changes without one */
+};
+extern struct smsm_stats smsm_stats;
 uint32_t smsm_get_state(enum smsm_state_item item);
 int smsm_set_sleep_duration(uint32_t delay);
 void smsm_print_sleep_info(void);
@@ -249,6 +267,12 @@ typedef enum {
 #define SMD_BUF_SIZE		8192
 #define SMD_CHANNELS		64
 
+/* the local loopback and test channels sit after the shared ones */
+#define SMD_LOOPBACK_CID	SMD_CHANNELS
+#define SMD_TEST_CHANNELS	2
+#define SMD_TEST_CID(n)		(SMD_LOOPBACK_CID + 1 + (n))
+#define SMD_CH_SLOTS		(SMD_CHANNELS + 1 + SMD_TEST_CHANNELS)
+
 #define SMD_HEADER_SIZE		20
 
 struct smd_alloc_elm {
@@ -295,10 +319,17 @@ struct smd_channel {
 	unsigned fifo_mask;
 	unsigned fifo_size;
 	unsigned current_packet;
+	unsigned write_remaining;	/* of a packet being reserved */
 	unsigned n;
 
 	struct list_head ch_list;
 
+	/* protects the channel state and serializes the notify callback */
+	spinlock_t lock;
+	unsigned char dispatching;
+	unsigned char redispatch;
+	unsigned char kicked;
+
 	void *priv;
 	void (*notify)(void *priv, unsigned flags);
 
@@ -320,6 +351,7 @@ struct smd_channel {
 #define SMD_TYPE_APPS_MODEM	0x000
 #define SMD_TYPE_APPS_DSP	0x001
 #define SMD_TYPE_MODEM_DSP	0x002
+#define SMD_TYPE_LOOPBACK	0x0FF
 
 #define SMD_KIND_MASK		0xF00
 #define SMD_KIND_UNKNOWN	0x000
@@ -329,6 +361,17 @@ struct smd_channel {
 extern struct list_head smd_ch_closed_list;
 extern struct list_head smd_ch_list_modem;
 extern struct list_head smd_ch_list_dsp;
+extern struct list_head smd_ch_list_loopback;
+
+#ifdef CONFIG_MSM_SMD_TEST
+/* for smd_test.c, which plays the remote end of these channels */
+int smd_test_channel_add(unsigned n, const char *name, int packet,
+			 struct smd_half_channel *send,
+			 struct smd_half_channel *recv,
+			 unsigned char *send_data, unsigned char *recv_data,
+			 unsigned fifo_size, void (*notify_other_cpu)(void));
+void smd_test_signal(unsigned n);
+#endif
 
 extern spinlock_t smd_lock;
 extern spinlock_t smem_lock;
@@ -39,12 +39,22 @@
 #include <linux/platform_device.h>
 #include <linux/uaccess.h>
 #include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/debugfs.h>
+#include <linux/mutex.h>
+#include <linux/mempool.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
 
 #include <asm/byteorder.h>
 #include <mach/smem_log.h>
 #include <mach/msm_smd.h>
 #include "smd_rpcrouter.h"
 
+#define CREATE_TRACE_POINTS
+#include "smd_rpcrouter_trace.h"
+
 enum {
 	SMEM_LOG = 1U << 0,
 	RTR_DBG = 1U << 1,
@@ -133,6 +143,30 @@ static LIST_HEAD(remote_endpoints);
 
 static LIST_HEAD(server_list);
 
+/* Point lookups go through these, the lists above are kept for walks */
+#define RR_HASH_BITS		5
+#define RR_HASH_SIZE		(1 << RR_HASH_BITS)
+
+static struct hlist_head local_endpoints_hash[RR_HASH_SIZE];
+static struct hlist_head remote_endpoints_hash[RR_HASH_SIZE];
+static struct hlist_head server_hash[RR_HASH_SIZE];
+
+static inline struct hlist_head *local_ept_bucket(uint32_t cid)
+{
+	return &local_endpoints_hash[hash_32(cid, RR_HASH_BITS)];
+}
+
+static inline struct hlist_head *remote_ept_bucket(uint32_t pid, uint32_t cid)
+{
+	return &remote_endpoints_hash[hash_32(pid ^ cid, RR_HASH_BITS)];
+}
+
+/* by prog only, so that msm_rpc_get_server() can match on version */
+static inline struct hlist_head *server_bucket(uint32_t prog)
+{
+	return &server_hash[hash_32(prog, RR_HASH_BITS)];
+}
+
 static smd_channel_t *smd_channel;
 static int initialized;
 static wait_queue_head_t newserver_wait;
@@ -145,6 +179,7 @@ static DEFINE_SPINLOCK(server_list_lock);
 static DEFINE_SPINLOCK(smd_lock);
 
 static struct workqueue_struct *rpcrouter_workqueue;
+static struct workqueue_struct *rpcrouter_ctl_workqueue;
 static struct wake_lock rpcrouter_wake_lock;
 static int rpcrouter_need_len;
 
@@ -154,8 +189,10 @@ static atomic_t pm_mid = ATOMIC_INIT(1);
 static void do_read_data(struct work_struct *work);
 static void do_create_pdevs(struct work_struct *work);
 static void do_create_rpcrouter_pdev(struct work_struct *work);
+static void do_ctl_msgs(struct work_struct *work);
 
 static DECLARE_WORK(work_read_data, do_read_data);
+static DECLARE_WORK(work_ctl_msgs, do_ctl_msgs);
 static DECLARE_WORK(work_create_pdevs, do_create_pdevs);
 static DECLARE_WORK(work_create_rpcrouter_pdev, do_create_rpcrouter_pdev);
 static atomic_t rpcrouter_pdev_created = ATOMIC_INIT(0);
@@ -192,6 +229,184 @@ struct rr_context {
 
 struct rr_context the_rr_context;
 
+/*
+ * RESUME_TX replies for confirm_rx are sent off the read path, since
+ * they can sleep for room in the tx fifo and the reader must not stall
+ * data for every endpoint meanwhile.  Received control messages are
+ * still processed inline, so they stay ordered against data.  The
+ * replies come from a mempool so that none is ever dropped.
+ */
+#define RR_CTL_POOL_MIN		8
+
+struct rr_ctl_msg {
+	struct list_head list;
+	union rr_control_msg msg;
+};
+
+static LIST_HEAD(ctl_msg_q);
+static DEFINE_SPINLOCK(ctl_msg_q_lock);
+static mempool_t *ctl_msg_pool;
+
+/* how a call ended, for rr_stats_call_end() */
+enum {
+	RR_CALL_REPLIED,
+	RR_CALL_TIMEDOUT,
+	RR_CALL_FAILED,
+};
+
+#if defined(CONFIG_MSM_ONCRPCROUTER_STATS)
+/*
+ * Per-(prog,proc) call statistics.  Outgoing calls are remembered by
+ * xid in a small table until their reply is read, so the time to the
+ * first fragment of the reply and to its delivery can be accounted.
+ * Bucket n counts latencies in [2^(n-1), 2^n) microseconds; the last
+ * bucket is open-ended.
+ */
+#define RR_LAT_BUCKETS		20
+#define RR_INFLIGHT_BITS	6
+#define RR_CALL_STATS_MAX	256
+
+struct rr_call_stats {
+	struct list_head list;
+	struct hlist_node hnode;
+	uint32_t prog;
+	uint32_t proc;
+	unsigned int calls;
+	unsigned int replies;
+	unsigned int timeouts;
+	u64 total_us;
+	unsigned int first_hist[RR_LAT_BUCKETS];
+	unsigned int reply_hist[RR_LAT_BUCKETS];
+};
+
+struct rr_inflight {
+	uint32_t xid;			/* be32, 0 if the slot is free */
+	struct rr_call_stats *st;
+	ktime_t t_send;
+	ktime_t t_first;
+};
+
+static LIST_HEAD(call_stats_list);
+static struct hlist_head call_stats_hash[RR_HASH_SIZE];
+static unsigned int call_stats_count;
+static struct rr_inflight inflight[1 << RR_INFLIGHT_BITS];
+static DEFINE_SPINLOCK(call_stats_lock);
+
+static inline unsigned int rr_lat_bucket(s64 us)
+{
+	if (us <= 0)
+		return 0;
+	return min_t(unsigned int, fls64(us), RR_LAT_BUCKETS - 1);
+}
+
+static inline struct rr_inflight *rr_inflight_slot(uint32_t xid)
+{
+	return &inflight[hash_32(xid, RR_INFLIGHT_BITS)];
+}
+
+/* Called with call_stats_lock held */
+static struct rr_call_stats *rr_call_stats_get(uint32_t prog, uint32_t proc)
+{
+	struct hlist_head *head;
+	struct rr_call_stats *st;
+	struct hlist_node *n;
+
+	head = &call_stats_hash[hash_32(prog ^ proc, RR_HASH_BITS)];
+	hlist_for_each_entry(st, n, head, hnode) {
+		if (st->prog == prog && st->proc == proc)
+			return st;
+	}
+
+	if (call_stats_count >= RR_CALL_STATS_MAX)
+		return NULL;
+	st = kzalloc(sizeof(*st), GFP_ATOMIC);
+	if (!st)
+		return NULL;
+	st->prog = prog;
+	st->proc = proc;
+	hlist_add_head(&st->hnode, head);
+	list_add_tail(&st->list, &call_stats_list);
+	call_stats_count++;
+	return st;
+}
+
+static void rr_stats_call_sent(struct rpc_request_hdr *rq)
+{
+	struct rr_inflight *slot;
+	struct rr_call_stats *st;
+	unsigned long flags;
+
+	spin_lock_irqsave(&call_stats_lock, flags);
+	st = rr_call_stats_get(be32_to_cpu(rq->prog),
+			       be32_to_cpu(rq->procedure));
+	if (st) {
+		st->calls++;
+		/* an unanswered call in the same slot is simply forgotten */
+		slot = rr_inflight_slot(rq->xid);
+		slot->xid = rq->xid;
+		slot->st = st;
+		slot->t_send = ktime_get();
+		slot->t_first = ktime_set(0, 0);
+	}
+	spin_unlock_irqrestore(&call_stats_lock, flags);
+}
+
+static void rr_stats_first_frag(uint32_t xid)
+{
+	struct rr_inflight *slot = rr_inflight_slot(xid);
+	unsigned long flags;
+
+	spin_lock_irqsave(&call_stats_lock, flags);
+	if (slot->xid == xid && !slot->t_first.tv64)
+		slot->t_first = ktime_get();
+	spin_unlock_irqrestore(&call_stats_lock, flags);
+}
+
+static void rr_stats_call_end(uint32_t xid, int how)
+{
+	struct rr_inflight *slot = rr_inflight_slot(xid);
+	struct rr_call_stats *st;
+	unsigned long flags;
+	s64 us;
+
+	spin_lock_irqsave(&call_stats_lock, flags);
+	if (slot->xid != xid) {
+		spin_unlock_irqrestore(&call_stats_lock, flags);
+		return;
+	}
+	st = slot->st;
+	slot->xid = 0;
+
+	if (how == RR_CALL_REPLIED) {
+		if (slot->t_first.tv64)
+			st->first_hist[rr_lat_bucket(ktime_us_delta(
+					slot->t_first, slot->t_send))]++;
+		us = ktime_us_delta(ktime_get(), slot->t_send);
+		st->reply_hist[rr_lat_bucket(us)]++;
+		st->total_us += us;
+		st->replies++;
+	} else if (how == RR_CALL_TIMEDOUT)
+		st->timeouts++;
+	else
+		st->calls--;
+	spin_unlock_irqrestore(&call_stats_lock, flags);
+}
+#else
+static inline void rr_stats_call_sent(struct rpc_request_hdr *rq) {}
+static inline void rr_stats_first_frag(uint32_t xid) {}
+static inline void rr_stats_call_end(uint32_t xid, int how) {}
+#endif
+
+/*
+ * For callers that wait for the reply themselves: the call with this
+ * xid (be32) was given up on.
+ */
+void msm_rpcrouter_call_timeout(uint32_t xid)
+{
+	trace_rpcrouter_call_timeout(be32_to_cpu(xid));
+	rr_stats_call_end(xid, RR_CALL_TIMEDOUT);
+}
+
 static struct platform_device rpcrouter_pdev = {
 	.name		= "oncrpc_router",
 	.id		= -1,
@@ -256,6 +471,7 @@ static struct rr_server *rpcrouter_create_server(uint32_t pid,
 
 	spin_lock_irqsave(&server_list_lock, flags);
 	list_add_tail(&server->list, &server_list);
+	hlist_add_head(&server->hnode, server_bucket(prog));
 	spin_unlock_irqrestore(&server_list_lock, flags);
 
 	rc = msm_rpcrouter_create_server_cdev(server);
@@ -266,6 +482,7 @@ static struct rr_server *rpcrouter_create_server(uint32_t pid,
 out_fail:
 	spin_lock_irqsave(&server_list_lock, flags);
 	list_del(&server->list);
+	hlist_del(&server->hnode);
 	spin_unlock_irqrestore(&server_list_lock, flags);
 	kfree(server);
 	return ERR_PTR(rc);
@@ -277,6 +494,7 @@ static void rpcrouter_destroy_server(struct rr_server *server)
 
 	spin_lock_irqsave(&server_list_lock, flags);
 	list_del(&server->list);
+	hlist_del(&server->hnode);
 	spin_unlock_irqrestore(&server_list_lock, flags);
 	device_destroy(msm_rpcrouter_class, server->device_number);
 	kfree(server);
@@ -285,10 +503,11 @@ static void rpcrouter_destroy_server(struct rr_server *server)
 static struct rr_server *rpcrouter_lookup_server(uint32_t prog, uint32_t ver)
 {
 	struct rr_server *server;
+	struct hlist_node *n;
 	unsigned long flags;
 
 	spin_lock_irqsave(&server_list_lock, flags);
-	list_for_each_entry(server, &server_list, list) {
+	hlist_for_each_entry(server, n, server_bucket(prog), hnode) {
 		if (server->prog == prog
 		 && server->vers == ver) {
 			spin_unlock_irqrestore(&server_list_lock, flags);
@@ -364,6 +583,7 @@ struct msm_rpc_endpoint *msm_rpcrouter_create_local_endpoint(dev_t dev)
 
 	spin_lock_irqsave(&local_endpoints_lock, flags);
 	list_add_tail(&ept->list, &local_endpoints);
+	hlist_add_head(&ept->hnode, local_ept_bucket(ept->cid));
 	spin_unlock_irqrestore(&local_endpoints_lock, flags);
 	return ept;
 }
@@ -398,7 +618,10 @@ int msm_rpcrouter_destroy_local_endpoint(struct msm_rpc_endpoint *ept)
 
 	wake_lock_destroy(&ept->read_q_wake_lock);
 	wake_lock_destroy(&ept->reply_q_wake_lock);
+	spin_lock_irqsave(&local_endpoints_lock, flags);
 	list_del(&ept->list);
+	hlist_del(&ept->hnode);
+	spin_unlock_irqrestore(&local_endpoints_lock, flags);
 	kfree(ept);
 	return 0;
 }
@@ -420,6 +643,7 @@ static int rpcrouter_create_remote_endpoint(uint32_t pid, uint32_t cid)
 
 	spin_lock_irqsave(&remote_endpoints_lock, flags);
 	list_add_tail(&new_c->list, &remote_endpoints);
+	hlist_add_head(&new_c->hnode, remote_ept_bucket(pid, cid));
 	new_c->quota_restart_state = RESTART_NORMAL;
 	spin_unlock_irqrestore(&remote_endpoints_lock, flags);
 	return 0;
@@ -428,10 +652,11 @@ static int rpcrouter_create_remote_endpoint(uint32_t pid, uint32_t cid)
 static struct msm_rpc_endpoint *rpcrouter_lookup_local_endpoint(uint32_t cid)
 {
 	struct msm_rpc_endpoint *ept;
+	struct hlist_node *n;
 	unsigned long flags;
 
 	spin_lock_irqsave(&local_endpoints_lock, flags);
-	list_for_each_entry(ept, &local_endpoints, list) {
+	hlist_for_each_entry(ept, n, local_ept_bucket(cid), hnode) {
 		if (ept->cid == cid) {
 			spin_unlock_irqrestore(&local_endpoints_lock, flags);
 			return ept;
@@ -445,10 +670,11 @@ static struct rr_remote_endpoint *rpcrouter_lookup_remote_endpoint(uint32_t pid,
 								   uint32_t cid)
 {
 	struct rr_remote_endpoint *ept;
+	struct hlist_node *n;
 	unsigned long flags;
 
 	spin_lock_irqsave(&remote_endpoints_lock, flags);
-	list_for_each_entry(ept, &remote_endpoints, list) {
+	hlist_for_each_entry(ept, n, remote_ept_bucket(pid, cid), hnode) {
 		if ((ept->pid == pid) && (ept->cid == cid)) {
 			spin_unlock_irqrestore(&remote_endpoints_lock, flags);
 			return ept;
@@ -628,6 +854,7 @@ static int process_control_msg(union rr_control_msg *msg, int len)
 		if (r_ept) {
 			spin_lock_irqsave(&remote_endpoints_lock, flags);
 			list_del(&r_ept->list);
+			hlist_del(&r_ept->hnode);
 			spin_unlock_irqrestore(&remote_endpoints_lock, flags);
 			kfree(r_ept);
 		}
@@ -676,6 +903,41 @@ static void do_create_pdevs(struct work_struct *work)
 	spin_unlock_irqrestore(&server_list_lock, flags);
 }
 
+static void queue_ctl_msg(union rr_control_msg *msg)
+{
+	struct rr_ctl_msg *cm;
+	unsigned long flags;
+
+	/* may wait for do_ctl_msgs() to free one, but never fails */
+	cm = mempool_alloc(ctl_msg_pool, GFP_KERNEL);
+	memcpy(&cm->msg, msg, sizeof(*msg));
+
+	spin_lock_irqsave(&ctl_msg_q_lock, flags);
+	list_add_tail(&cm->list, &ctl_msg_q);
+	spin_unlock_irqrestore(&ctl_msg_q_lock, flags);
+	queue_work(rpcrouter_ctl_workqueue, &work_ctl_msgs);
+}
+
+static void do_ctl_msgs(struct work_struct *work)
+{
+	struct rr_ctl_msg *cm;
+	unsigned long flags;
+
+	for (;;) {
+		spin_lock_irqsave(&ctl_msg_q_lock, flags);
+		if (list_empty(&ctl_msg_q)) {
+			spin_unlock_irqrestore(&ctl_msg_q_lock, flags);
+			return;
+		}
+		cm = list_first_entry(&ctl_msg_q, struct rr_ctl_msg, list);
+		list_del(&cm->list);
+		spin_unlock_irqrestore(&ctl_msg_q_lock, flags);
+
+		rpcrouter_send_control_msg(&cm->msg);
+		mempool_free(cm, ctl_msg_pool);
+	}
+}
+
 static void rpcrouter_smdnotify(void *_dev, unsigned event)
 {
 	if (event != SMD_EVENT_DATA)
@@ -762,9 +1024,7 @@ static void do_read_data(struct work_struct *work)
 	struct rr_packet *pkt;
 	struct rr_fragment *frag;
 	struct msm_rpc_endpoint *ept;
-#if defined(CONFIG_MSM_ONCRPCROUTER_DEBUG)
 	struct rpc_request_hdr *rq;
-#endif
 	uint32_t pm, mid;
 	unsigned long flags;
 
@@ -880,6 +1140,16 @@ static void do_read_data(struct work_struct *work)
 	 * the incomplete list if this fragment is not a last fragment,
 	 * otherwise put it on the read queue.
 	 */
+	if (frag->length >= 2 * sizeof(uint32_t)) {
+		rq = (struct rpc_request_hdr *) frag->data;
+		trace_rpcrouter_rx_first(be32_to_cpu(rq->xid),
+					 be32_to_cpu(rq->type),
+					 hdr.src_pid, hdr.src_cid,
+					 hdr.dst_cid, hdr.size);
+		if (rq->type != 0)
+			rr_stats_first_frag(rq->xid);
+	}
+
 	pkt = rr_malloc(sizeof(struct rr_packet));
 	pkt->first = frag;
 	pkt->last = frag;
@@ -896,6 +1166,9 @@ packet_complete:
 	D("%s: take read lock on ept %p\n", __func__, ept);
 	wake_lock(&ept->read_q_wake_lock);
 	list_add_tail(&pkt->list, &ept->read_q);
+	ept->read_q_total++;
+	if (++ept->read_q_len > ept->read_q_max)
+		ept->read_q_max = ept->read_q_len;
 	wake_up(&ept->wait_q);
 	spin_unlock_irqrestore(&ept->read_q_lock, flags);
 done:
@@ -908,7 +1181,7 @@ done:
 		msg.cli.cid = hdr.dst_cid;
 
 		RR("x RESUME_TX id=%d:%08x\n", msg.cli.pid, msg.cli.cid);
-		rpcrouter_send_control_msg(&msg);
+		queue_ctl_msg(&msg);
 
 #if defined(CONFIG_MSM_ONCRPCROUTER_DEBUG)
 		if (smd_rpcrouter_debug_mask & SMEM_LOG)
@@ -1322,6 +1595,15 @@ int msm_rpc_write(struct msm_rpc_endpoint *ept, void *buffer, int count)
 		goto write_release_lock;
 	}
 
+	if (rq->type == 0) {
+		trace_rpcrouter_call_send(be32_to_cpu(rq->prog),
+					  be32_to_cpu(rq->vers),
+					  be32_to_cpu(rq->procedure),
+					  be32_to_cpu(rq->xid),
+					  hdr.dst_pid, hdr.dst_cid, count);
+		rr_stats_call_sent(rq);
+	}
+
 	tx_cnt = count;
 	tx_buf = buffer;
 	mid = atomic_add_return(1, &pm_mid) & 0xFF;
@@ -1361,6 +1643,9 @@ int msm_rpc_write(struct msm_rpc_endpoint *ept, void *buffer, int count)
 
  write_release_lock:
 
+	if (rq->type == 0 && count < 0)
+		rr_stats_call_end(rq->xid, RR_CALL_FAILED);
+
 	/* if reply, release wakelock after writing to the transport */
 	if (rq->type != 0) {
 		/* Upon failure, add reply tag to the pending list.
@@ -1460,6 +1745,8 @@ int msm_rpc_call_reply(struct msm_rpc_endpoint *ept, uint32_t proc,
 
 	for (;;) {
 		rc = msm_rpc_read(ept, (void *) &reply, -1, timeout);
+		if (rc == -ETIMEDOUT)
+			msm_rpcrouter_call_timeout(req->xid);
 		if (rc < 0)
 			return rc;
 		if (rc < (3 * sizeof(uint32_t))) {
@@ -1588,6 +1875,7 @@ int __msm_rpc_read(struct msm_rpc_endpoint *ept,
 		return -ETOOSMALL;
 	}
 	list_del(&pkt->list);
+	ept->read_q_len--;
 	spin_unlock_irqrestore(&ept->read_q_lock, flags);
 
 	rc = pkt->length;
@@ -1616,6 +1904,11 @@ int __msm_rpc_read(struct msm_rpc_endpoint *ept,
 		reply->prog = rq->prog;
 		reply->vers = rq->vers;
 		set_pend_reply(ept, reply);
+	} else if ((rc >= (sizeof(uint32_t) * 2)) && (rq->type != 0)) {
+		/* RPC REPLY */
+		trace_rpcrouter_reply_delivered(be32_to_cpu(rq->xid),
+						ept->cid, rc);
+		rr_stats_call_end(rq->xid, RR_CALL_REPLIED);
 	}
 
 	kfree(pkt);
@@ -1657,6 +1950,7 @@ static struct rr_server *msm_rpc_get_server(uint32_t prog, uint32_t vers,
 					    uint32_t *found_prog)
 {
 	struct rr_server *server;
+	struct hlist_node *n;
 	unsigned long     flags;
 
 	if (found_prog == NULL)
@@ -1664,7 +1958,7 @@ static struct rr_server *msm_rpc_get_server(uint32_t prog, uint32_t vers,
 
 	*found_prog = 0;
 	spin_lock_irqsave(&server_list_lock, flags);
-	list_for_each_entry(server, &server_list, list) {
+	hlist_for_each_entry(server, n, server_bucket(prog), hnode) {
 		if (server->prog == prog) {
 			*found_prog = 1;
 			spin_unlock_irqrestore(&server_list_lock, flags);
@@ -1834,6 +2128,136 @@ int msm_rpcrouter_close(void)
 	return smd_close(smd_channel);
 }
 
+#if defined(CONFIG_DEBUG_FS)
+#define DEBUG_BUFMAX 4096
+static char debug_buffer[DEBUG_BUFMAX];
+static DEFINE_MUTEX(debug_buffer_lock);
+
+static int debug_read_endpoints(char *buf, int max)
+{
+	struct msm_rpc_endpoint *ept;
+	unsigned long flags;
+	int i = 0;
+
+	i += scnprintf(buf + i, max - i,
+		       "cid      prog     vers     depth    max      total\n");
+
+	spin_lock_irqsave(&local_endpoints_lock, flags);
+	list_for_each_entry(ept, &local_endpoints, list) {
+		i += scnprintf(buf + i, max - i,
+			       "%08x %08x %08x %-8u %-8u %u\n",
+			       ept->cid, be32_to_cpu(ept->dst_prog),
+			       be32_to_cpu(ept->dst_vers), ept->read_q_len,
+			       ept->read_q_max, ept->read_q_total);
+	}
+	spin_unlock_irqrestore(&local_endpoints_lock, flags);
+
+	return i;
+}
+
+static ssize_t debug_read(struct file *file, char __user *buf,
+			  size_t count, loff_t *ppos)
+{
+	int (*fill)(char *buf, int max) = file->private_data;
+	ssize_t ret;
+	int bsize;
+
+	mutex_lock(&debug_buffer_lock);
+	bsize = fill(debug_buffer, DEBUG_BUFMAX);
+	ret = simple_read_from_buffer(buf, count, ppos, debug_buffer, bsize);
+	mutex_unlock(&debug_buffer_lock);
+	return ret;
+}
+
+static int debug_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+static const struct file_operations debug_ops = {
+	.read = debug_read,
+	.open = debug_open,
+	.llseek = default_llseek,
+};
+
+#if defined(CONFIG_MSM_ONCRPCROUTER_STATS)
+static int debug_calls_show(struct seq_file *s, void *data)
+{
+	struct rr_call_stats *st;
+	unsigned long flags;
+	unsigned int b;
+
+	/* Bucket n: [2^(n-1), 2^n) us */
+	spin_lock_irqsave(&call_stats_lock, flags);
+	list_for_each_entry(st, &call_stats_list, list) {
+		seq_printf(s, "%08x:%u calls %u replies %u timeouts %u "
+			   "avg_us %llu\n", st->prog, st->proc, st->calls,
+			   st->replies, st->timeouts,
+			   st->replies ? div_u64(st->total_us, st->replies)
+				       : 0);
+		seq_printf(s, "  first:");
+		for (b = 0; b < RR_LAT_BUCKETS; b++)
+			seq_printf(s, " %u", st->first_hist[b]);
+		seq_printf(s, "\n  reply:");
+		for (b = 0; b < RR_LAT_BUCKETS; b++)
+			seq_printf(s, " %u", st->reply_hist[b]);
+		seq_putc(s, '\n');
+	}
+	spin_unlock_irqrestore(&call_stats_lock, flags);
+	return 0;
+}
+
+static int debug_calls_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, debug_calls_show, NULL);
+}
+
+static ssize_t debug_calls_write(struct file *file, const char __user *ubuf,
+				 size_t count, loff_t *ppos)
+{
+	struct rr_call_stats *st;
+	unsigned long flags;
+
+	/* Any write clears the counters */
+	spin_lock_irqsave(&call_stats_lock, flags);
+	list_for_each_entry(st, &call_stats_list, list) {
+		st->calls = st->replies = st->timeouts = 0;
+		st->total_us = 0;
+		memset(st->first_hist, 0, sizeof(st->first_hist));
+		memset(st->reply_hist, 0, sizeof(st->reply_hist));
+	}
+	spin_unlock_irqrestore(&call_stats_lock, flags);
+	return count;
+}
+
+static const struct file_operations debug_calls_ops = {
+	.open		= debug_calls_open,
+	.read		= seq_read,
+	.write		= debug_calls_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif
+
+static void rpcrouter_debugfs_init(void)
+{
+	struct dentry *dent;
+
+	dent = debugfs_create_dir("smd_rpcrouter", 0);
+	if (IS_ERR(dent))
+		return;
+
+	debugfs_create_file("endpoints", 0444, dent, debug_read_endpoints,
+			    &debug_ops);
+#if defined(CONFIG_MSM_ONCRPCROUTER_STATS)
+	debugfs_create_file("calls", 0644, dent, NULL, &debug_calls_ops);
+#endif
+}
+#else
+static void rpcrouter_debugfs_init(void) {}
+#endif
+
 static int msm_rpcrouter_probe(struct platform_device *pdev)
 {
 	int rc;
@@ -1850,9 +2274,23 @@ static int msm_rpcrouter_probe(struct platform_device *pdev)
 	if (!rpcrouter_workqueue)
 		return -ENOMEM;
 
+	rpcrouter_ctl_workqueue =
+		create_singlethread_workqueue("rpcrouter_ctl");
+	if (!rpcrouter_ctl_workqueue) {
+		rc = -ENOMEM;
+		goto fail_destroy_workqueue;
+	}
+
+	ctl_msg_pool = mempool_create_kmalloc_pool(RR_CTL_POOL_MIN,
+						   sizeof(struct rr_ctl_msg));
+	if (!ctl_msg_pool) {
+		rc = -ENOMEM;
+		goto fail_destroy_ctl_workqueue;
+	}
+
 	rc = msm_rpcrouter_init_devices();
 	if (rc < 0)
-		goto fail_destroy_workqueue;
+		goto fail_destroy_pool;
 
 	/* Open up SMD channel 2 */
 	initialized = 0;
@@ -1860,11 +2298,16 @@ static int msm_rpcrouter_probe(struct platform_device *pdev)
 	if (rc < 0)
 		goto fail_remove_devices;
 
+	rpcrouter_debugfs_init();
 	queue_work(rpcrouter_workqueue, &work_read_data);
 	return 0;
 
  fail_remove_devices:
 	msm_rpcrouter_exit_devices();
+ fail_destroy_pool:
+	mempool_destroy(ctl_msg_pool);
+ fail_destroy_ctl_workqueue:
+	destroy_workqueue(rpcrouter_ctl_workqueue);
  fail_destroy_workqueue:
 	destroy_workqueue(rpcrouter_workqueue);
 	return rc;
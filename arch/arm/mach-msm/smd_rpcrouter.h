@@ -125,6 +125,9 @@ static inline uint32_t PACMARK(uint32_t len, uint32_t mid, uint32_t first,
 
 struct rr_server {
 	struct list_head list;
+#if defined(CONFIG_ARCH_MSM7X30)
+	struct hlist_node hnode;	/* hashed by prog */
+#endif
 
 	uint32_t pid;
 	uint32_t cid;
@@ -150,6 +153,9 @@ struct rr_remote_endpoint {
 	wait_queue_head_t quota_wait;
 
 	struct list_head list;
+#if defined(CONFIG_ARCH_MSM7X30)
+	struct hlist_node hnode;	/* hashed by pid/cid */
+#endif
 };
 
 #if defined(CONFIG_ARCH_MSM7X30)
@@ -165,6 +171,9 @@ struct msm_rpc_reply {
 
 struct msm_rpc_endpoint {
 	struct list_head list;
+#if defined(CONFIG_ARCH_MSM7X30)
+	struct hlist_node hnode;	/* hashed by cid */
+#endif
 
 	/* incomplete packets waiting for assembly */
 	struct list_head incomplete;
@@ -180,6 +189,11 @@ struct msm_rpc_endpoint {
 	unsigned flags;
        uint32_t forced_wakeup;
 #if defined(CONFIG_ARCH_MSM7X30)
+	/* read_q depth, updated under read_q_lock */
+	uint32_t read_q_len;
+	uint32_t read_q_max;
+	uint32_t read_q_total;
+
 	/* restart handling */
 	int restart_state;
 	spinlock_t restart_lock;
@@ -240,6 +254,7 @@ void msm_rpcrouter_exit_devices(void);
 void get_requesting_client(struct msm_rpc_endpoint *ept, uint32_t xid,
 			   struct msm_rpc_client_info *clnt_info);
 int msm_rpc_clear_netreset(struct msm_rpc_endpoint *ept);
+void msm_rpcrouter_call_timeout(uint32_t xid);
 #endif
 
 extern dev_t msm_rpcrouter_devno;
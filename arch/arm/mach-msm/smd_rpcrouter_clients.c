@@ -526,6 +526,7 @@ int msm_rpc_client_req(struct msm_rpc_client *client, uint32_t proc,
 					xdr_read_avail(&client->xdr), timeout);
 		if (rc == 0) {
 			pr_err("%s: request timeout\n", __func__);
+			msm_rpcrouter_call_timeout(req_xid);
 			rc = -ETIMEDOUT;
 			goto release_locks;
 		}
@@ -634,6 +635,7 @@ int msm_rpc_client_req2(struct msm_rpc_client *client, uint32_t proc,
 					xdr_read_avail(&client->xdr), timeout);
 		if (rc == 0) {
 			pr_err("%s: request timeout\n", __func__);
+			msm_rpcrouter_call_timeout(cpu_to_be32(req_xid));
 			rc = -ETIMEDOUT;
 			goto release_locks;
 		}
@@ -0,0 +1,134 @@
+/* arch/arm/mach-msm/smd_rpcrouter_trace.h
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Tracepoints along the life of an RPC call: request sent, first
+ * fragment of the answer received, reply handed to the reader, or the
+ * caller giving up.  Events carry the xid so they can be paired up.
+ */
+
+#if !defined(_SMD_RPCROUTER_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _SMD_RPCROUTER_TRACE_H
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM rpcrouter
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE smd_rpcrouter_trace
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(rpcrouter_call_send,
+
+	TP_PROTO(uint32_t prog, uint32_t vers, uint32_t proc, uint32_t xid,
+		 uint32_t dst_pid, uint32_t dst_cid, int len),
+
+	TP_ARGS(prog, vers, proc, xid, dst_pid, dst_cid, len),
+
+	TP_STRUCT__entry(
+		__field(u32, prog)
+		__field(u32, vers)
+		__field(u32, proc)
+		__field(u32, xid)
+		__field(u32, dst_pid)
+		__field(u32, dst_cid)
+		__field(int, len)
+	),
+
+	TP_fast_assign(
+		__entry->prog = prog;
+		__entry->vers = vers;
+		__entry->proc = proc;
+		__entry->xid = xid;
+		__entry->dst_pid = dst_pid;
+		__entry->dst_cid = dst_cid;
+		__entry->len = len;
+	),
+
+	TP_printk("xid=%08x prog=%08x:%08x proc=%u dst=%u:%08x len=%d",
+		__entry->xid, __entry->prog, __entry->vers, __entry->proc,
+		__entry->dst_pid, __entry->dst_cid, __entry->len)
+);
+
+TRACE_EVENT(rpcrouter_rx_first,
+
+	TP_PROTO(uint32_t xid, uint32_t type, uint32_t src_pid,
+		 uint32_t src_cid, uint32_t dst_cid, int len),
+
+	TP_ARGS(xid, type, src_pid, src_cid, dst_cid, len),
+
+	TP_STRUCT__entry(
+		__field(u32, xid)
+		__field(u32, type)
+		__field(u32, src_pid)
+		__field(u32, src_cid)
+		__field(u32, dst_cid)
+		__field(int, len)
+	),
+
+	TP_fast_assign(
+		__entry->xid = xid;
+		__entry->type = type;
+		__entry->src_pid = src_pid;
+		__entry->src_cid = src_cid;
+		__entry->dst_cid = dst_cid;
+		__entry->len = len;
+	),
+
+	TP_printk("xid=%08x %s src=%u:%08x dst=%08x len=%d",
+		__entry->xid, __entry->type ? "reply" : "call",
+		__entry->src_pid, __entry->src_cid, __entry->dst_cid,
+		__entry->len)
+);
+
+TRACE_EVENT(rpcrouter_reply_delivered,
+
+	TP_PROTO(uint32_t xid, uint32_t cid, int len),
+
+	TP_ARGS(xid, cid, len),
+
+	TP_STRUCT__entry(
+		__field(u32, xid)
+		__field(u32, cid)
+		__field(int, len)
+	),
+
+	TP_fast_assign(
+		__entry->xid = xid;
+		__entry->cid = cid;
+		__entry->len = len;
+	),
+
+	TP_printk("xid=%08x ept=%08x len=%d",
+		__entry->xid, __entry->cid, __entry->len)
+);
+
+TRACE_EVENT(rpcrouter_call_timeout,
+
+	TP_PROTO(uint32_t xid),
+
+	TP_ARGS(xid),
+
+	TP_STRUCT__entry(
+		__field(u32, xid)
+	),
+
+	TP_fast_assign(
+		__entry->xid = xid;
+	),
+
+	TP_printk("xid=%08x", __entry->xid)
+);
+
+#endif /* _SMD_RPCROUTER_TRACE_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -331,43 +331,146 @@ int xdr_recv_array(struct msm_rpc_xdr *xdr, void **addr, uint32_t *size,
 	return 0;
 }
 
+static inline uint32_t xdr_field_get(const void *obj,
+				     const struct msm_rpc_xdr_field *f)
+{
+	const void *p = obj + f->offset;
+
+	switch (f->type) {
+	case XDR_FIELD_INT8:
+		return (int32_t)*(const int8_t *)p;
+	case XDR_FIELD_UINT8:
+		return *(const uint8_t *)p;
+	case XDR_FIELD_INT16:
+		return (int32_t)*(const int16_t *)p;
+	case XDR_FIELD_UINT16:
+		return *(const uint16_t *)p;
+	default:
+		return *(const uint32_t *)p;
+	}
+}
+
+static inline void xdr_field_put(void *obj, const struct msm_rpc_xdr_field *f,
+				 uint32_t value)
+{
+	void *p = obj + f->offset;
+
+	switch (f->type) {
+	case XDR_FIELD_INT8:
+	case XDR_FIELD_UINT8:
+		*(uint8_t *)p = value;
+		break;
+	case XDR_FIELD_INT16:
+	case XDR_FIELD_UINT16:
+		*(uint16_t *)p = value;
+		break;
+	default:
+		*(uint32_t *)p = value;
+		break;
+	}
+}
+
+int xdr_send_struct(struct msm_rpc_xdr *xdr, const void *obj,
+		    const struct msm_rpc_xdr_field *fields,
+		    unsigned int nfields)
+{
+	uint32_t *out = xdr->out_buf + xdr->out_index;
+	unsigned int i;
+
+	if (!obj || (xdr->out_index + nfields * sizeof(uint32_t)) >
+	    xdr->out_size) {
+		pr_err("%s: xdr out buffer full\n", __func__);
+		return -1;
+	}
+
+	for (i = 0; i < nfields; i++)
+		out[i] = cpu_to_be32(xdr_field_get(obj, &fields[i]));
+
+	xdr->out_index += nfields * sizeof(uint32_t);
+	return 0;
+}
+
+int xdr_recv_struct_array(struct msm_rpc_xdr *xdr, void *obj,
+			  uint32_t elm_size, uint32_t count,
+			  const struct msm_rpc_xdr_field *fields,
+			  unsigned int nfields)
+{
+	const uint32_t *in = xdr->in_buf + xdr->in_index;
+	uint32_t avail = (xdr->in_size - xdr->in_index) / sizeof(uint32_t);
+	unsigned int i;
+
+	if (!obj || xdr->in_index > xdr->in_size ||
+	    (nfields && count > avail / nfields)) {
+		pr_err("%s: xdr in buffer full\n", __func__);
+		return -1;
+	}
+
+	for (; count; count--, obj += elm_size) {
+		for (i = 0; i < nfields; i++)
+			xdr_field_put(obj, &fields[i], be32_to_cpu(*in++));
+	}
+
+	xdr->in_index = (void *)in - xdr->in_buf;
+	return 0;
+}
+
+int xdr_recv_struct(struct msm_rpc_xdr *xdr, void *obj,
+		    const struct msm_rpc_xdr_field *fields,
+		    unsigned int nfields)
+{
+	return xdr_recv_struct_array(xdr, obj, 0, 1, fields, nfields);
+}
+
+static const struct msm_rpc_xdr_field rpc_request_hdr_xdr[] = {
+	XDR_FIELD(struct rpc_request_hdr, xid, UINT32),
+	XDR_FIELD(struct rpc_request_hdr, type, UINT32),
+	XDR_FIELD(struct rpc_request_hdr, rpc_vers, UINT32),
+	XDR_FIELD(struct rpc_request_hdr, prog, UINT32),
+	XDR_FIELD(struct rpc_request_hdr, vers, UINT32),
+	XDR_FIELD(struct rpc_request_hdr, procedure, UINT32),
+	XDR_FIELD(struct rpc_request_hdr, cred_flavor, UINT32),
+	XDR_FIELD(struct rpc_request_hdr, cred_length, UINT32),
+	XDR_FIELD(struct rpc_request_hdr, verf_flavor, UINT32),
+	XDR_FIELD(struct rpc_request_hdr, verf_length, UINT32),
+};
+
+static const struct msm_rpc_xdr_field rpc_reply_hdr_xdr[] = {
+	XDR_FIELD(struct rpc_reply_hdr, xid, UINT32),
+	XDR_FIELD(struct rpc_reply_hdr, type, UINT32),
+	XDR_FIELD(struct rpc_reply_hdr, reply_stat, UINT32),
+};
+
+static const struct msm_rpc_xdr_field rpc_accepted_reply_hdr_xdr[] = {
+	XDR_FIELD(struct rpc_reply_hdr, data.acc_hdr.verf_flavor, UINT32),
+	XDR_FIELD(struct rpc_reply_hdr, data.acc_hdr.verf_length, UINT32),
+	XDR_FIELD(struct rpc_reply_hdr, data.acc_hdr.accept_stat, UINT32),
+};
+
 int xdr_recv_req(struct msm_rpc_xdr *xdr, struct rpc_request_hdr *req)
 {
-	int rc = 0;
 	if (!req)
 		return -1;
 
-	rc |= xdr_recv_uint32(xdr, &req->xid);           /* xid */
-	rc |= xdr_recv_uint32(xdr, &req->type);          /* type */
-	rc |= xdr_recv_uint32(xdr, &req->rpc_vers);      /* rpc_vers */
-	rc |= xdr_recv_uint32(xdr, &req->prog);          /* prog */
-	rc |= xdr_recv_uint32(xdr, &req->vers);          /* vers */
-	rc |= xdr_recv_uint32(xdr, &req->procedure);     /* procedure */
-	rc |= xdr_recv_uint32(xdr, &req->cred_flavor);   /* cred_flavor */
-	rc |= xdr_recv_uint32(xdr, &req->cred_length);   /* cred_length */
-	rc |= xdr_recv_uint32(xdr, &req->verf_flavor);   /* verf_flavor */
-	rc |= xdr_recv_uint32(xdr, &req->verf_length);   /* verf_length */
-
-	return rc;
+	return xdr_recv_struct(xdr, req, rpc_request_hdr_xdr,
+			       ARRAY_SIZE(rpc_request_hdr_xdr));
 }
 
 int xdr_recv_reply(struct msm_rpc_xdr *xdr, struct rpc_reply_hdr *reply)
 {
-	int rc = 0;
+	int rc;
 
 	if (!reply)
 		return -1;
 
-	rc |= xdr_recv_uint32(xdr, &reply->xid);           /* xid */
-	rc |= xdr_recv_uint32(xdr, &reply->type);          /* type */
-	rc |= xdr_recv_uint32(xdr, &reply->reply_stat);    /* reply_stat */
+	rc = xdr_recv_struct(xdr, reply, rpc_reply_hdr_xdr,
+			     ARRAY_SIZE(rpc_reply_hdr_xdr));
+	if (rc)
+		return rc;
 
 	/* acc_hdr */
-	if (reply->reply_stat == RPCMSG_REPLYSTAT_ACCEPTED) {
-		rc |= xdr_recv_uint32(xdr, &reply->data.acc_hdr.verf_flavor);
-		rc |= xdr_recv_uint32(xdr, &reply->data.acc_hdr.verf_length);
-		rc |= xdr_recv_uint32(xdr, &reply->data.acc_hdr.accept_stat);
-	}
+	if (reply->reply_stat == RPCMSG_REPLYSTAT_ACCEPTED)
+		rc = xdr_recv_struct(xdr, reply, rpc_accepted_reply_hdr_xdr,
+				     ARRAY_SIZE(rpc_accepted_reply_hdr_xdr));
 
 	return rc;
 }
@@ -472,3 +575,189 @@ uint32_t xdr_read_avail(struct msm_rpc_xdr *xdr)
 {
 	return xdr->in_size;
 }
+
+#ifdef CONFIG_MSM_ONCRPCROUTER_XDR_TEST
+
+#include <linux/module.h>
+#include <linux/random.h>
+
+/*
+ * Check xdr_send_struct() and xdr_recv_struct_array() against the
+ * per-field calls on random layouts, values and buffer sizes.  Every
+ * member is given a 32-bit slot, since the per-field calls access a
+ * full word even for 8 and 16-bit members, and 8 and 16-bit values are
+ * stored extended to 32 bits so that both give the same bytes.
+ */
+#define XDR_TEST_ROUNDS		2000
+#define XDR_TEST_FIELDS		16
+#define XDR_TEST_COUNT		4
+#define XDR_TEST_BUF_SIZE \
+	((XDR_TEST_FIELDS * XDR_TEST_COUNT + 2) * sizeof(uint32_t))
+
+static struct msm_rpc_xdr_field xdr_test_fields[XDR_TEST_FIELDS] __initdata;
+static uint32_t xdr_test_obj[2][XDR_TEST_COUNT][XDR_TEST_FIELDS] __initdata;
+static uint32_t xdr_test_buf[2][XDR_TEST_BUF_SIZE / 4] __initdata;
+
+static uint32_t __init xdr_test_value(int type)
+{
+	uint32_t v = random32();
+
+	switch (type) {
+	case XDR_FIELD_INT8:
+		return (int32_t)(int8_t)v;
+	case XDR_FIELD_UINT8:
+		return (uint8_t)v;
+	case XDR_FIELD_INT16:
+		return (int32_t)(int16_t)v;
+	case XDR_FIELD_UINT16:
+		return (uint16_t)v;
+	default:
+		return v;
+	}
+}
+
+static int __init xdr_test_send_field(struct msm_rpc_xdr *xdr, void *p,
+				      int type)
+{
+	switch (type) {
+	case XDR_FIELD_INT8:
+		return xdr_send_int8(xdr, p);
+	case XDR_FIELD_UINT8:
+		return xdr_send_uint8(xdr, p);
+	case XDR_FIELD_INT16:
+		return xdr_send_int16(xdr, p);
+	case XDR_FIELD_UINT16:
+		return xdr_send_uint16(xdr, p);
+	case XDR_FIELD_INT32:
+		return xdr_send_int32(xdr, p);
+	default:
+		return xdr_send_uint32(xdr, p);
+	}
+}
+
+static int __init xdr_test_recv_field(struct msm_rpc_xdr *xdr, void *p,
+				      int type)
+{
+	switch (type) {
+	case XDR_FIELD_INT8:
+		return xdr_recv_int8(xdr, p);
+	case XDR_FIELD_UINT8:
+		return xdr_recv_uint8(xdr, p);
+	case XDR_FIELD_INT16:
+		return xdr_recv_int16(xdr, p);
+	case XDR_FIELD_UINT16:
+		return xdr_recv_uint16(xdr, p);
+	case XDR_FIELD_INT32:
+		return xdr_recv_int32(xdr, p);
+	default:
+		return xdr_recv_uint32(xdr, p);
+	}
+}
+
+static int __init xdr_test_send(unsigned int nfields)
+{
+	struct msm_rpc_xdr xdr[2];
+	uint32_t size = random32() % (XDR_TEST_BUF_SIZE + 1);
+	uint32_t start = min_t(uint32_t, size,
+			       (random32() % 3) * sizeof(uint32_t));
+	unsigned int i;
+	int rc[2];
+
+	memset(xdr_test_buf, 0, sizeof(xdr_test_buf));
+	for (i = 0; i < nfields; i++)
+		xdr_test_obj[0][0][i] =
+			xdr_test_value(xdr_test_fields[i].type);
+
+	xdr_init_output(&xdr[0], xdr_test_buf[0], size);
+	xdr_init_output(&xdr[1], xdr_test_buf[1], size);
+	xdr[0].out_index = xdr[1].out_index = start;
+
+	rc[0] = xdr_send_struct(&xdr[0], xdr_test_obj[0][0],
+				xdr_test_fields, nfields);
+	for (rc[1] = 0, i = 0; i < nfields; i++)
+		rc[1] |= xdr_test_send_field(&xdr[1], &xdr_test_obj[0][0][i],
+					     xdr_test_fields[i].type);
+
+	if (!rc[0] != !rc[1])
+		return -EINVAL;
+	if (rc[0])
+		return 0;
+	if (xdr[0].out_index != xdr[1].out_index ||
+	    memcmp(xdr_test_buf[0], xdr_test_buf[1], sizeof(xdr_test_buf[0])))
+		return -EINVAL;
+	return 0;
+}
+
+static int __init xdr_test_recv(unsigned int nfields)
+{
+	struct msm_rpc_xdr xdr[2];
+	uint32_t size = random32() % (XDR_TEST_BUF_SIZE + 1);
+	uint32_t start = min_t(uint32_t, size,
+			       (random32() % 3) * sizeof(uint32_t));
+	uint32_t count = 1 + random32() % XDR_TEST_COUNT;
+	unsigned int i, n;
+	int rc[2];
+
+	get_random_bytes(xdr_test_buf[0], sizeof(xdr_test_buf[0]));
+	memset(xdr_test_obj, 0, sizeof(xdr_test_obj));
+
+	xdr[0].in_buf = xdr[1].in_buf = xdr_test_buf[0];
+	xdr[0].in_size = xdr[1].in_size = size;
+	xdr[0].in_index = xdr[1].in_index = start;
+
+	rc[0] = xdr_recv_struct_array(&xdr[0], xdr_test_obj[0],
+				      sizeof(xdr_test_obj[0][0]), count,
+				      xdr_test_fields, nfields);
+	for (rc[1] = 0, n = 0; n < count; n++)
+		for (i = 0; i < nfields; i++)
+			rc[1] |= xdr_test_recv_field(&xdr[1],
+					&xdr_test_obj[1][n][i],
+					xdr_test_fields[i].type);
+
+	if (!rc[0] != !rc[1])
+		return -EINVAL;
+	if (rc[0])
+		return 0;
+	if (xdr[0].in_index != xdr[1].in_index)
+		return -EINVAL;
+	for (n = 0; n < count; n++)
+		for (i = 0; i < nfields; i++)
+			if (xdr_field_get(xdr_test_obj[0][n],
+					  &xdr_test_fields[i]) !=
+			    xdr_field_get(xdr_test_obj[1][n],
+					  &xdr_test_fields[i]))
+				return -EINVAL;
+	return 0;
+}
+
+static int __init xdr_struct_test(void)
+{
+	unsigned int round, i, nfields;
+
+	printk(KERN_DEBUG "xdr_struct_test: start testing xdr_*_struct()\n");
+
+	for (round = 0; round < XDR_TEST_ROUNDS; round++) {
+		nfields = random32() % (XDR_TEST_FIELDS + 1);
+		for (i = 0; i < nfields; i++) {
+			xdr_test_fields[i].offset = i * sizeof(uint32_t);
+			xdr_test_fields[i].type =
+				random32() % (XDR_FIELD_INT8 + 1);
+		}
+
+		if (xdr_test_send(nfields)) {
+			printk(KERN_ERR "xdr_struct_test: error: "
+			       "xdr_send_struct() differs, round %u\n", round);
+			return -EINVAL;
+		}
+		if (xdr_test_recv(nfields)) {
+			printk(KERN_ERR "xdr_struct_test: error: "
+			       "xdr_recv_struct_array() differs, round %u\n",
+			       round);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+module_init(xdr_struct_test);
+#endif /* CONFIG_MSM_ONCRPCROUTER_XDR_TEST */
@@ -0,0 +1,765 @@
+/* arch/arm/mach-msm/smd_test.c
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * SMD benchmark and fault injection without a modem.
+ *
+ * Two channels, SMD_TEST_STREAM and SMD_TEST_PACKET, live in local
+ * memory and go through the regular SMD core on this side.  A kthread
+ * per channel plays the remote processor: it follows the open/close
+ * handshake and echoes back everything written to it, raising the
+ * "interrupt" through the normal dispatch path.
+ *
+ * debugfs smd_test/:
+ *   run      write "<stream|packet> <count> [size]" to echo count
+ *            messages of size bytes, or of every power of two from
+ *            16 to 4096 bytes when size is left out.  Each size is run
+ *            twice: copying through smd_write()/smd_read(), then in
+ *            place through smd_write_reserve()/smd_begin_read()
+ *   results  throughput, wakeup latency and stalls of the last run
+ *   fault    write "none", "full <ms>" (remote stops draining its
+ *            fifo), "restart" (remote closes and reopens the channel)
+ *            or "crash" (remote resets the channel and goes silent
+ *            until "none")
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/jiffies.h>
+#include <linux/delay.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+
+#include <mach/msm_smd.h>
+
+#include "smd_private.h"
+
+#define SMD_TEST_FIFO_SIZE	SMD_BUF_SIZE
+#define SMD_TEST_MAX_MSG	4096
+#define SMD_TEST_LAT_BUCKETS	16
+#define SMD_TEST_TIMEOUT	(2 * HZ)
+#define SMD_TEST_RESULTS_SIZE	8192
+
+enum {
+	SMD_TEST_FAULT_NONE,
+	SMD_TEST_FAULT_FULL,
+	SMD_TEST_FAULT_RESTART,
+	SMD_TEST_FAULT_CRASH,
+};
+
+struct smd_test_mem {
+	struct smd_half_channel local;	/* written by us */
+	struct smd_half_channel remote;	/* written by the remote */
+	unsigned char local_data[SMD_TEST_FIFO_SIZE];
+	unsigned char remote_data[SMD_TEST_FIFO_SIZE];
+};
+
+struct smd_test_chan {
+	int n;
+	const char *name;
+	int packet;
+	struct smd_test_mem *mem;
+
+	/* the emulated remote */
+	struct task_struct *thread;
+	wait_queue_head_t remote_wait;
+	int remote_kicked;
+	int fault;
+	unsigned long fault_until;
+	int crashed;
+	ktime_t kick_time;		/* we notified the remote */
+	ktime_t signal_time;		/* the remote notified us */
+
+	/* our end, used by the benchmark */
+	smd_channel_t *ch;
+	wait_queue_head_t wait;
+	int events;
+	int opened;
+	int closed;
+
+	/* measurements of the current run */
+	unsigned int remote_hist[SMD_TEST_LAT_BUCKETS];
+	unsigned int local_hist[SMD_TEST_LAT_BUCKETS];
+	unsigned long stalls;
+	unsigned long mismatches;
+};
+
+static struct smd_test_chan smd_test_chans[SMD_TEST_CHANNELS] = {
+	{ .n = 0, .name = "SMD_TEST_STREAM", .packet = 0 },
+	{ .n = 1, .name = "SMD_TEST_PACKET", .packet = 1 },
+};
+
+static DEFINE_MUTEX(smd_test_lock);
+static char *smd_test_results;
+static int smd_test_results_len;
+static unsigned char *smd_test_txbuf;
+static unsigned char *smd_test_rxbuf;
+
+static void smd_test_lat_add(unsigned int *hist, ktime_t since)
+{
+	s64 us = ktime_us_delta(ktime_get(), since);
+	unsigned int b = 0;
+
+	if (us > 0)
+		b = min_t(unsigned int, fls64(us), SMD_TEST_LAT_BUCKETS - 1);
+	hist[b]++;
+}
+
+/* byte at offset off of the data echoed through a channel */
+static inline unsigned char smd_test_pattern(unsigned long off)
+{
+	return (unsigned char)(off + (off >> 8));
+}
+
+/* ------------------------------------------------------------------ */
+/* the emulated remote processor */
+
+static void smd_test_kick(struct smd_test_chan *tc)
+{
+	tc->kick_time = ktime_get();
+	tc->remote_kicked = 1;
+	wake_up(&tc->remote_wait);
+}
+
+static void smd_test_kick0(void)
+{
+	smd_test_kick(&smd_test_chans[0]);
+}
+
+static void smd_test_kick1(void)
+{
+	smd_test_kick(&smd_test_chans[1]);
+}
+
+static void (*smd_test_kick_fn[SMD_TEST_CHANNELS])(void) = {
+	smd_test_kick0,
+	smd_test_kick1,
+};
+
+static void smd_test_signal_local(struct smd_test_chan *tc)
+{
+	tc->signal_time = ktime_get();
+	smd_test_signal(tc->n);
+}
+
+static void smd_test_set_state(struct smd_test_chan *tc, unsigned state)
+{
+	volatile struct smd_half_channel *r = &tc->mem->remote;
+	int up = state == SMD_SS_OPENED;
+
+	r->fDSR = up;
+	r->fCTS = up;
+	r->fCD = up;
+	r->state = state;
+	r->fSTATE = 1;
+	smd_test_signal_local(tc);
+}
+
+/*
+ * Forget everything in flight and start over, as a rebooted remote.
+ * r->tail belongs to our reader, which rewinds it when it sees the
+ * remote go through OPENING.
+ */
+static void smd_test_reset(struct smd_test_chan *tc)
+{
+	volatile struct smd_half_channel *l = &tc->mem->local;
+	volatile struct smd_half_channel *r = &tc->mem->remote;
+
+	l->tail = l->head;
+	r->head = 0;
+}
+
+/* copy what we wrote into the remote's fifo, as is */
+static int smd_test_echo(struct smd_test_chan *tc)
+{
+	struct smd_test_mem *m = tc->mem;
+	volatile struct smd_half_channel *l = &m->local;
+	volatile struct smd_half_channel *r = &m->remote;
+	unsigned mask = SMD_TEST_FIFO_SIZE - 1;
+	unsigned avail, room, n, moved = 0;
+	unsigned tail, head;
+
+	for (;;) {
+		tail = l->tail;
+		head = r->head;
+		avail = (l->head - tail) & mask;
+		room = mask - ((head - r->tail) & mask);
+		n = min(avail, room);
+		n = min(n, SMD_TEST_FIFO_SIZE - tail);
+		n = min(n, SMD_TEST_FIFO_SIZE - head);
+		if (n == 0)
+			break;
+
+		memcpy(m->remote_data + head, m->local_data + tail, n);
+		wmb();
+		r->head = (head + n) & mask;
+		l->tail = (tail + n) & mask;
+		moved += n;
+	}
+
+	if (moved) {
+		r->fHEAD = 1;
+		r->fTAIL = 1;
+		smd_test_signal_local(tc);
+	}
+	return moved;
+}
+
+static void smd_test_remote_step(struct smd_test_chan *tc)
+{
+	volatile struct smd_half_channel *l = &tc->mem->local;
+	volatile struct smd_half_channel *r = &tc->mem->remote;
+
+	switch (tc->fault) {
+	case SMD_TEST_FAULT_CRASH:
+		if (!tc->crashed) {
+			tc->crashed = 1;
+			smd_test_set_state(tc, SMD_SS_RESET);
+		}
+		return;
+	case SMD_TEST_FAULT_RESTART:
+		tc->fault = SMD_TEST_FAULT_NONE;
+		if (r->state == SMD_SS_OPENED) {
+			smd_test_set_state(tc, SMD_SS_CLOSING);
+			msleep(20);
+			smd_test_reset(tc);
+			smd_test_set_state(tc, SMD_SS_OPENING);
+		}
+		break;
+	case SMD_TEST_FAULT_FULL:
+		if (time_before(jiffies, tc->fault_until))
+			return;
+		tc->fault = SMD_TEST_FAULT_NONE;
+		break;
+	}
+
+	if (tc->crashed) {
+		/* back from the dead, the other side has to reopen */
+		tc->crashed = 0;
+		smd_test_reset(tc);
+		smd_test_set_state(tc, SMD_SS_CLOSED);
+	}
+
+	if (l->state == SMD_SS_OPENED && r->state != SMD_SS_OPENED) {
+		if (r->state != SMD_SS_OPENING) {
+			smd_test_reset(tc);
+			smd_test_set_state(tc, SMD_SS_OPENING);
+		}
+		/* only echo once our reader has caught up with the reset */
+		if (r->tail == 0)
+			smd_test_set_state(tc, SMD_SS_OPENED);
+	} else if (l->state != SMD_SS_OPENED && r->state == SMD_SS_OPENED) {
+		smd_test_set_state(tc, SMD_SS_CLOSED);
+	}
+
+	if (l->state == SMD_SS_OPENED && r->state == SMD_SS_OPENED)
+		smd_test_echo(tc);
+}
+
+static int smd_test_remote_thread(void *data)
+{
+	struct smd_test_chan *tc = data;
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible_timeout(tc->remote_wait,
+			tc->remote_kicked || kthread_should_stop(), HZ / 10);
+		if (tc->remote_kicked) {
+			tc->remote_kicked = 0;
+			smd_test_lat_add(tc->remote_hist, tc->kick_time);
+		}
+		smd_test_remote_step(tc);
+	}
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* the benchmark, on our side of the channel */
+
+static void smd_test_notify(void *priv, unsigned event)
+{
+	struct smd_test_chan *tc = priv;
+
+	switch (event) {
+	case SMD_EVENT_DATA:
+		smd_test_lat_add(tc->local_hist, tc->signal_time);
+		break;
+	case SMD_EVENT_OPEN:
+		tc->opened = 1;
+		tc->closed = 0;
+		break;
+	case SMD_EVENT_CLOSE:
+		tc->closed = 1;
+		break;
+	}
+	tc->events++;
+	wake_up(&tc->wait);
+}
+
+static int smd_test_write_msg(struct smd_test_chan *tc, unsigned long off,
+			      int size, int partial)
+{
+	int i, n;
+
+	for (i = partial; i < size; i++)
+		smd_test_txbuf[i] = smd_test_pattern(off + i - partial);
+
+	if (tc->packet) {
+		if (smd_write_avail(tc->ch) < size)
+			return 0;
+		n = smd_write(tc->ch, smd_test_txbuf, size);
+		return n < 0 ? 0 : n;
+	}
+
+	n = smd_write(tc->ch, smd_test_txbuf + partial, size - partial);
+	return n < 0 ? 0 : n;
+}
+
+/* as smd_test_write_msg(), filling the fifo in place */
+static int smd_test_write_zc(struct smd_test_chan *tc, unsigned long off,
+			     int size, int partial)
+{
+	unsigned char *p;
+	int i, n, done = 0;
+
+	/*
+	 * A packet is reserved whole, header included, so once the first
+	 * reserve succeeds the rest of it fits, maybe after a wrap.
+	 */
+	while (partial + done < size) {
+		n = smd_write_reserve(tc->ch, (void **)&p,
+				      size - partial - done);
+		if (n <= 0)
+			break;
+		for (i = 0; i < n; i++)
+			p[i] = smd_test_pattern(off + done + i);
+		smd_write_commit(tc->ch, n);
+		done += n;
+	}
+
+	return done;
+}
+
+/* how much of the next message can be read now */
+static int smd_test_read_len(struct smd_test_chan *tc, int size)
+{
+	int avail;
+
+	avail = smd_read_avail(tc->ch);
+	if (avail <= 0)
+		return 0;
+
+	if (tc->packet) {
+		if (smd_cur_packet_size(tc->ch) != size) {
+			tc->mismatches++;
+			size = smd_cur_packet_size(tc->ch);
+		}
+		if (avail < size)
+			return 0;
+	} else if (avail < size) {
+		size = avail;
+	}
+
+	return size;
+}
+
+static int smd_test_read(struct smd_test_chan *tc, unsigned long off,
+			 int size)
+{
+	int n, i;
+
+	size = smd_test_read_len(tc, size);
+	if (size == 0)
+		return 0;
+
+	n = smd_read(tc->ch, smd_test_rxbuf, size);
+	for (i = 0; i < n; i++)
+		if (smd_test_rxbuf[i] != smd_test_pattern(off + i)) {
+			tc->mismatches++;
+			break;
+		}
+
+	return n;
+}
+
+/* as smd_test_read(), checking the data in the fifo */
+static int smd_test_read_zc(struct smd_test_chan *tc, unsigned long off,
+			    int size)
+{
+	unsigned char *p;
+	int i, n, done = 0, bad = 0;
+
+	size = smd_test_read_len(tc, size);
+	while (done < size) {
+		n = smd_begin_read(tc->ch, (void **)&p);
+		if (n <= 0)
+			break;
+		n = min(n, size - done);
+		for (i = 0; i < n && !bad; i++)
+			if (p[i] != smd_test_pattern(off + done + i)) {
+				tc->mismatches++;
+				bad = 1;
+			}
+		smd_end_read(tc->ch, n);
+		done += n;
+	}
+
+	return done;
+}
+
+static int smd_test_wait_open(struct smd_test_chan *tc)
+{
+	if (!wait_event_timeout(tc->wait, tc->opened, SMD_TEST_TIMEOUT))
+		return -ETIMEDOUT;
+	return 0;
+}
+
+/*
+ * Echo count messages of size bytes, keeping as many in flight as the
+ * fifo takes, copying them or working on the fifo in place (zc).
+ * Stops early if the remote closes the channel or stays silent for
+ * SMD_TEST_TIMEOUT.
+ */
+static int smd_test_run_one(struct smd_test_chan *tc, int count, int size,
+			    int zc)
+{
+	unsigned long total = (unsigned long)count * size;
+	unsigned long tx = 0, rx = 0;
+	unsigned long long kbps;
+	int partial = 0;
+	int blocked = 0;
+	int events, n;
+	ktime_t start;
+	s64 us;
+	int i, b, ret = 0;
+	char *p;
+
+	memset(tc->remote_hist, 0, sizeof(tc->remote_hist));
+	memset(tc->local_hist, 0, sizeof(tc->local_hist));
+	tc->stalls = 0;
+	tc->mismatches = 0;
+
+	start = ktime_get();
+	while (rx < total) {
+		events = tc->events;
+		if (tc->closed) {
+			ret = -ECONNRESET;
+			break;
+		}
+
+		n = 0;
+		if (tx < total) {
+			n = zc ? smd_test_write_zc(tc, tx, size, partial) :
+				 smd_test_write_msg(tc, tx, size, partial);
+			if (n > 0) {
+				tx += n;
+				partial = tc->packet ? 0 : (partial + n) % size;
+				blocked = 0;
+			} else if (!blocked) {
+				/* count each time the fifo fills up */
+				tc->stalls++;
+				blocked = 1;
+			}
+		}
+
+		i = zc ? smd_test_read_zc(tc, rx, size) :
+			 smd_test_read(tc, rx, size);
+		rx += i;
+
+		if (n <= 0 && i <= 0 &&
+		    !wait_event_timeout(tc->wait, tc->events != events,
+					SMD_TEST_TIMEOUT)) {
+			ret = -ETIMEDOUT;
+			break;
+		}
+	}
+	us = ktime_us_delta(ktime_get(), start);
+	if (us <= 0)
+		us = 1;
+	kbps = div64_u64((u64)rx * 1000, us);
+
+	p = smd_test_results + smd_test_results_len;
+	n = SMD_TEST_RESULTS_SIZE - smd_test_results_len;
+	i = scnprintf(p, n, "%s %s size %d: %lu bytes in %lld us, %llu KB/s, "
+		      "stalls %lu, mismatches %lu%s\n", tc->name,
+		      zc ? "zero-copy" : "copy", size, rx, us,
+		      kbps, tc->stalls, tc->mismatches,
+		      ret == -ETIMEDOUT ? ", timed out" :
+		      ret == -ECONNRESET ? ", remote closed" : "");
+	i += scnprintf(p + i, n - i, "  remote wakeup us:");
+	for (b = 0; b < SMD_TEST_LAT_BUCKETS; b++)
+		i += scnprintf(p + i, n - i, " %u", tc->remote_hist[b]);
+	i += scnprintf(p + i, n - i, "\n  local wakeup us: ");
+	for (b = 0; b < SMD_TEST_LAT_BUCKETS; b++)
+		i += scnprintf(p + i, n - i, " %u", tc->local_hist[b]);
+	i += scnprintf(p + i, n - i, "\n");
+	smd_test_results_len += i;
+
+	return ret;
+}
+
+static int smd_test_run(struct smd_test_chan *tc, int count, int size)
+{
+	int ret;
+
+	tc->opened = 0;
+	tc->closed = 0;
+	ret = smd_open(tc->name, &tc->ch, tc, smd_test_notify);
+	if (ret)
+		return ret;
+
+	smd_test_results_len = 0;
+	smd_test_results[0] = 0;
+
+	ret = smd_test_wait_open(tc);
+	if (ret)
+		goto out;
+
+	if (size) {
+		ret = smd_test_run_one(tc, count, size, 0);
+		if (!ret)
+			ret = smd_test_run_one(tc, count, size, 1);
+	} else {
+		for (size = 16; size <= SMD_TEST_MAX_MSG; size <<= 1) {
+			ret = smd_test_run_one(tc, count, size, 0);
+			if (!ret)
+				ret = smd_test_run_one(tc, count, size, 1);
+			if (ret)
+				break;
+		}
+	}
+
+out:
+	smd_close(tc->ch);
+	tc->ch = NULL;
+	return ret;
+}
+
+/* ------------------------------------------------------------------ */
+
+static ssize_t smd_test_run_write(struct file *file, const char __user *ubuf,
+				  size_t count, loff_t *ppos)
+{
+	struct smd_test_chan *tc;
+	char buf[32], mode[8];
+	int n, size = 0;
+	int ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = 0;
+
+	if (sscanf(buf, "%7s %d %d", mode, &n, &size) < 2 || n <= 0 ||
+	    size < 0 || size > SMD_TEST_MAX_MSG)
+		return -EINVAL;
+
+	if (!strcmp(mode, "stream"))
+		tc = &smd_test_chans[0];
+	else if (!strcmp(mode, "packet"))
+		tc = &smd_test_chans[1];
+	else
+		return -EINVAL;
+	if (!tc->thread)
+		return -ENODEV;
+
+	mutex_lock(&smd_test_lock);
+	ret = smd_test_run(tc, n, size);
+	mutex_unlock(&smd_test_lock);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations smd_test_run_ops = {
+	.write = smd_test_run_write,
+};
+
+static ssize_t smd_test_results_read(struct file *file, char __user *buf,
+				     size_t count, loff_t *ppos)
+{
+	ssize_t ret;
+
+	mutex_lock(&smd_test_lock);
+	ret = simple_read_from_buffer(buf, count, ppos, smd_test_results,
+				      smd_test_results_len);
+	mutex_unlock(&smd_test_lock);
+	return ret;
+}
+
+static const struct file_operations smd_test_results_ops = {
+	.read = smd_test_results_read,
+};
+
+static const char * const smd_test_fault_names[] = {
+	[SMD_TEST_FAULT_NONE] = "none",
+	[SMD_TEST_FAULT_FULL] = "full",
+	[SMD_TEST_FAULT_RESTART] = "restart",
+	[SMD_TEST_FAULT_CRASH] = "crash",
+};
+
+static int smd_test_fault_show(struct seq_file *s, void *data)
+{
+	int n;
+
+	for (n = 0; n < SMD_TEST_CHANNELS; n++)
+		seq_printf(s, "%s: %s\n", smd_test_chans[n].name,
+			   smd_test_fault_names[smd_test_chans[n].fault]);
+	return 0;
+}
+
+static int smd_test_fault_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, smd_test_fault_show, NULL);
+}
+
+/* a fault applies to both channels, whether a run is going on or not */
+static ssize_t smd_test_fault_write(struct file *file,
+				    const char __user *ubuf,
+				    size_t count, loff_t *ppos)
+{
+	struct smd_test_chan *tc;
+	char buf[32], name[8];
+	int fault, ms = 0;
+	int n;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = 0;
+
+	if (sscanf(buf, "%7s %d", name, &ms) < 1)
+		return -EINVAL;
+
+	for (fault = 0; fault < ARRAY_SIZE(smd_test_fault_names); fault++)
+		if (!strcmp(name, smd_test_fault_names[fault]))
+			break;
+	if (fault == ARRAY_SIZE(smd_test_fault_names) ||
+	    (fault == SMD_TEST_FAULT_FULL && ms <= 0))
+		return -EINVAL;
+
+	for (n = 0; n < SMD_TEST_CHANNELS; n++) {
+		tc = &smd_test_chans[n];
+		if (!tc->thread)
+			continue;
+		tc->fault_until = jiffies + msecs_to_jiffies(ms);
+		tc->fault = fault;
+		smd_test_kick(tc);
+	}
+
+	return count;
+}
+
+static const struct file_operations smd_test_fault_ops = {
+	.open		= smd_test_fault_open,
+	.read		= seq_read,
+	.write		= smd_test_fault_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init smd_test_chan_init(struct smd_test_chan *tc)
+{
+	struct smd_test_mem *m;
+	int ret;
+
+	m = kzalloc(sizeof(*m), GFP_KERNEL);
+	if (!m)
+		return -ENOMEM;
+	tc->mem = m;
+	init_waitqueue_head(&tc->remote_wait);
+	init_waitqueue_head(&tc->wait);
+
+	ret = smd_test_channel_add(tc->n, tc->name, tc->packet,
+				   &m->local, &m->remote,
+				   m->local_data, m->remote_data,
+				   SMD_TEST_FIFO_SIZE, smd_test_kick_fn[tc->n]);
+	if (ret) {
+		tc->mem = NULL;
+		kfree(m);
+		return ret;
+	}
+
+	/* the channel cannot be taken back, its memory stays */
+	tc->thread = kthread_run(smd_test_remote_thread, tc, "smd_test/%d",
+				 tc->n);
+	if (IS_ERR(tc->thread)) {
+		ret = PTR_ERR(tc->thread);
+		tc->thread = NULL;
+		return ret;
+	}
+
+	return 0;
+}
+
+static int __init smd_test_init(void)
+{
+	struct dentry *dent;
+	int n, up = 0;
+	int ret = 0;
+
+	smd_test_results = kzalloc(SMD_TEST_RESULTS_SIZE, GFP_KERNEL);
+	smd_test_txbuf = kmalloc(SMD_TEST_MAX_MSG, GFP_KERNEL);
+	smd_test_rxbuf = kmalloc(SMD_TEST_MAX_MSG, GFP_KERNEL);
+	if (!smd_test_results || !smd_test_txbuf || !smd_test_rxbuf) {
+		kfree(smd_test_results);
+		kfree(smd_test_txbuf);
+		kfree(smd_test_rxbuf);
+		return -ENOMEM;
+	}
+
+	/* carry on with whichever channels came up */
+	for (n = 0; n < SMD_TEST_CHANNELS; n++) {
+		ret = smd_test_chan_init(&smd_test_chans[n]);
+		if (ret)
+			pr_err("smd_test: %s: error %d\n",
+			       smd_test_chans[n].name, ret);
+		else
+			up++;
+	}
+	if (!up)
+		goto err_free;
+
+	dent = debugfs_create_dir("smd_test", 0);
+	if (IS_ERR_OR_NULL(dent)) {
+		ret = dent ? PTR_ERR(dent) : -ENOMEM;
+		goto err_stop;
+	}
+
+	debugfs_create_file("run", 0200, dent, NULL, &smd_test_run_ops);
+	debugfs_create_file("results", 0444, dent, NULL,
+			    &smd_test_results_ops);
+	debugfs_create_file("fault", 0644, dent, NULL, &smd_test_fault_ops);
+
+	return 0;
+
+err_stop:
+	/* the channels and their memory cannot be taken back */
+	for (n = 0; n < SMD_TEST_CHANNELS; n++) {
+		if (smd_test_chans[n].thread) {
+			kthread_stop(smd_test_chans[n].thread);
+			smd_test_chans[n].thread = NULL;
+		}
+	}
+err_free:
+	kfree(smd_test_results);
+	kfree(smd_test_txbuf);
+	kfree(smd_test_rxbuf);
+	return ret;
+}
+
+late_initcall(smd_test_init);
@@ -19,7 +19,12 @@
 #include <linux/cdev.h>
 #include <linux/device.h>
 #include <linux/wait.h>
+#include <linux/delay.h>
 #include <linux/wakelock.h>
+#include <linux/hrtimer.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <linux/tty.h>
 #include <linux/tty_driver.h>
@@ -28,7 +33,28 @@
 #include <mach/msm_smd.h>
 
 #define MAX_SMD_TTYS 32
-#define MAX_TTY_BUF_SIZE 2048
+#define SMD_TTY_LOOPBACK 31
+
+/* Bytes moved to the tty per pass of the work before yielding */
+#define SMD_TTY_RX_BUDGET	16384
+
+/*
+ * On stream channels small writes are gathered in tx_buf and handed to
+ * the modem together, with one interrupt, once SMD_TTY_TX_FLUSH bytes
+ * are pending or tx_coalesce_us after the first of them.  A writer
+ * turned away for lack of room is only woken up again once at least
+ * SMD_TTY_TX_WAKE bytes can be taken, rather than for every few bytes
+ * the modem drains.
+ */
+#define SMD_TTY_TX_BUF_SIZE	2048
+#define SMD_TTY_TX_FLUSH	512
+#define SMD_TTY_TX_WAKE		1024
+
+/* How long the last close waits for tx_buf to reach the modem */
+#define SMD_TTY_DRAIN_MS	500
+
+static int tx_coalesce_us = 500;
+module_param(tx_coalesce_us, int, S_IRUGO | S_IWUSR);
 
 static DEFINE_MUTEX(smd_tty_lock);
 
@@ -38,65 +64,134 @@ struct smd_tty_info {
 	struct wake_lock wake_lock;
 	int open_count;
 	struct work_struct tty_work;
+	const char *name;
+
+	int throttled;
+	int tx_blocked;
+	unsigned char *tx_buf;		/* NULL when not coalescing */
+	int tx_len;
+	struct hrtimer tx_timer;
+
+	/* statistics since open */
+	ktime_t open_time;
+	unsigned long long rx_bytes;
+	unsigned long long tx_bytes;
+	unsigned long rx_pushes;
+	unsigned long tx_writes;
+	unsigned long tx_kicks;
 };
 
 static struct smd_tty_info smd_tty[MAX_SMD_TTYS];
 static struct workqueue_struct *smd_tty_wq;
 
-static void smd_tty_work_func(struct work_struct *work)
+/* Called with smd_tty_lock held */
+static void smd_tty_tx_flush(struct smd_tty_info *info)
 {
-	unsigned char *ptr;
-	int avail;
+	int n;
+
+	if (!info->tx_len)
+		return;
+
+	n = smd_write(info->ch, info->tx_buf, info->tx_len);
+	if (n <= 0)
+		return;
 
+	info->tx_len -= n;
+	if (info->tx_len)
+		memmove(info->tx_buf, info->tx_buf + n, info->tx_len);
+	info->tx_kicks++;
+}
+
+static int smd_tty_room(struct smd_tty_info *info)
+{
+	int room = smd_write_avail(info->ch);
+
+	if (info->tx_buf) {
+		room = min(room - info->tx_len,
+			   SMD_TTY_TX_BUF_SIZE - info->tx_len);
+		if (room < 0)
+			room = 0;
+	}
+	return room;
+}
+
+static void smd_tty_work_func(struct work_struct *work)
+{
 	struct smd_tty_info *info = container_of(work,
 						struct smd_tty_info,
 						tty_work);
 	struct tty_struct *tty = info->tty;
+	int budget = SMD_TTY_RX_BUDGET;
+	int wakeup = 0;
+	int more = 0;
+	void *ptr;
+	int n;
 
 	if (!tty)
 		return;
 
-
 	mutex_lock(&smd_tty_lock);
 
-	for (;;) {
-		if (test_bit(TTY_THROTTLED, &tty->flags))
+	if (info->ch == 0) {
+		printk(KERN_ERR "smd_tty_work_func: info->ch null\n");
+		mutex_unlock(&smd_tty_lock);
+		return;
+	}
+
+	if (info->tx_buf)
+		smd_tty_tx_flush(info);
+
+	/* copy straight from the fifo, pushing to the ldisc once */
+	while (budget > 0 && !info->throttled &&
+	       !test_bit(TTY_THROTTLED, &tty->flags)) {
+		n = smd_begin_read(info->ch, &ptr);
+		if (n <= 0)
 			break;
+		if (n > budget)
+			n = budget;
 
-		if (info->ch == 0) {
-			printk(KERN_ERR "smd_tty_work_func: info->ch null\n");
+		n = tty_insert_flip_string(tty, ptr, n);
+		if (n == 0) {
+			printk(KERN_ERR "smd_tty_work_func: "
+			       "tty_insert_flip_string fail\n");
 			break;
 		}
+		smd_end_read(info->ch, n);
+		budget -= n;
+	}
 
-		avail = smd_read_avail(info->ch);
-		if (avail == 0)
-			break;
+	if (budget < SMD_TTY_RX_BUDGET) {
+		info->rx_bytes += SMD_TTY_RX_BUDGET - budget;
+		info->rx_pushes++;
+		wake_lock_timeout(&info->wake_lock, HZ / 2);
+		tty->low_latency = 1;
+		if (budget == 0)
+			more = smd_read_avail(info->ch);
+	}
 
-		if (avail > MAX_TTY_BUF_SIZE)
-			avail = MAX_TTY_BUF_SIZE;
-
-		ptr = NULL;
-		avail = tty_prepare_flip_string(tty, &ptr, avail);
-
-		if (avail && ptr) {
-			if (smd_read(info->ch, ptr, avail) != avail) {
-				/* shouldn't be possible since we're in interrupt
-				 * context here and nobody else could 'steal' our
-				 * characters.
-				 */
-				printk(KERN_ERR "OOPS - smd_tty_buffer mismatch?!");
-			}
-			wake_lock_timeout(&info->wake_lock, HZ / 2);
-			tty->low_latency = 1;
-			tty_flip_buffer_push(tty);
-		} else
-			printk(KERN_ERR "smd_tty_work_func: tty_prepare_flip_string fail\n");
+	if (info->tx_blocked && smd_tty_room(info) >= SMD_TTY_TX_WAKE) {
+		info->tx_blocked = 0;
+		wakeup = 1;
 	}
 
 	mutex_unlock(&smd_tty_lock);
 
-	/* XXX only when writable and necessary */
-	tty_wakeup(tty);
+	if (budget < SMD_TTY_RX_BUDGET)
+		tty_flip_buffer_push(tty);
+	if (more)
+		queue_work(smd_tty_wq, &info->tty_work);
+	if (wakeup)
+		tty_wakeup(tty);
+}
+
+static enum hrtimer_restart smd_tty_tx_timer_func(struct hrtimer *timer)
+{
+	struct smd_tty_info *info = container_of(timer,
+						struct smd_tty_info,
+						tx_timer);
+
+	queue_work(smd_tty_wq, &info->tty_work);
+	return HRTIMER_NORESTART;
 }
 
 static void smd_tty_notify(void *priv, unsigned event)
@@ -106,6 +201,10 @@ static void smd_tty_notify(void *priv, unsigned event)
 	if (event != SMD_EVENT_DATA)
 		return;
 
+	/* nothing to do until unthrottled, unless a writer waits */
+	if (info->throttled && !info->tx_blocked && !info->tx_len)
+		return;
+
 	queue_work(smd_tty_wq, &info->tty_work);
 }
 
@@ -129,6 +228,11 @@ static int smd_tty_open(struct tty_struct *tty, struct file *f)
 
 	} else if (n == 27) {
 		name = "SMD_GPSNMEA";
+#ifdef CONFIG_MSM_SMD_LOOPBACK
+	} else if (n == SMD_TTY_LOOPBACK) {
+		/* local loopback, for measuring throughput */
+		name = "LOCAL_LOOPBACK";
+#endif
 #ifdef CONFIG_BUILD_OMA_DM
 	} else if (n == 19) {
 		/* MASD requested OMA_DM AT-channel */
@@ -150,6 +254,13 @@ static int smd_tty_open(struct tty_struct *tty, struct file *f)
 	if (info->open_count++ == 0) {
 		wake_lock_init(&info->wake_lock, WAKE_LOCK_SUSPEND, name);
 		info->tty = tty;
+		info->name = name;
+		info->throttled = 0;
+		info->tx_blocked = 0;
+		info->tx_len = 0;
+		info->open_time = ktime_get();
+		info->rx_bytes = info->tx_bytes = 0;
+		info->rx_pushes = info->tx_writes = info->tx_kicks = 0;
 		if (info->ch) {
 			smd_kick(info->ch);
 		} else {
@@ -161,18 +272,48 @@ static int smd_tty_open(struct tty_struct *tty, struct file *f)
 				smd_wait_until_opened(info->ch, 200);
 #endif
 		}
+		/* packet channels keep one packet per write */
+		if (info->ch && !smd_is_packet_channel(info->ch))
+			info->tx_buf = kmalloc(SMD_TTY_TX_BUF_SIZE,
+					       GFP_KERNEL);
 	}
 	mutex_unlock(&smd_tty_lock);
 
 	return res;
 }
 
+/* Called with smd_tty_lock held, may drop it while waiting */
+static void smd_tty_tx_drain(struct smd_tty_info *info)
+{
+	unsigned long timeout = jiffies + msecs_to_jiffies(SMD_TTY_DRAIN_MS);
+
+	while (info->tx_buf && info->tx_len && info->ch) {
+		smd_tty_tx_flush(info);
+		if (!info->tx_len || time_after(jiffies, timeout))
+			break;
+		mutex_unlock(&smd_tty_lock);
+		msleep(10);
+		mutex_lock(&smd_tty_lock);
+	}
+}
+
 static void smd_tty_close(struct tty_struct *tty, struct file *f)
 {
 	struct smd_tty_info *info = tty->driver_data;
+	int last;
 
 	if (info == 0)
 		return;
+
+	mutex_lock(&smd_tty_lock);
+	last = info->open_count == 1;
+	if (last)
+		smd_tty_tx_drain(info);
+	mutex_unlock(&smd_tty_lock);
+
+	/* other openers still rely on the timer to push out tx_buf */
+	if (last)
+		hrtimer_cancel(&info->tx_timer);
 	/* wait for the work in workqueue to complete */
 	flush_work(&info->tty_work);
 
@@ -181,10 +322,22 @@ static void smd_tty_close(struct tty_struct *tty, struct file *f)
 		info->tty = 0;
 		tty->driver_data = 0;
 		wake_lock_destroy(&info->wake_lock);
+		if (info->tx_buf) {
+			smd_tty_tx_flush(info);
+			if (info->tx_len)
+				printk(KERN_ERR "%s: dropping %d bytes on %s\n",
+					__func__, info->tx_len, info->name);
+			kfree(info->tx_buf);
+			info->tx_buf = NULL;
+			info->tx_len = 0;
+		}
 		if (info->ch) {
 			smd_close(info->ch);
 			info->ch = 0;
 		}
+	} else if (last && info->tx_len) {
+		/* reopened while we drained, hand tx_buf back to the work */
+		queue_work(smd_tty_wq, &info->tty_work);
 	}
 	mutex_unlock(&smd_tty_lock);
 }
@@ -201,12 +354,33 @@ static int smd_tty_write(struct tty_struct *tty,
 	** is currently space for
 	*/
 	mutex_lock(&smd_tty_lock);
-	avail = smd_write_avail(info->ch);
+	avail = smd_tty_room(info);
 	if (len > avail) {
 		len = avail;
-		printk(KERN_INFO "%s: buffer full. avail:%d, len:%d\n", __func__, avail, len);
+		info->tx_blocked = 1;
+	}
+
+	if (!info->tx_buf) {
+		ret = smd_write(info->ch, buf, len);
+		if (ret > 0)
+			info->tx_kicks++;
+	} else {
+		memcpy(info->tx_buf + info->tx_len, buf, len);
+		info->tx_len += len;
+		ret = len;
+
+		if (info->tx_len >= SMD_TTY_TX_FLUSH || tx_coalesce_us <= 0)
+			smd_tty_tx_flush(info);
+		else if (info->tx_len && !hrtimer_active(&info->tx_timer))
+			hrtimer_start(&info->tx_timer,
+				      ns_to_ktime(tx_coalesce_us * 1000LL),
+				      HRTIMER_MODE_REL);
+	}
+
+	if (ret > 0) {
+		info->tx_bytes += ret;
+		info->tx_writes++;
 	}
-	ret = smd_write(info->ch, buf, len);
 	mutex_unlock(&smd_tty_lock);
 
 	return ret;
@@ -215,18 +389,30 @@ static int smd_tty_write(struct tty_struct *tty,
 static int smd_tty_write_room(struct tty_struct *tty)
 {
 	struct smd_tty_info *info = tty->driver_data;
-	return smd_write_avail(info->ch);
+	int room = smd_tty_room(info);
+
+	/* hold writers off until the wakeup threshold is reached */
+	if (info->tx_blocked && room < SMD_TTY_TX_WAKE)
+		return 0;
+	return room;
 }
 
 static int smd_tty_chars_in_buffer(struct tty_struct *tty)
 {
 	struct smd_tty_info *info = tty->driver_data;
-	return smd_read_avail(info->ch);
+	return smd_read_avail(info->ch) + info->tx_len;
+}
+
+static void smd_tty_throttle(struct tty_struct *tty)
+{
+	struct smd_tty_info *info = tty->driver_data;
+	info->throttled = 1;
 }
 
 static void smd_tty_unthrottle(struct tty_struct *tty)
 {
 	struct smd_tty_info *info = tty->driver_data;
+	info->throttled = 0;
 	queue_work(smd_tty_wq, &info->tty_work);
 	return;
 }
@@ -237,11 +423,79 @@ static struct tty_operations smd_tty_ops = {
 	.write = smd_tty_write,
 	.write_room = smd_tty_write_room,
 	.chars_in_buffer = smd_tty_chars_in_buffer,
+	.throttle = smd_tty_throttle,
 	.unthrottle = smd_tty_unthrottle,
 };
 
+#if defined(CONFIG_DEBUG_FS)
+/*
+ * Per open tty: bytes moved each way and the rate since it was
+ * opened, plus the number of ldisc pushes and modem notifications it
+ * took.  Run a loopback through the tty to measure throughput.
+ */
+static int smd_tty_stats_show(struct seq_file *s, void *data)
+{
+	struct smd_tty_info *info;
+	s64 us;
+	int n;
+
+	mutex_lock(&smd_tty_lock);
+	for (n = 0; n < MAX_SMD_TTYS; n++) {
+		info = smd_tty + n;
+		if (!info->open_count)
+			continue;
+
+		us = ktime_us_delta(ktime_get(), info->open_time);
+		if (us <= 0)
+			us = 1;
+		seq_printf(s, "smd%d %s: rx %llu (%llu KB/s) tx %llu "
+			   "(%llu KB/s) pushes %lu writes %lu kicks %lu\n",
+			   n, info->name, info->rx_bytes,
+			   div64_u64(info->rx_bytes * 1000, us),
+			   info->tx_bytes,
+			   div64_u64(info->tx_bytes * 1000, us),
+			   info->rx_pushes, info->tx_writes, info->tx_kicks);
+	}
+	mutex_unlock(&smd_tty_lock);
+	return 0;
+}
+
+static int smd_tty_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, smd_tty_stats_show, NULL);
+}
+
+static const struct file_operations smd_tty_stats_ops = {
+	.open		= smd_tty_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void smd_tty_debugfs_init(void)
+{
+	struct dentry *dent;
+
+	dent = debugfs_create_dir("smd_tty", 0);
+	if (IS_ERR(dent))
+		return;
+
+	debugfs_create_file("stats", 0444, dent, NULL, &smd_tty_stats_ops);
+}
+#else
+static void smd_tty_debugfs_init(void) {}
+#endif
+
 static struct tty_driver *smd_tty_driver;
 
+static void __init smd_tty_add(int n)
+{
+	tty_register_device(smd_tty_driver, n, 0);
+	INIT_WORK(&smd_tty[n].tty_work, smd_tty_work_func);
+	hrtimer_init(&smd_tty[n].tx_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	smd_tty[n].tx_timer.function = smd_tty_tx_timer_func;
+}
+
 static int __init smd_tty_init(void)
 {
 	int ret;
@@ -277,24 +531,22 @@ static int __init smd_tty_init(void)
 		return ret;
 
 	/* this should be dynamic */
-	tty_register_device(smd_tty_driver, 0, 0);
-	INIT_WORK(&smd_tty[0].tty_work, smd_tty_work_func);
-	tty_register_device(smd_tty_driver, 1, 0);
-	INIT_WORK(&smd_tty[1].tty_work, smd_tty_work_func);
-	tty_register_device(smd_tty_driver, 9, 0);
-	INIT_WORK(&smd_tty[9].tty_work, smd_tty_work_func);
-	tty_register_device(smd_tty_driver, 27, 0);
-	INIT_WORK(&smd_tty[27].tty_work, smd_tty_work_func);
+	smd_tty_add(0);
+	smd_tty_add(1);
+	smd_tty_add(9);
+	smd_tty_add(27);
 #ifdef CONFIG_BUILD_OMA_DM
 	/* MASD requested OMA_DM AT-channel */
-	tty_register_device(smd_tty_driver, 19, 0);
-	INIT_WORK(&smd_tty[19].tty_work, smd_tty_work_func);
+	smd_tty_add(19);
 #endif
 #ifdef CONFIG_BUILD_CIQ
-	tty_register_device(smd_tty_driver, 26, 0);
-	INIT_WORK(&smd_tty[26].tty_work, smd_tty_work_func);
+	smd_tty_add(26);
+#endif
+#ifdef CONFIG_MSM_SMD_LOOPBACK
+	smd_tty_add(SMD_TTY_LOOPBACK);
 #endif
 
+	smd_tty_debugfs_init();
 	return 0;
 }
 
@@ -66,6 +66,8 @@
 #include <linux/errno.h>
 #include <linux/jiffies.h>
 #include <linux/remote_spinlock.h>
+#include <linux/percpu.h>
+#include <linux/timer.h>
 #include <linux/debugfs.h>
 #include <linux/io.h>
 #include <linux/string.h>
@@ -956,6 +958,125 @@ static inline unsigned int read_timestamp(void)
 	return tick;
 }
 
+/* Called with the log's remote spinlock held */
+static void smem_log_put(struct smem_log_inst *in,
+			 const struct smem_log_item *item, int n)
+{
+	uint32_t idx;
+	uint32_t next_idx;
+
+	idx = *in->idx;
+
+	/* the two halves of an event6 are never split across the wrap */
+	if (idx + n <= in->num)
+		memcpy(&in->events[idx], item, n * sizeof(*item));
+
+	next_idx = idx + n;
+	if (next_idx >= in->num)
+		next_idx = 0;
+	*in->idx = next_idx;
+}
+
+/*
+ * Events are first staged in a per-cpu buffer and copied into the
+ * shared log in batches, under one acquisition of the remote spinlock
+ * instead of one per event.  A flush takes the staged events of every
+ * cpu and writes them out merged by timestamp.  It runs from the
+ * writer once its buffer is half full, from a timer shortly after the
+ * first event, and before the log is read.  Each cpu has two buffers
+ * so that it can keep logging while the other one is being flushed;
+ * if both fill up, events are dropped and counted.
+ */
+#define SMEM_LOG_STAGE_ENTRIES	32
+#define SMEM_LOG_STAGE_FLUSH	(SMEM_LOG_STAGE_ENTRIES / 2)
+#define SMEM_LOG_FLUSH_DELAY	(HZ / 20)
+
+struct smem_log_stage_buf {
+	unsigned int count;
+	unsigned int head;		/* next item to flush */
+	struct smem_log_item items[SMEM_LOG_STAGE_ENTRIES];
+	unsigned char nr[SMEM_LOG_STAGE_ENTRIES];	/* items per event */
+};
+
+struct smem_log_stage {
+	spinlock_t lock;
+	int active;
+	struct smem_log_stage_buf *flushing;
+	struct smem_log_stage_buf buf[2];
+	unsigned long dropped;
+};
+
+static DEFINE_PER_CPU(struct smem_log_stage, smem_log_stage[NUM]);
+static DEFINE_SPINLOCK(smem_log_flush_lock);
+static unsigned long smem_log_flushes[NUM];
+static struct timer_list smem_log_flush_timer;
+static int smem_log_staging;
+
+static void smem_log_flush(int log, int wait)
+{
+	struct smem_log_stage_buf *b, *best;
+	struct smem_log_stage *stage;
+	unsigned long flags;
+	int cpu;
+
+	if (!smem_log_staging)
+		return;
+
+	if (wait)
+		spin_lock_irqsave(&smem_log_flush_lock, flags);
+	else if (!spin_trylock_irqsave(&smem_log_flush_lock, flags))
+		return;
+
+	for_each_possible_cpu(cpu) {
+		stage = &per_cpu(smem_log_stage, cpu)[log];
+		spin_lock(&stage->lock);
+		stage->flushing = &stage->buf[stage->active];
+		stage->active ^= 1;
+		spin_unlock(&stage->lock);
+	}
+
+	if (inst[log].events && inst[log].idx) {
+		remote_spin_lock(inst[log].remote_spinlock);
+		for (;;) {
+			best = NULL;
+			for_each_possible_cpu(cpu) {
+				b = per_cpu(smem_log_stage, cpu)[log].flushing;
+				if (b->head == b->count)
+					continue;
+				if (!best || (int32_t)(b->items[b->head].timetick -
+					best->items[best->head].timetick) < 0)
+					best = b;
+			}
+			if (!best)
+				break;
+			smem_log_put(&inst[log], &best->items[best->head],
+				     best->nr[best->head]);
+			best->head += best->nr[best->head];
+		}
+		remote_spin_unlock(inst[log].remote_spinlock);
+	}
+
+	for_each_possible_cpu(cpu) {
+		b = per_cpu(smem_log_stage, cpu)[log].flushing;
+		b->count = 0;
+		b->head = 0;
+	}
+	smem_log_flushes[log]++;
+
+	spin_unlock_irqrestore(&smem_log_flush_lock, flags);
+}
+
+static void smem_log_flush_all(void)
+{
+	smem_log_flush(GEN, 1);
+	smem_log_flush(STA, 1);
+}
+
+static void smem_log_flush_timer_fn(unsigned long data)
+{
+	smem_log_flush_all();
+}
+
 static void smem_log_event_from_user(struct smem_log_inst *inst,
 				     const char __user *buf, int size, int num)
 {
@@ -967,6 +1088,7 @@ static void smem_log_event_from_user(struct smem_log_inst *inst,
 	int first = 1;
 	int ret;
 
+	smem_log_flush(inst->which_log, 1);
 	remote_spin_lock_irqsave(inst->remote_spinlock, flags);
 
 	while (num--) {
@@ -1010,120 +1132,117 @@ static void smem_log_event_from_user(struct smem_log_inst *inst,
 	remote_spin_unlock_irqrestore(inst->remote_spinlock, flags);
 }
 
-static void _smem_log_event(
-	struct smem_log_item __iomem *events,
-	uint32_t __iomem *_idx,
-	remote_spinlock_t *lock,
-	int num,
-	uint32_t id, uint32_t data1, uint32_t data2,
-	uint32_t data3)
+static void _smem_log_event(int log, struct smem_log_item *item, int n)
 {
-	struct smem_log_item item;
-	uint32_t idx;
-	uint32_t next_idx;
+	struct smem_log_stage_buf *b;
+	struct smem_log_stage *stage;
 	unsigned long flags;
+	unsigned int count;
+	int i;
 
-	item.timetick = read_timestamp();
-	item.identifier = id;
-	item.data1 = data1;
-	item.data2 = data2;
-	item.data3 = data3;
-
-	remote_spin_lock_irqsave(lock, flags);
-
-	idx = *_idx;
-
-	if (idx < num) {
-		memcpy(&events[idx],
-		       &item, sizeof(item));
+	if (!smem_log_staging) {
+		if (!inst[log].events || !inst[log].idx)
+			return;
+		item[0].timetick = read_timestamp();
+		for (i = 1; i < n; i++)
+			item[i].timetick = item[0].timetick;
+		remote_spin_lock_irqsave(inst[log].remote_spinlock, flags);
+		smem_log_put(&inst[log], item, n);
+		remote_spin_unlock_irqrestore(inst[log].remote_spinlock, flags);
+		return;
 	}
 
-	next_idx = idx + 1;
-	if (next_idx >= num)
-		next_idx = 0;
-	*_idx = next_idx;
+	local_irq_save(flags);
+	stage = &per_cpu(smem_log_stage, smp_processor_id())[log];
+	spin_lock(&stage->lock);
+	b = &stage->buf[stage->active];
+	if (b->count + n > SMEM_LOG_STAGE_ENTRIES) {
+		stage->dropped++;
+		spin_unlock(&stage->lock);
+		local_irq_restore(flags);
+		return;
+	}
 
-	remote_spin_unlock_irqrestore(lock, flags);
+	/* stamped under the lock so each buffer stays in time order */
+	item[0].timetick = read_timestamp();
+	for (i = 1; i < n; i++)
+		item[i].timetick = item[0].timetick;
+	memcpy(&b->items[b->count], item, n * sizeof(*item));
+	b->nr[b->count] = n;
+	b->count += n;
+	count = b->count;
+	spin_unlock(&stage->lock);
+
+	if (count >= SMEM_LOG_STAGE_FLUSH)
+		smem_log_flush(log, 0);
+	else if (!timer_pending(&smem_log_flush_timer))
+		mod_timer(&smem_log_flush_timer,
+			  jiffies + SMEM_LOG_FLUSH_DELAY);
+	local_irq_restore(flags);
 }
 
-static void _smem_log_event6(
-	struct smem_log_item __iomem *events,
-	uint32_t __iomem *_idx,
-	remote_spinlock_t *lock,
-	int num,
-	uint32_t id, uint32_t data1, uint32_t data2,
-	uint32_t data3, uint32_t data4, uint32_t data5,
-	uint32_t data6)
+static void _smem_log_event6(int log, uint32_t id, uint32_t data1,
+			     uint32_t data2, uint32_t data3, uint32_t data4,
+			     uint32_t data5, uint32_t data6)
 {
 	struct smem_log_item item[2];
-	uint32_t idx;
-	uint32_t next_idx;
-	unsigned long flags;
 
-	item[0].timetick = read_timestamp();
 	item[0].identifier = id;
 	item[0].data1 = data1;
 	item[0].data2 = data2;
 	item[0].data3 = data3;
 	item[1].identifier = item[0].identifier;
-	item[1].timetick = item[0].timetick;
 	item[1].data1 = data4;
 	item[1].data2 = data5;
 	item[1].data3 = data6;
 
-	remote_spin_lock_irqsave(lock, flags);
-
-	idx = *_idx;
-
-	if (idx < (num-1)) {
-		memcpy(&events[idx],
-		       &item, sizeof(item));
-	}
-
-	next_idx = idx + 2;
-	if (next_idx >= num)
-		next_idx = 0;
-	*_idx = next_idx;
-
-	remote_spin_unlock_irqrestore(lock, flags);
+	_smem_log_event(log, item, 2);
 }
 
 void smem_log_event(uint32_t id, uint32_t data1, uint32_t data2,
 		    uint32_t data3)
 {
-	_smem_log_event(inst[GEN].events, inst[GEN].idx,
-			inst[GEN].remote_spinlock, SMEM_LOG_NUM_ENTRIES,
-			id, data1, data2, data3);
+	struct smem_log_item item;
+
+	item.identifier = id;
+	item.data1 = data1;
+	item.data2 = data2;
+	item.data3 = data3;
+
+	_smem_log_event(GEN, &item, 1);
 }
 
 void smem_log_event6(uint32_t id, uint32_t data1, uint32_t data2,
 		     uint32_t data3, uint32_t data4, uint32_t data5,
 		     uint32_t data6)
 {
-	_smem_log_event6(inst[GEN].events, inst[GEN].idx,
-			 inst[GEN].remote_spinlock, SMEM_LOG_NUM_ENTRIES,
-			 id, data1, data2, data3, data4, data5, data6);
+	_smem_log_event6(GEN, id, data1, data2, data3, data4, data5, data6);
 }
 
 void smem_log_event_to_static(uint32_t id, uint32_t data1, uint32_t data2,
 		    uint32_t data3)
 {
-	_smem_log_event(inst[STA].events, inst[STA].idx,
-			inst[STA].remote_spinlock, SMEM_LOG_NUM_STATIC_ENTRIES,
-			id, data1, data2, data3);
+	struct smem_log_item item;
+
+	item.identifier = id;
+	item.data1 = data1;
+	item.data2 = data2;
+	item.data3 = data3;
+
+	_smem_log_event(STA, &item, 1);
 }
 
 void smem_log_event6_to_static(uint32_t id, uint32_t data1, uint32_t data2,
 		     uint32_t data3, uint32_t data4, uint32_t data5,
 		     uint32_t data6)
 {
-	_smem_log_event6(inst[STA].events, inst[STA].idx,
-			 inst[STA].remote_spinlock, SMEM_LOG_NUM_STATIC_ENTRIES,
-			 id, data1, data2, data3, data4, data5, data6);
+	_smem_log_event6(STA, id, data1, data2, data3, data4, data5, data6);
 }
 
 static int _smem_log_init(void)
 {
+	int cpu, log;
+
 	inst[GEN].which_log = GEN;
 	inst[GEN].events =
 		(struct smem_log_item *)smem_alloc(SMEM_SMEM_LOG_EVENTS,
@@ -1176,6 +1295,12 @@ static int _smem_log_init(void)
 	remote_spin_lock_init(&remote_spinlock_static,
 			      SMEM_SPINLOCK_STATIC_LOG);
 
+	for_each_possible_cpu(cpu)
+		for (log = 0; log < NUM; log++)
+			spin_lock_init(&per_cpu(smem_log_stage, cpu)[log].lock);
+	setup_timer(&smem_log_flush_timer, smem_log_flush_timer_fn, 0);
+	smem_log_staging = 1;
+
 	init_syms();
 
 	return 0;
@@ -1193,6 +1318,7 @@ static ssize_t smem_log_read_bin(struct file *fp, char __user *buf,
 
 	inst = fp->private_data;
 
+	smem_log_flush(inst->which_log, 1);
 	remote_spin_lock_irqsave(inst->remote_spinlock, flags);
 
 	orig_idx = *inst->idx;
@@ -1243,6 +1369,7 @@ static ssize_t smem_log_read(struct file *fp, char __user *buf,
 
 	inst = fp->private_data;
 
+	smem_log_flush(inst->which_log, 1);
 	remote_spin_lock_irqsave(inst->remote_spinlock, flags);
 
 	orig_idx = *inst->idx;
@@ -1467,6 +1594,7 @@ static int _debug_dump(int log, char *buf, int max)
 	if (!inst[log].events)
 		return 0;
 
+	smem_log_flush(log, 1);
 	remote_spin_lock_irqsave(inst[log].remote_spinlock, flags);
 
 	orig_idx = *inst[log].idx;
@@ -1538,6 +1666,7 @@ static int _debug_dump_sym(int log, char *buf, int max)
 				       voter_d2_syms[k].str);
 	i += scnprintf(buf + i, max - i, "\n");
 
+	smem_log_flush(log, 1);
 	remote_spin_lock_irqsave(inst[log].remote_spinlock, flags);
 
 	orig_idx = *inst[log].idx;
@@ -1962,6 +2091,25 @@ static int debug_dump_power_sym(char *buf, int max)
 	return _debug_dump_sym(POW, buf, max);
 }
 
+static int debug_staging(char *buf, int max)
+{
+	static const char * const names[] = { "general", "static" };
+	unsigned long dropped;
+	int cpu, log;
+	int i = 0;
+
+	for (log = GEN; log <= STA; log++) {
+		dropped = 0;
+		for_each_possible_cpu(cpu)
+			dropped += per_cpu(smem_log_stage, cpu)[log].dropped;
+		i += scnprintf(buf + i, max - i,
+			       "%-8s flushes %lu dropped %lu\n",
+			       names[log], smem_log_flushes[log], dropped);
+	}
+
+	return i;
+}
+
 #define SMEM_LOG_ITEM_PRINT_SIZE 160
 
 #define EVENTS_PRINT_SIZE \
@@ -2010,6 +2158,7 @@ static void smem_log_debugfs_init(void)
 	debug_create("dump_static_sym", 0444, dent, debug_dump_static_sym);
 	debug_create("dump_power", 0444, dent, debug_dump_power);
 	debug_create("dump_power_sym", 0444, dent, debug_dump_power_sym);
+	debug_create("staging", 0444, dent, debug_staging);
 }
 #else
 static void smem_log_debugfs_init(void) {}
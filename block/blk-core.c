@@ -26,7 +26,9 @@
 #include <linux/swap.h>
 #include <linux/writeback.h>
 #include <linux/task_io_accounting_ops.h>
+#include <linux/uid_stat.h>
 #include <linux/fault-inject.h>
+#include <linux/list_sort.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/block.h>
@@ -128,6 +130,11 @@ void blk_rq_init(struct request_queue *q, struct request *rq)
 	rq->ref_count = 1;
 	rq->start_time = jiffies;
 	set_start_time_ns(rq);
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	preempt_disable();
+	rq->lat_start_ns = sched_clock();
+	preempt_enable();
+#endif
 }
 EXPORT_SYMBOL(blk_rq_init);
 
@@ -383,6 +390,7 @@ void blk_sync_queue(struct request_queue *q)
 	del_timer_sync(&q->timeout);
 	cancel_work_sync(&q->unplug_work);
 	throtl_shutdown_timer_wq(q);
+	blk_discard_shutdown(q);
 }
 EXPORT_SYMBOL(blk_sync_queue);
 
@@ -521,6 +529,12 @@ struct request_queue *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 		return NULL;
 	}
 
+	if (blk_discard_init(q)) {
+		blk_throtl_exit(q);
+		kmem_cache_free(blk_requestq_cachep, q);
+		return NULL;
+	}
+
 	setup_timer(&q->backing_dev_info.laptop_mode_wb_timer,
 		    laptop_mode_timer_fn, (unsigned long) q);
 	init_timer(&q->unplug_timer);
@@ -1187,15 +1201,103 @@ static inline bool queue_should_plug(struct request_queue *q)
 	return !(blk_queue_nonrot(q) && blk_queue_tagged(q));
 }
 
+static bool bio_attempt_back_merge(struct request_queue *q,
+				   struct request *req, struct bio *bio)
+{
+	const unsigned long ff = bio->bi_rw & REQ_FAILFAST_MASK;
+
+	if (!ll_back_merge_fn(q, req, bio))
+		return false;
+
+	trace_block_bio_backmerge(q, bio);
+
+	if ((req->cmd_flags & REQ_FAILFAST_MASK) != ff)
+		blk_rq_set_mixed_merge(req);
+
+	req->biotail->bi_next = bio;
+	req->biotail = bio;
+	req->__data_len += bio->bi_size;
+	req->ioprio = ioprio_best(req->ioprio, bio_prio(bio));
+	if (!blk_rq_cpu_valid(req))
+		req->cpu = bio->bi_comp_cpu;
+	drive_stat_acct(req, 0);
+	return true;
+}
+
+static bool bio_attempt_front_merge(struct request_queue *q,
+				    struct request *req, struct bio *bio)
+{
+	const unsigned long ff = bio->bi_rw & REQ_FAILFAST_MASK;
+
+	if (!ll_front_merge_fn(q, req, bio))
+		return false;
+
+	trace_block_bio_frontmerge(q, bio);
+
+	if ((req->cmd_flags & REQ_FAILFAST_MASK) != ff) {
+		blk_rq_set_mixed_merge(req);
+		req->cmd_flags &= ~REQ_FAILFAST_MASK;
+		req->cmd_flags |= ff;
+	}
+
+	bio->bi_next = req->bio;
+	req->bio = bio;
+
+	/*
+	 * may not be valid. if the low level driver said
+	 * it didn't need a bounce buffer then it better
+	 * not touch req->buffer either...
+	 */
+	req->buffer = bio_data(bio);
+	req->__sector = bio->bi_sector;
+	req->__data_len += bio->bi_size;
+	req->ioprio = ioprio_best(req->ioprio, bio_prio(bio));
+	if (!blk_rq_cpu_valid(req))
+		req->cpu = bio->bi_comp_cpu;
+	drive_stat_acct(req, 0);
+	return true;
+}
+
+/*
+ * Try to merge @bio into one of the requests already sitting on the
+ * task's plug list.  Those requests are private to the task, so no
+ * lock is needed; only the list tail is likely to match, so walk it
+ * backwards.
+ */
+static bool attempt_plug_merge(struct task_struct *tsk, struct request_queue *q,
+			       struct bio *bio)
+{
+	struct blk_plug *plug = tsk->plug;
+	struct request *rq;
+	int el_ret;
+
+	if (!plug)
+		return false;
+
+	list_for_each_entry_reverse(rq, &plug->list, queuelist) {
+		if (rq->q != q)
+			continue;
+
+		el_ret = elv_try_merge(rq, bio);
+		if (el_ret == ELEVATOR_BACK_MERGE) {
+			if (bio_attempt_back_merge(q, rq, bio))
+				return true;
+		} else if (el_ret == ELEVATOR_FRONT_MERGE) {
+			if (bio_attempt_front_merge(q, rq, bio))
+				return true;
+		}
+	}
+
+	return false;
+}
+
 static int __make_request(struct request_queue *q, struct bio *bio)
 {
 	struct request *req;
+	struct blk_plug *plug;
 	int el_ret;
-	unsigned int bytes = bio->bi_size;
-	const unsigned short prio = bio_prio(bio);
 	const bool sync = !!(bio->bi_rw & REQ_SYNC);
 	const bool unplug = !!(bio->bi_rw & REQ_UNPLUG);
-	const unsigned long ff = bio->bi_rw & REQ_FAILFAST_MASK;
 	int where = ELEVATOR_INSERT_SORT;
 	int rw_flags;
 
@@ -1213,13 +1315,21 @@ static int __make_request(struct request_queue *q, struct bio *bio)
 	 */
 	blk_queue_bounce(q, &bio);
 
-	spin_lock_irq(q->queue_lock);
-
 	if (bio->bi_rw & (REQ_FLUSH | REQ_FUA)) {
+		spin_lock_irq(q->queue_lock);
 		where = ELEVATOR_INSERT_FRONT;
 		goto get_rq;
 	}
 
+	/*
+	 * Check if we can merge with the plugged list before grabbing
+	 * any locks.
+	 */
+	if (attempt_plug_merge(current, q, bio))
+		return 0;
+
+	spin_lock_irq(q->queue_lock);
+
 	if (elv_queue_empty(q))
 		goto get_rq;
 
@@ -1228,21 +1338,9 @@ static int __make_request(struct request_queue *q, struct bio *bio)
 	case ELEVATOR_BACK_MERGE:
 		BUG_ON(!rq_mergeable(req));
 
-		if (!ll_back_merge_fn(q, req, bio))
+		if (!bio_attempt_back_merge(q, req, bio))
 			break;
 
-		trace_block_bio_backmerge(q, bio);
-
-		if ((req->cmd_flags & REQ_FAILFAST_MASK) != ff)
-			blk_rq_set_mixed_merge(req);
-
-		req->biotail->bi_next = bio;
-		req->biotail = bio;
-		req->__data_len += bytes;
-		req->ioprio = ioprio_best(req->ioprio, prio);
-		if (!blk_rq_cpu_valid(req))
-			req->cpu = bio->bi_comp_cpu;
-		drive_stat_acct(req, 0);
 		elv_bio_merged(q, req, bio);
 		if (!attempt_back_merge(q, req))
 			elv_merged_request(q, req, el_ret);
@@ -1251,32 +1349,9 @@ static int __make_request(struct request_queue *q, struct bio *bio)
 	case ELEVATOR_FRONT_MERGE:
 		BUG_ON(!rq_mergeable(req));
 
-		if (!ll_front_merge_fn(q, req, bio))
+		if (!bio_attempt_front_merge(q, req, bio))
 			break;
 
-		trace_block_bio_frontmerge(q, bio);
-
-		if ((req->cmd_flags & REQ_FAILFAST_MASK) != ff) {
-			blk_rq_set_mixed_merge(req);
-			req->cmd_flags &= ~REQ_FAILFAST_MASK;
-			req->cmd_flags |= ff;
-		}
-
-		bio->bi_next = req->bio;
-		req->bio = bio;
-
-		/*
-		 * may not be valid. if the low level driver said
-		 * it didn't need a bounce buffer then it better
-		 * not touch req->buffer either...
-		 */
-		req->buffer = bio_data(bio);
-		req->__sector = bio->bi_sector;
-		req->__data_len += bytes;
-		req->ioprio = ioprio_best(req->ioprio, prio);
-		if (!blk_rq_cpu_valid(req))
-			req->cpu = bio->bi_comp_cpu;
-		drive_stat_acct(req, 0);
 		elv_bio_merged(q, req, bio);
 		if (!attempt_front_merge(q, req))
 			elv_merged_request(q, req, el_ret);
@@ -1311,10 +1386,29 @@ get_rq:
 	 */
 	init_request_from_bio(req, bio);
 
-	spin_lock_irq(q->queue_lock);
 	if (test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags) ||
 	    bio_flagged(bio, BIO_CPU_AFFINE))
-		req->cpu = blk_cpu_to_group(smp_processor_id());
+		req->cpu = blk_cpu_to_group(raw_smp_processor_id());
+
+	/*
+	 * With a plug active the request stays on the task's list; the
+	 * in-flight accounting and the elevator insert are done under the
+	 * queue lock when the plug is flushed.
+	 */
+	plug = current->plug;
+	if (plug && where == ELEVATOR_INSERT_SORT) {
+		if (!plug->should_sort && !list_empty(&plug->list)) {
+			struct request *__rq;
+
+			__rq = list_entry_rq(plug->list.prev);
+			if (__rq->q != q)
+				plug->should_sort = 1;
+		}
+		list_add_tail(&req->queuelist, &plug->list);
+		return 0;
+	}
+
+	spin_lock_irq(q->queue_lock);
 	if (queue_should_plug(q) && elv_queue_empty(q))
 		blk_plug_device(q);
 
@@ -1541,6 +1635,13 @@ static inline void __generic_make_request(struct bio *bio)
 			goto end_io;
 		}
 
+		/*
+		 * If bio = NULL, the discard has been queued for idle time.
+		 */
+		blk_discard_bio(q, &bio);
+		if (!bio)
+			break;
+
 		blk_throtl_bio(q, &bio);
 
 		/*
@@ -1633,8 +1734,11 @@ void submit_bio(int rw, struct bio *bio)
 	if (bio_has_data(bio) && !(rw & REQ_DISCARD)) {
 		if (rw & WRITE) {
 			count_vm_events(PGPGOUT, count);
+			/* the submitter, the flusher for writeback */
+			uid_stat_io_write(current_uid(), bio->bi_size);
 		} else {
 			task_io_account_read(bio->bi_size);
+			uid_stat_io_read(current_uid(), bio->bi_size);
 			count_vm_events(PGPGIN, count);
 		}
 
@@ -1794,6 +1898,39 @@ static void blk_account_io_completion(struct request *req, unsigned int bytes)
 	}
 }
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static void blk_account_latency(int cpu, struct hd_struct *part,
+				struct request *req)
+{
+	unsigned long long delta = sched_clock() - req->lat_start_ns;
+	unsigned long usecs;
+	int type, bucket;
+
+	if (req->cmd_flags & REQ_DISCARD)
+		type = BLK_LAT_DISCARD;
+	else if (req->cmd_flags & (REQ_FLUSH | REQ_FUA))
+		type = BLK_LAT_FLUSH;
+	else if (rq_data_dir(req) == WRITE)
+		type = BLK_LAT_WRITE;
+	else
+		type = BLK_LAT_READ;
+
+	/* sched_clock() may differ slightly between cpus */
+	if ((long long)delta < 0)
+		delta = 0;
+	usecs = min_t(unsigned long long, div_u64(delta, NSEC_PER_USEC),
+		      ULONG_MAX);
+
+	bucket = min(fls(usecs >> BLK_LAT_MIN_SHIFT), BLK_LAT_BUCKETS - 1);
+	part_stat_inc(cpu, part, lat_hist[type][bucket]);
+}
+#else
+static inline void blk_account_latency(int cpu, struct hd_struct *part,
+				       struct request *req)
+{
+}
+#endif
+
 static void blk_account_io_done(struct request *req)
 {
 	/*
@@ -1812,6 +1949,7 @@ static void blk_account_io_done(struct request *req)
 
 		part_stat_inc(cpu, part, ios[rw]);
 		part_stat_add(cpu, part, ticks[rw], duration);
+		blk_account_latency(cpu, part, req);
 		part_round_stats(cpu, part);
 		part_dec_in_flight(part, rw);
 
@@ -2613,6 +2751,132 @@ int kblockd_schedule_delayed_work(struct request_queue *q,
 }
 EXPORT_SYMBOL(kblockd_schedule_delayed_work);
 
+/**
+ * blk_start_plug - start collecting the task's requests
+ * @plug:	the &struct blk_plug, usually on the caller's stack
+ *
+ * Description:
+ *    Until blk_finish_plug() is called, requests submitted by the task
+ *    are kept on @plug instead of being inserted into the elevator, and
+ *    new bios are merged into them without taking the queue lock.  The
+ *    list is flushed early if the task has to sleep.  Plugs do not nest;
+ *    an inner blk_start_plug() is a no-op and the outermost one flushes.
+ */
+void blk_start_plug(struct blk_plug *plug)
+{
+	struct task_struct *tsk = current;
+
+	plug->magic = BLK_PLUG_MAGIC;
+	INIT_LIST_HEAD(&plug->list);
+	plug->should_sort = 0;
+
+	/*
+	 * If this is a nested plug, don't actually assign it. It will be
+	 * flushed on its own.
+	 */
+	if (!tsk->plug) {
+		/*
+		 * Store ordering should not be needed here, since a potential
+		 * preempt will imply a full memory barrier
+		 */
+		tsk->plug = plug;
+	}
+}
+EXPORT_SYMBOL(blk_start_plug);
+
+static int plug_rq_cmp(void *priv, struct list_head *a, struct list_head *b)
+{
+	struct request *rqa = container_of(a, struct request, queuelist);
+	struct request *rqb = container_of(b, struct request, queuelist);
+
+	return !(rqa->q <= rqb->q);
+}
+
+/*
+ * Kick the queue once its share of the plug list is in the elevator.
+ * From schedule() we may be deep in a filesystem with little stack
+ * left, so the driver is run from kblockd instead.
+ */
+static void queue_unplugged(struct request_queue *q, bool from_schedule)
+{
+	if (from_schedule) {
+		queue_flag_set(QUEUE_FLAG_PLUGGED, q);
+		kblockd_schedule_work(q, &q->unplug_work);
+	} else
+		__blk_run_queue(q);
+	spin_unlock(q->queue_lock);
+}
+
+/**
+ * blk_flush_plug_list - hand plugged requests to their queues
+ * @plug:		the plug to empty
+ * @from_schedule:	called from the scheduler on the way to sleep
+ *
+ * Description:
+ *    The list is sorted by queue so each queue lock is taken once for
+ *    the whole batch.
+ */
+void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
+{
+	struct request_queue *q;
+	unsigned long flags;
+	struct request *rq;
+	LIST_HEAD(list);
+
+	BUG_ON(plug->magic != BLK_PLUG_MAGIC);
+
+	if (list_empty(&plug->list))
+		return;
+
+	list_splice_init(&plug->list, &list);
+
+	if (plug->should_sort) {
+		list_sort(NULL, &list, plug_rq_cmp);
+		plug->should_sort = 0;
+	}
+
+	q = NULL;
+
+	/*
+	 * Save and disable interrupts here, to avoid doing it for every
+	 * queue lock we have to take.
+	 */
+	local_irq_save(flags);
+	while (!list_empty(&list)) {
+		rq = list_entry_rq(list.next);
+		list_del_init(&rq->queuelist);
+		BUG_ON(!rq->q);
+		if (rq->q != q) {
+			if (q)
+				queue_unplugged(q, from_schedule);
+			q = rq->q;
+			spin_lock(q->queue_lock);
+		}
+
+		drive_stat_acct(rq, 1);
+		__elv_add_request(q, rq, ELEVATOR_INSERT_SORT, 0);
+	}
+
+	if (q)
+		queue_unplugged(q, from_schedule);
+
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(blk_flush_plug_list);
+
+/**
+ * blk_finish_plug - submit the requests collected since blk_start_plug()
+ * @plug:	the plug passed to blk_start_plug()
+ */
+void blk_finish_plug(struct blk_plug *plug)
+{
+	blk_flush_plug_list(plug, false);
+
+	if (plug == current->plug)
+		current->plug = NULL;
+}
+EXPORT_SYMBOL(blk_finish_plug);
+
 int __init blk_dev_init(void)
 {
 	BUILD_BUG_ON(__REQ_NR_BITS > 8 *
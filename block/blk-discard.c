@@ -0,0 +1,438 @@
+/*
+ * Deferred discard support
+ *
+ * Discards are acknowledged as soon as they are submitted and the
+ * ranges are kept in a per-queue tree, merged with their neighbours.
+ * They are sent to the device one chunk at a time once the queue has
+ * been idle for a while, so that erasing a large deleted file does not
+ * stall the reads and writes queued behind it.
+ *
+ * A write to a sector that is still waiting to be discarded takes it
+ * out of the backlog, so deferring never destroys newer data.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+
+#include "blk.h"
+
+/* Pass discards straight through once this many ranges are pending */
+#define BLK_DISCARD_MAX_RANGES	1024
+
+/* Largest discard sent in one go, so a new request never waits long */
+#define BLK_DISCARD_CHUNK	((4 << 20) >> 9)
+
+struct discard_range {
+	struct rb_node node;
+	sector_t start;
+	sector_t end;			/* exclusive */
+};
+
+struct discard_data {
+	spinlock_t lock;
+	struct rb_root ranges;
+	unsigned int nr_ranges;
+	sector_t nr_sectors;		/* backlog */
+
+	unsigned long idle;		/* jiffies, 0 disables deferral */
+	unsigned long last_busy;	/* last non-discard bio */
+	int issuing;
+	int deferring;			/* discard_zeroes_data is saved */
+	unsigned int zeroes_data;	/* saved discard_zeroes_data */
+
+	struct request_queue *queue;
+	struct delayed_work work;
+};
+
+/*
+ * Lowest range ending after @sector.  Called with dd->lock held.
+ */
+static struct discard_range *
+discard_first_after(struct discard_data *dd, sector_t sector)
+{
+	struct rb_node *n = dd->ranges.rb_node;
+	struct discard_range *r, *found = NULL;
+
+	while (n) {
+		r = rb_entry(n, struct discard_range, node);
+		if (r->end > sector) {
+			found = r;
+			n = n->rb_left;
+		} else
+			n = n->rb_right;
+	}
+
+	return found;
+}
+
+static inline struct discard_range *discard_next(struct discard_range *r)
+{
+	struct rb_node *n = rb_next(&r->node);
+
+	return n ? rb_entry(n, struct discard_range, node) : NULL;
+}
+
+static void discard_link(struct discard_data *dd, struct discard_range *new)
+{
+	struct rb_node **p = &dd->ranges.rb_node;
+	struct rb_node *parent = NULL;
+	struct discard_range *r;
+
+	while (*p) {
+		parent = *p;
+		r = rb_entry(parent, struct discard_range, node);
+		if (new->start < r->start)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+
+	rb_link_node(&new->node, parent, p);
+	rb_insert_color(&new->node, &dd->ranges);
+	dd->nr_ranges++;
+	dd->nr_sectors += new->end - new->start;
+}
+
+static void discard_unlink(struct discard_data *dd, struct discard_range *r)
+{
+	rb_erase(&r->node, &dd->ranges);
+	dd->nr_ranges--;
+	dd->nr_sectors -= r->end - r->start;
+	kfree(r);
+}
+
+/*
+ * Add [new->start, new->end) to the backlog, absorbing every range it
+ * overlaps or touches.
+ */
+static void discard_insert(struct discard_data *dd, struct discard_range *new)
+{
+	struct discard_range *r, *next;
+
+	r = discard_first_after(dd, new->start ? new->start - 1 : 0);
+	while (r && r->start <= new->end) {
+		next = discard_next(r);
+		new->start = min(new->start, r->start);
+		new->end = max(new->end, r->end);
+		discard_unlink(dd, r);
+		r = next;
+	}
+
+	discard_link(dd, new);
+}
+
+/*
+ * Drop [start, end) from the backlog.  If a range has to be split and
+ * there is no memory for the tail, the tail is dropped as well: losing
+ * a discard is harmless, issuing one over live data is not.
+ */
+static void discard_cancel(struct discard_data *dd, sector_t start,
+			   sector_t end)
+{
+	struct discard_range *r, *next, *tail;
+
+	r = discard_first_after(dd, start);
+	while (r && r->start < end) {
+		next = discard_next(r);
+
+		if (r->start < start && r->end > end) {
+			sector_t old_end = r->end;
+
+			tail = kmalloc(sizeof(*tail), GFP_ATOMIC);
+			dd->nr_sectors -= old_end - start;
+			r->end = start;
+			if (tail) {
+				tail->start = end;
+				tail->end = old_end;
+				discard_link(dd, tail);
+			}
+			break;
+		} else if (r->start < start) {
+			dd->nr_sectors -= r->end - start;
+			r->end = start;
+		} else if (r->end > end) {
+			dd->nr_sectors -= end - r->start;
+			r->start = end;
+		} else
+			discard_unlink(dd, r);
+
+		r = next;
+	}
+}
+
+/*
+ * Once deferral is off and the backlog has been issued, every discard
+ * acknowledged so far has reached the device, so the queue can go back
+ * to advertising what the driver set.  Called with dd->lock held.
+ */
+static void discard_restore(struct discard_data *dd)
+{
+	if (dd->deferring && !dd->idle && !dd->nr_ranges && !dd->issuing) {
+		dd->queue->limits.discard_zeroes_data = dd->zeroes_data;
+		dd->deferring = 0;
+	}
+}
+
+/*
+ * Jiffies until the queue counts as idle, 0 if it already does.  With
+ * deferral switched off the backlog is drained right away.  The
+ * request counts cover everything allocated on the queue, whether it
+ * came through generic_make_request or not.
+ */
+static unsigned long blk_discard_idle_in(struct request_queue *q,
+					 struct discard_data *dd)
+{
+	unsigned long idle_at = dd->last_busy + dd->idle;
+
+	if (!dd->idle)
+		return 0;
+	if (q->rq.count[BLK_RW_SYNC] || q->rq.count[BLK_RW_ASYNC])
+		return dd->idle;
+	if (time_before(jiffies, idle_at))
+		return idle_at - jiffies;
+	return 0;
+}
+
+static void blk_discard_end_io(struct request *rq, int error)
+{
+	struct discard_data *dd = rq->end_io_data;
+	struct discard_range *r, *next;
+
+	spin_lock(&dd->lock);
+	dd->issuing = 0;
+	if (error) {
+		/* the device refused it, the rest would fare no better */
+		for (r = discard_first_after(dd, 0); r; r = next) {
+			next = discard_next(r);
+			discard_unlink(dd, r);
+		}
+	} else if (dd->nr_ranges)
+		kblockd_schedule_delayed_work(dd->queue, &dd->work, 0);
+	discard_restore(dd);
+	spin_unlock(&dd->lock);
+
+	__blk_put_request(rq->q, rq);
+}
+
+static void blk_discard_work(struct work_struct *work)
+{
+	struct discard_data *dd =
+		container_of(work, struct discard_data, work.work);
+	struct request_queue *q = dd->queue;
+	struct discard_range *r;
+	struct request *rq;
+	unsigned long delay;
+	sector_t start, nr;
+
+	delay = blk_discard_idle_in(q, dd);
+	if (delay) {
+		kblockd_schedule_delayed_work(q, &dd->work, delay);
+		return;
+	}
+
+	rq = blk_get_request(q, WRITE, GFP_NOIO);
+	if (!rq) {
+		kblockd_schedule_delayed_work(q, &dd->work, dd->idle);
+		return;
+	}
+
+	/*
+	 * Pick the chunk and queue it under the queue lock, so a write
+	 * racing with us either trims the backlog first or is queued
+	 * behind the discard.
+	 */
+	spin_lock_irq(q->queue_lock);
+	spin_lock(&dd->lock);
+	r = discard_first_after(dd, 0);
+	if (!r || dd->issuing) {
+		discard_restore(dd);
+		spin_unlock(&dd->lock);
+		__blk_put_request(q, rq);
+		spin_unlock_irq(q->queue_lock);
+		return;
+	}
+
+	start = r->start;
+	nr = min_t(sector_t, r->end - r->start,
+		   min_t(unsigned int, q->limits.max_discard_sectors,
+			 BLK_DISCARD_CHUNK));
+	if (nr == r->end - r->start)
+		discard_unlink(dd, r);
+	else {
+		r->start += nr;
+		dd->nr_sectors -= nr;
+	}
+	dd->issuing = 1;
+	spin_unlock(&dd->lock);
+
+	rq->cmd_type = REQ_TYPE_FS;
+	rq->cmd_flags |= REQ_DISCARD;
+	rq->__sector = start;
+	rq->__data_len = nr << 9;
+	rq->end_io = blk_discard_end_io;
+	rq->end_io_data = dd;
+
+	__elv_add_request(q, rq, ELEVATOR_INSERT_BACK, 1);
+	__generic_unplug_device(q);
+	spin_unlock_irq(q->queue_lock);
+}
+
+/**
+ * blk_discard_bio - defer a discard bio, or trim the backlog for a write
+ * @q: the queue the bio is headed to
+ * @biop: the bio, set to NULL when it has been absorbed
+ *
+ * Called from __generic_make_request() after partition remapping, so
+ * all sectors are relative to the whole device.
+ */
+int blk_discard_bio(struct request_queue *q, struct bio **biop)
+{
+	struct discard_data *dd = q->dd;
+	struct bio *bio = *biop;
+	struct discard_range *new;
+	sector_t start = bio->bi_sector;
+	sector_t end = start + bio_sectors(bio);
+	unsigned long flags;
+
+	if (!dd->idle && !dd->nr_ranges)
+		return 0;
+
+	if (!(bio->bi_rw & REQ_DISCARD)) {
+		dd->last_busy = jiffies;
+		if (bio_data_dir(bio) == WRITE && start != end &&
+		    dd->nr_ranges) {
+			spin_lock_irqsave(&dd->lock, flags);
+			discard_cancel(dd, start, end);
+			spin_unlock_irqrestore(&dd->lock, flags);
+		}
+		return 0;
+	}
+
+	/* secure discards must have happened by the time they complete */
+	if ((bio->bi_rw & REQ_SECURE) || start == end)
+		return 0;
+
+	new = kmalloc(sizeof(*new), GFP_NOIO);
+	if (!new)
+		return 0;
+	new->start = start;
+	new->end = end;
+
+	spin_lock_irqsave(&dd->lock, flags);
+	if (!dd->idle || dd->nr_ranges >= BLK_DISCARD_MAX_RANGES) {
+		spin_unlock_irqrestore(&dd->lock, flags);
+		kfree(new);
+		return 0;
+	}
+	discard_insert(dd, new);
+	if (!delayed_work_pending(&dd->work))
+		kblockd_schedule_delayed_work(q, &dd->work, dd->idle);
+	spin_unlock_irqrestore(&dd->lock, flags);
+
+	bio_endio(bio, 0);
+	*biop = NULL;
+	return 0;
+}
+
+static void blk_discard_set_idle(struct request_queue *q, unsigned int msecs)
+{
+	struct discard_data *dd = q->dd;
+
+	spin_lock_irq(&dd->lock);
+	dd->idle = msecs_to_jiffies(msecs);
+	if (dd->idle) {
+		if (!dd->deferring) {
+			dd->zeroes_data = q->limits.discard_zeroes_data;
+			dd->deferring = 1;
+		}
+		q->limits.discard_zeroes_data = 0;
+	} else if (dd->nr_ranges)
+		kblockd_schedule_delayed_work(q, &dd->work, 0);
+	discard_restore(dd);
+	spin_unlock_irq(&dd->lock);
+}
+
+/**
+ * blk_queue_discard_defer - set how long a queue must idle before discarding
+ * @q: the request queue for the device
+ * @msecs: idle time in milliseconds, 0 to issue discards immediately
+ *
+ * Only for drivers that can handle a discard request without a bio
+ * attached; calling this also lets the administrator change the idle
+ * time through sysfs.  Until a deferred range is issued it still reads
+ * back its old contents, so the queue stops advertising
+ * discard_zeroes_data while deferral is on.  Switching deferral off
+ * issues the backlog and then restores discard_zeroes_data.
+ */
+void blk_queue_discard_defer(struct request_queue *q, unsigned int msecs)
+{
+	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD_DEFER, q);
+	blk_discard_set_idle(q, msecs);
+}
+EXPORT_SYMBOL(blk_queue_discard_defer);
+
+ssize_t blk_discard_defer_show(struct request_queue *q, char *page)
+{
+	return sprintf(page, "%u\n", jiffies_to_msecs(q->dd->idle));
+}
+
+ssize_t blk_discard_defer_store(struct request_queue *q, const char *page,
+				size_t count)
+{
+	unsigned long msecs;
+
+	if (!blk_queue_discard_deferrable(q))
+		return -EINVAL;
+	if (strict_strtoul(page, 10, &msecs))
+		return -EINVAL;
+
+	blk_discard_set_idle(q, msecs);
+	return count;
+}
+
+ssize_t blk_discard_backlog_show(struct request_queue *q, char *page)
+{
+	return sprintf(page, "%llu\n",
+		       (unsigned long long)q->dd->nr_sectors << 9);
+}
+
+void blk_discard_shutdown(struct request_queue *q)
+{
+	cancel_delayed_work_sync(&q->dd->work);
+}
+
+int blk_discard_init(struct request_queue *q)
+{
+	struct discard_data *dd;
+
+	dd = kzalloc_node(sizeof(*dd), GFP_KERNEL, q->node);
+	if (!dd)
+		return -ENOMEM;
+
+	spin_lock_init(&dd->lock);
+	dd->ranges = RB_ROOT;
+	dd->queue = q;
+	INIT_DELAYED_WORK(&dd->work, blk_discard_work);
+
+	q->dd = dd;
+	return 0;
+}
+
+void blk_discard_exit(struct request_queue *q)
+{
+	struct discard_data *dd = q->dd;
+	struct discard_range *r, *next;
+
+	cancel_delayed_work_sync(&dd->work);
+
+	for (r = discard_first_after(dd, 0); r; r = next) {
+		next = discard_next(r);
+		discard_unlink(dd, r);
+	}
+
+	kfree(dd);
+	q->dd = NULL;
+}
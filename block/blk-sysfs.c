@@ -349,6 +349,19 @@ static struct queue_sysfs_entry queue_discard_zeroes_data_entry = {
 	.show = queue_discard_zeroes_data_show,
 };
 
+#ifdef CONFIG_BLK_DEV_DISCARD_DEFER
+static struct queue_sysfs_entry queue_discard_defer_entry = {
+	.attr = {.name = "discard_defer_ms", .mode = S_IRUGO | S_IWUSR },
+	.show = blk_discard_defer_show,
+	.store = blk_discard_defer_store,
+};
+
+static struct queue_sysfs_entry queue_discard_backlog_entry = {
+	.attr = {.name = "discard_backlog_bytes", .mode = S_IRUGO },
+	.show = blk_discard_backlog_show,
+};
+#endif
+
 static struct queue_sysfs_entry queue_nonrot_entry = {
 	.attr = {.name = "rotational", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_show_nonrot,
@@ -396,6 +409,10 @@ static struct attribute *default_attrs[] = {
 	&queue_discard_granularity_entry.attr,
 	&queue_discard_max_entry.attr,
 	&queue_discard_zeroes_data_entry.attr,
+#ifdef CONFIG_BLK_DEV_DISCARD_DEFER
+	&queue_discard_defer_entry.attr,
+	&queue_discard_backlog_entry.attr,
+#endif
 	&queue_nonrot_entry.attr,
 	&queue_nomerges_entry.attr,
 	&queue_rq_affinity_entry.attr,
@@ -472,6 +489,7 @@ static void blk_release_queue(struct kobject *kobj)
 	blk_sync_queue(q);
 
 	blk_throtl_exit(q);
+	blk_discard_exit(q);
 
 	if (rl->rq_pool)
 		mempool_destroy(rl->rq_pool);
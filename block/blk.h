@@ -25,6 +25,13 @@ void blk_delete_timer(struct request *);
 void blk_add_timer(struct request *);
 void __generic_unplug_device(struct request_queue *);
 
+#ifdef CONFIG_BLK_DEV_DISCARD_DEFER
+ssize_t blk_discard_defer_show(struct request_queue *q, char *page);
+ssize_t blk_discard_defer_store(struct request_queue *q, const char *page,
+				size_t count);
+ssize_t blk_discard_backlog_show(struct request_queue *q, char *page);
+#endif
+
 /*
  * Internal atomic flags for request handling
  */
@@ -117,6 +124,7 @@ void blk_queue_congestion_threshold(struct request_queue *q);
 
 int blk_dev_init(void);
 
+int elv_try_merge(struct request *__rq, struct bio *bio);
 void elv_quiesce_start(struct request_queue *q);
 void elv_quiesce_end(struct request_queue *q);
 
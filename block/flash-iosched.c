@@ -0,0 +1,651 @@
+/*
+ *  Flash-aware I/O scheduler.
+ *
+ *  Aimed at eMMC and SD devices: seeking is free, but small scattered
+ *  writes cost the card a read-modify-write of a whole erase block.
+ *
+ *  - Synchronous requests (all reads, plus O_SYNC/fsync writes) sit on a
+ *    plain FIFO and are dispatched ahead of async writeback.
+ *  - Async writes are kept on a FIFO and in a sector-sorted tree.  When
+ *    they get their turn, every queued write falling in the erase-block
+ *    aligned window of the oldest one is issued back to back.
+ *  - The async expiry, which is what eventually pushes writeback through
+ *    a stream of reads, follows the device queue: it grows while reads
+ *    complete late behind in-flight writes, and decays again once the
+ *    device has drained.
+ *  - Completion latency per class is exported in the "latency" attribute
+ *    as "<class> <count> <avg_us> <max_us> <histogram>", bucket i of the
+ *    histogram counting completions below 128us << i.  Writing to the
+ *    attribute clears it.
+ */
+#include <linux/kernel.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/rbtree.h>
+#include <linux/ktime.h>
+
+enum {
+	ASYNC,
+	SYNC,
+};
+
+enum {
+	FLASH_LAT_READ,
+	FLASH_LAT_SYNC_WRITE,
+	FLASH_LAT_ASYNC_WRITE,
+	FLASH_LAT_NR,
+};
+
+#define FLASH_LAT_BUCKETS	16
+#define FLASH_LAT_SHIFT		7
+
+/* write window used when the queue advertises no erase/optimal size */
+#define FLASH_DEFAULT_BATCH	(512 * 1024)
+
+static const int async_expire_min = HZ / 2;	/* floor of the adaptive expiry */
+static const int async_expire_max = 5 * HZ;	/* ceiling of the adaptive expiry */
+static const int read_lat_target = 20000;	/* usecs before reads push back */
+
+struct flash_lat {
+	unsigned long count;
+	u64 total_us;
+	u32 max_us;
+	unsigned long hist[FLASH_LAT_BUCKETS];
+};
+
+struct flash_data {
+	struct request_queue *q;
+
+	struct list_head fifo_list[2];
+	struct rb_root sort_list;	/* async writes in sector order */
+
+	/*
+	 * current write batch, batch_end is 0 when not batching
+	 */
+	sector_t batch_end;
+	struct request *batch_next;
+	int batch_forced;		/* started because writeback expired */
+	int sync_owed;			/* serve a sync request before forcing again */
+
+	int async_expire;		/* current, adapted on completion */
+	u32 read_lat_avg;		/* usecs, EWMA */
+
+	/*
+	 * settings
+	 */
+	int async_expire_min;
+	int async_expire_max;
+	int write_batch_kb;		/* 0 derives it from the queue limits */
+	int read_lat_target;
+
+	struct flash_lat lat[FLASH_LAT_NR];
+};
+
+/*
+ * The submission time is kept in elevator_private, truncated to 32 bits
+ * of usecs; that wraps after an hour, far beyond any request lifetime.
+ */
+static inline u32 flash_now_us(void)
+{
+	return (u32)ktime_to_us(ktime_get());
+}
+
+static inline u32 flash_stamp(struct request *rq)
+{
+	return (u32)(unsigned long)rq->elevator_private;
+}
+
+static inline void flash_set_stamp(struct request *rq, u32 us)
+{
+	rq->elevator_private = (void *)(unsigned long)us;
+}
+
+static inline struct request *flash_latter_rq(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	return node ? rb_entry_rq(node) : NULL;
+}
+
+static inline struct request *flash_former_rq(struct request *rq)
+{
+	struct rb_node *node = rb_prev(&rq->rb_node);
+
+	return node ? rb_entry_rq(node) : NULL;
+}
+
+static void flash_remove_request(struct flash_data *fd, struct request *rq)
+{
+	rq_fifo_clear(rq);
+
+	if (!rq_is_sync(rq)) {
+		if (fd->batch_next == rq)
+			fd->batch_next = flash_latter_rq(rq);
+		elv_rb_del(&fd->sort_list, rq);
+	}
+}
+
+static void flash_move_to_dispatch(struct flash_data *fd, struct request *rq)
+{
+	if (rq_is_sync(rq))
+		fd->sync_owed = 0;
+
+	flash_remove_request(fd, rq);
+	elv_dispatch_add_tail(rq->q, rq);
+}
+
+static void flash_add_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	struct request *__alias;
+
+	while (unlikely(__alias = elv_rb_add(&fd->sort_list, rq)))
+		flash_move_to_dispatch(fd, __alias);
+}
+
+static void
+flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int sync = rq_is_sync(rq);
+
+	flash_set_stamp(rq, flash_now_us());
+
+	if (sync) {
+		rq_set_fifo_time(rq, jiffies);
+	} else {
+		flash_add_rq_rb(fd, rq);
+		rq_set_fifo_time(rq, jiffies + fd->async_expire);
+	}
+
+	list_add_tail(&rq->queuelist, &fd->fifo_list[sync]);
+}
+
+static int
+flash_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	sector_t sector = bio->bi_sector + bio_sectors(bio);
+	struct request *__rq;
+
+	/*
+	 * back merges are found through the elevator hash, only async
+	 * writes are sorted so only they can be front merged
+	 */
+	if (rw_is_sync(bio->bi_rw))
+		return ELEVATOR_NO_MERGE;
+
+	__rq = elv_rb_find(&fd->sort_list, sector);
+	if (__rq && elv_rq_merge_ok(__rq, bio)) {
+		*req = __rq;
+		return ELEVATOR_FRONT_MERGE;
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void
+flash_merged_request(struct request_queue *q, struct request *rq, int type)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	if (type == ELEVATOR_FRONT_MERGE && !rq_is_sync(rq)) {
+		elv_rb_del(&fd->sort_list, rq);
+		flash_add_rq_rb(fd, rq);
+	}
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *rq,
+		      struct request *next)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	/*
+	 * if next expires before rq, assign its expire time to rq and
+	 * move into next position (next will be deleted) in fifo
+	 */
+	if (!list_empty(&rq->queuelist) && !list_empty(&next->queuelist) &&
+	    rq_is_sync(rq) == rq_is_sync(next)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(rq))) {
+			list_move(&rq->queuelist, &next->queuelist);
+			rq_set_fifo_time(rq, rq_fifo_time(next));
+		}
+	}
+
+	/* latency counts from the older of the two submissions */
+	if ((s32)(flash_stamp(next) - flash_stamp(rq)) < 0)
+		flash_set_stamp(rq, flash_stamp(next));
+
+	flash_remove_request(fd, next);
+}
+
+static int
+flash_allow_merge(struct request_queue *q, struct request *rq, struct bio *bio)
+{
+	/*
+	 * a sync write merged into writeback would wait for the whole
+	 * async batch, keep the two apart
+	 */
+	return rq_is_sync(rq) == rw_is_sync(bio->bi_rw);
+}
+
+static unsigned int
+flash_batch_bytes(struct request_queue *q, struct flash_data *fd)
+{
+	unsigned int bytes = fd->write_batch_kb << 10;
+
+	if (!bytes)
+		bytes = queue_io_opt(q);
+	if (!bytes)
+		bytes = q->limits.discard_granularity;
+	if (!bytes)
+		bytes = FLASH_DEFAULT_BATCH;
+
+	return bytes;
+}
+
+static inline int flash_async_expired(struct flash_data *fd)
+{
+	struct request *rq = rq_entry_fifo(fd->fifo_list[ASYNC].next);
+
+	return time_after(jiffies, rq_fifo_time(rq));
+}
+
+/*
+ * Open a write batch over the erase-block-aligned window holding the
+ * oldest async write, starting from the lowest queued sector inside it.
+ */
+static struct request *
+flash_start_batch(struct request_queue *q, struct flash_data *fd, int forced)
+{
+	struct request *rq = rq_entry_fifo(fd->fifo_list[ASYNC].next);
+	unsigned int window = max(flash_batch_bytes(q, fd) >> 9, 1U);
+	sector_t start = blk_rq_pos(rq);
+	sector_t tmp = start;
+	struct request *prev;
+
+	start -= sector_div(tmp, window);
+
+	while ((prev = flash_former_rq(rq)) && blk_rq_pos(prev) >= start)
+		rq = prev;
+
+	fd->batch_end = start + window;
+	fd->batch_next = rq;
+	fd->batch_forced = forced;
+
+	return rq;
+}
+
+static void flash_end_batch(struct flash_data *fd)
+{
+	if (fd->batch_forced)
+		fd->sync_owed = 1;
+
+	fd->batch_end = 0;
+	fd->batch_next = NULL;
+	fd->batch_forced = 0;
+}
+
+static int
+flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int syncs = !list_empty(&fd->fifo_list[SYNC]);
+	const int asyncs = !list_empty(&fd->fifo_list[ASYNC]);
+	struct request *rq;
+
+	/*
+	 * Keep feeding the current write batch unless a sync request has
+	 * arrived.  A batch forced by expiry is not preempted, otherwise a
+	 * steady stream of reads would starve writeback for good.
+	 */
+	if (fd->batch_end) {
+		rq = fd->batch_next;
+		if (rq && blk_rq_pos(rq) < fd->batch_end &&
+		    (!syncs || fd->batch_forced))
+			goto dispatch;
+		flash_end_batch(fd);
+	}
+
+	if (syncs && (fd->sync_owed || !asyncs || !flash_async_expired(fd))) {
+		rq = rq_entry_fifo(fd->fifo_list[SYNC].next);
+		goto dispatch;
+	}
+
+	if (!asyncs)
+		return 0;
+
+	rq = flash_start_batch(q, fd, syncs);
+
+dispatch:
+	flash_move_to_dispatch(fd, rq);
+	return 1;
+}
+
+static int
+flash_queue_empty(struct request_queue *q)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	return list_empty(&fd->fifo_list[SYNC]) &&
+		list_empty(&fd->fifo_list[ASYNC]);
+}
+
+static void flash_lat_account(struct flash_lat *lat, u32 us)
+{
+	int bucket = fls(us >> FLASH_LAT_SHIFT);
+
+	if (bucket >= FLASH_LAT_BUCKETS)
+		bucket = FLASH_LAT_BUCKETS - 1;
+
+	lat->hist[bucket]++;
+	lat->count++;
+	lat->total_us += us;
+	if (us > lat->max_us)
+		lat->max_us = us;
+}
+
+/*
+ * Queue-depth feedback for the async expiry.  A read completing over
+ * target while writes are still in flight at the device means writeback
+ * is crowding reads out, so let writes wait longer before they are
+ * forced through.  Once the device queue is empty the expiry decays.
+ */
+static void flash_update_expire(struct request_queue *q,
+				struct flash_data *fd, int class, u32 us)
+{
+	int expire = fd->async_expire;
+
+	if (class == FLASH_LAT_READ) {
+		fd->read_lat_avg = (fd->read_lat_avg * 7 + us) >> 3;
+		if (fd->read_lat_avg > (u32)fd->read_lat_target &&
+		    q->in_flight[ASYNC])
+			expire += (expire >> 1) + 1;
+	} else if (!q->in_flight[SYNC] && !q->in_flight[ASYNC]) {
+		expire -= expire >> 3;
+	}
+
+	fd->async_expire = clamp(expire, fd->async_expire_min,
+				 fd->async_expire_max);
+}
+
+static void
+flash_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	u32 us = flash_now_us() - flash_stamp(rq);
+	int class;
+
+	if (!rq_is_sync(rq))
+		class = FLASH_LAT_ASYNC_WRITE;
+	else if (rq_data_dir(rq) == WRITE)
+		class = FLASH_LAT_SYNC_WRITE;
+	else
+		class = FLASH_LAT_READ;
+
+	flash_lat_account(&fd->lat[class], us);
+	flash_update_expire(q, fd, class, us);
+}
+
+static struct request *
+flash_former_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	if (!rq_is_sync(rq))
+		return elv_rb_former_request(q, rq);
+
+	if (rq->queuelist.prev == &fd->fifo_list[SYNC])
+		return NULL;
+
+	return list_entry(rq->queuelist.prev, struct request, queuelist);
+}
+
+static struct request *
+flash_latter_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	if (!rq_is_sync(rq))
+		return elv_rb_latter_request(q, rq);
+
+	if (rq->queuelist.next == &fd->fifo_list[SYNC])
+		return NULL;
+
+	return list_entry(rq->queuelist.next, struct request, queuelist);
+}
+
+static void *
+flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+
+	fd = kzalloc_node(sizeof(*fd), GFP_KERNEL, q->node);
+	if (!fd)
+		return NULL;
+
+	fd->q = q;
+	INIT_LIST_HEAD(&fd->fifo_list[SYNC]);
+	INIT_LIST_HEAD(&fd->fifo_list[ASYNC]);
+	fd->sort_list = RB_ROOT;
+
+	fd->async_expire_min = async_expire_min;
+	fd->async_expire_max = async_expire_max;
+	fd->async_expire = async_expire_min;
+	fd->read_lat_target = read_lat_target;
+
+	return fd;
+}
+
+static void
+flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	BUG_ON(!list_empty(&fd->fifo_list[SYNC]));
+	BUG_ON(!list_empty(&fd->fifo_list[ASYNC]));
+
+	kfree(fd);
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_async_expire_show, fd->async_expire, 1);
+SHOW_FUNCTION(flash_async_expire_min_show, fd->async_expire_min, 1);
+SHOW_FUNCTION(flash_async_expire_max_show, fd->async_expire_max, 1);
+SHOW_FUNCTION(flash_write_batch_kb_show, fd->write_batch_kb, 0);
+SHOW_FUNCTION(flash_read_lat_target_show, fd->read_lat_target, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_write_batch_kb_store, &fd->write_batch_kb, 0, 65536, 0);
+STORE_FUNCTION(flash_read_lat_target_store, &fd->read_lat_target, 0, INT_MAX, 0);
+#undef STORE_FUNCTION
+
+/*
+ * The adaptive expiry bounds may not cross: a write that would put min
+ * above max is refused.  The current expiry is pulled into the new range.
+ */
+static ssize_t
+flash_expire_bound_store(struct elevator_queue *e, const char *page,
+			 size_t count, int is_max)
+{
+	struct flash_data *fd = e->elevator_data;
+	ssize_t ret;
+	int data;
+
+	ret = flash_var_store(&data, page, count);
+	data = msecs_to_jiffies(max(data, 0));
+
+	spin_lock_irq(fd->q->queue_lock);
+	if (is_max ? data < fd->async_expire_min :
+		     data > fd->async_expire_max) {
+		ret = -EINVAL;
+	} else {
+		if (is_max)
+			fd->async_expire_max = data;
+		else
+			fd->async_expire_min = data;
+		fd->async_expire = clamp(fd->async_expire,
+					 fd->async_expire_min,
+					 fd->async_expire_max);
+	}
+	spin_unlock_irq(fd->q->queue_lock);
+
+	return ret;
+}
+
+static ssize_t
+flash_async_expire_min_store(struct elevator_queue *e, const char *page,
+			     size_t count)
+{
+	return flash_expire_bound_store(e, page, count, 0);
+}
+
+static ssize_t
+flash_async_expire_max_store(struct elevator_queue *e, const char *page,
+			     size_t count)
+{
+	return flash_expire_bound_store(e, page, count, 1);
+}
+
+static ssize_t flash_latency_show(struct elevator_queue *e, char *page)
+{
+	static const char *names[FLASH_LAT_NR] = {
+		"read", "sync_write", "async_write",
+	};
+	struct flash_data *fd = e->elevator_data;
+	struct flash_lat lat[FLASH_LAT_NR];
+	ssize_t len = 0;
+	int i, b;
+
+	spin_lock_irq(fd->q->queue_lock);
+	memcpy(lat, fd->lat, sizeof(lat));
+	spin_unlock_irq(fd->q->queue_lock);
+
+	for (i = 0; i < FLASH_LAT_NR; i++) {
+		u64 avg = lat[i].total_us;
+
+		if (lat[i].count)
+			do_div(avg, lat[i].count);
+
+		len += sprintf(page + len, "%s %lu %llu %u", names[i],
+			       lat[i].count, (unsigned long long)avg,
+			       lat[i].max_us);
+		for (b = 0; b < FLASH_LAT_BUCKETS; b++)
+			len += sprintf(page + len, " %lu", lat[i].hist[b]);
+		len += sprintf(page + len, "\n");
+	}
+
+	return len;
+}
+
+static ssize_t
+flash_latency_store(struct elevator_queue *e, const char *page, size_t count)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	spin_lock_irq(fd->q->queue_lock);
+	memset(fd->lat, 0, sizeof(fd->lat));
+	spin_unlock_irq(fd->q->queue_lock);
+
+	return count;
+}
+
+#define FLASH_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+
+static struct elv_fs_entry flash_attrs[] = {
+	__ATTR(async_expire, S_IRUGO, flash_async_expire_show, NULL),
+	FLASH_ATTR(async_expire_min),
+	FLASH_ATTR(async_expire_max),
+	FLASH_ATTR(write_batch_kb),
+	FLASH_ATTR(read_lat_target),
+	FLASH_ATTR(latency),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_merge_fn =		flash_merge,
+		.elevator_merged_fn =		flash_merged_request,
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_allow_merge_fn =	flash_allow_merge,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_add_request,
+		.elevator_queue_empty_fn =	flash_queue_empty,
+		.elevator_completed_req_fn =	flash_completed_request,
+		.elevator_former_req_fn =	flash_former_request,
+		.elevator_latter_req_fn =	flash_latter_request,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	elv_register(&iosched_flash);
+
+	return 0;
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Flash-aware IO scheduler");
@@ -0,0 +1,237 @@
+/*
+ * Null block device driver
+ *
+ * Every request is completed as soon as it is seen, without touching
+ * the data, so whatever is measured on a nullb device is the cost of
+ * the block layer alone.  It is meant for checking how the submission
+ * path scales with the number of submitters: run a random I/O load on
+ * it and compare the IOPS and the number of requests handled per
+ * request_fn call (that is, per queue lock round trip), which are
+ * exported in debugfs under null_blk/nullbN/.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/debugfs.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+
+#define SECTOR_SHIFT		9
+
+struct nullb {
+	struct list_head list;
+	unsigned int index;
+	struct request_queue *q;
+	struct gendisk *disk;
+	spinlock_t lock;
+
+	/* rq mode only, updated under the queue lock */
+	u64 requests;
+	u64 dispatches;
+	struct dentry *debugfs_dir;
+};
+
+static LIST_HEAD(nullb_list);
+static int null_major;
+static struct dentry *null_debugfs_root;
+
+enum {
+	NULL_Q_BIO	= 0,
+	NULL_Q_RQ	= 1,
+};
+
+enum {
+	NULL_IRQ_NONE		= 0,
+	NULL_IRQ_SOFTIRQ	= 1,
+};
+
+static int queue_mode = NULL_Q_RQ;
+module_param(queue_mode, int, S_IRUGO);
+MODULE_PARM_DESC(queue_mode, "Block interface to use (0=bio,1=rq)");
+
+static int irqmode = NULL_IRQ_SOFTIRQ;
+module_param(irqmode, int, S_IRUGO);
+MODULE_PARM_DESC(irqmode, "Request completion (0=inline,1=softirq)");
+
+static int nr_devices = 2;
+module_param(nr_devices, int, S_IRUGO);
+MODULE_PARM_DESC(nr_devices, "Number of devices to register");
+
+static int gb = 250;
+module_param(gb, int, S_IRUGO);
+MODULE_PARM_DESC(gb, "Size of each device in GB");
+
+static int bs = 512;
+module_param(bs, int, S_IRUGO);
+MODULE_PARM_DESC(bs, "Logical block size in bytes");
+
+static int null_make_request(struct request_queue *q, struct bio *bio)
+{
+	bio_endio(bio, 0);
+	return 0;
+}
+
+static void null_softirq_done_fn(struct request *rq)
+{
+	blk_end_request_all(rq, 0);
+}
+
+static void null_request_fn(struct request_queue *q)
+{
+	struct nullb *nullb = q->queuedata;
+	struct request *rq;
+
+	nullb->dispatches++;
+
+	while ((rq = blk_fetch_request(q)) != NULL) {
+		nullb->requests++;
+		if (irqmode == NULL_IRQ_SOFTIRQ)
+			blk_complete_request(rq);
+		else
+			__blk_end_request_all(rq, 0);
+	}
+}
+
+static const struct block_device_operations null_fops = {
+	.owner		= THIS_MODULE,
+};
+
+static void null_debugfs_add(struct nullb *nullb)
+{
+	struct dentry *dir;
+
+	if (!null_debugfs_root || queue_mode != NULL_Q_RQ)
+		return;
+
+	dir = debugfs_create_dir(nullb->disk->disk_name, null_debugfs_root);
+	if (IS_ERR_OR_NULL(dir))
+		return;
+
+	debugfs_create_u64("requests", S_IRUGO, dir, &nullb->requests);
+	debugfs_create_u64("dispatches", S_IRUGO, dir, &nullb->dispatches);
+	nullb->debugfs_dir = dir;
+}
+
+static void null_del_dev(struct nullb *nullb)
+{
+	list_del_init(&nullb->list);
+
+	debugfs_remove_recursive(nullb->debugfs_dir);
+	del_gendisk(nullb->disk);
+	blk_cleanup_queue(nullb->q);
+	put_disk(nullb->disk);
+	kfree(nullb);
+}
+
+static int null_add_dev(unsigned int index)
+{
+	struct gendisk *disk;
+	struct nullb *nullb;
+
+	nullb = kzalloc(sizeof(*nullb), GFP_KERNEL);
+	if (!nullb)
+		return -ENOMEM;
+
+	nullb->index = index;
+	spin_lock_init(&nullb->lock);
+
+	if (queue_mode == NULL_Q_BIO) {
+		nullb->q = blk_alloc_queue(GFP_KERNEL);
+		if (!nullb->q)
+			goto out_free_nullb;
+		blk_queue_make_request(nullb->q, null_make_request);
+	} else {
+		nullb->q = blk_init_queue(null_request_fn, &nullb->lock);
+		if (!nullb->q)
+			goto out_free_nullb;
+		if (irqmode == NULL_IRQ_SOFTIRQ)
+			blk_queue_softirq_done(nullb->q, null_softirq_done_fn);
+	}
+
+	nullb->q->queuedata = nullb;
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, nullb->q);
+	blk_queue_logical_block_size(nullb->q, bs);
+	blk_queue_physical_block_size(nullb->q, bs);
+
+	disk = nullb->disk = alloc_disk(1);
+	if (!disk)
+		goto out_cleanup_queue;
+
+	disk->major		= null_major;
+	disk->first_minor	= index;
+	disk->fops		= &null_fops;
+	disk->private_data	= nullb;
+	disk->queue		= nullb->q;
+	sprintf(disk->disk_name, "nullb%d", index);
+	set_capacity(disk, (sector_t)gb << (30 - SECTOR_SHIFT));
+
+	add_disk(disk);
+	null_debugfs_add(nullb);
+	list_add_tail(&nullb->list, &nullb_list);
+	return 0;
+
+out_cleanup_queue:
+	blk_cleanup_queue(nullb->q);
+out_free_nullb:
+	kfree(nullb);
+	return -ENOMEM;
+}
+
+static int __init null_init(void)
+{
+	struct nullb *nullb, *next;
+	unsigned int i;
+	int ret;
+
+	if (bs < 512 || bs > PAGE_SIZE || !is_power_of_2(bs)) {
+		printk(KERN_WARNING "null_blk: invalid block size %d, using 512\n",
+		       bs);
+		bs = 512;
+	}
+
+	if (queue_mode != NULL_Q_BIO && queue_mode != NULL_Q_RQ)
+		queue_mode = NULL_Q_RQ;
+
+	null_major = register_blkdev(0, "nullb");
+	if (null_major < 0)
+		return null_major;
+
+	null_debugfs_root = debugfs_create_dir("null_blk", NULL);
+	if (IS_ERR(null_debugfs_root))
+		null_debugfs_root = NULL;
+
+	for (i = 0; i < nr_devices; i++) {
+		ret = null_add_dev(i);
+		if (ret)
+			goto out_free;
+	}
+
+	printk(KERN_INFO "null_blk: module loaded\n");
+	return 0;
+
+out_free:
+	list_for_each_entry_safe(nullb, next, &nullb_list, list)
+		null_del_dev(nullb);
+	debugfs_remove_recursive(null_debugfs_root);
+	unregister_blkdev(null_major, "nullb");
+	return ret;
+}
+
+static void __exit null_exit(void)
+{
+	struct nullb *nullb, *next;
+
+	list_for_each_entry_safe(nullb, next, &nullb_list, list)
+		null_del_dev(nullb);
+
+	debugfs_remove_recursive(null_debugfs_root);
+	unregister_blkdev(null_major, "nullb");
+}
+
+module_init(null_init);
+module_exit(null_exit);
+
+MODULE_LICENSE("GPL");
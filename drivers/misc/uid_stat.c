@@ -16,39 +16,66 @@
 #include <asm/atomic.h>
 
 #include <linux/err.h>
+#include <linux/hash.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/moduleparam.h>
 #include <linux/proc_fs.h>
+#include <linux/rculist.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/stat.h>
+#include <linux/uaccess.h>
 #include <linux/uid_stat.h>
+#include <linux/workqueue.h>
 #include <net/activity_stats.h>
 
+#define UID_HASH_BITS	6
+
 static DEFINE_SPINLOCK(uid_lock);
-static LIST_HEAD(uid_list);
+static struct hlist_head uid_hash[1 << UID_HASH_BITS];
+static LIST_HEAD(uid_pending);
 static struct proc_dir_entry *parent;
 
 struct uid_stat {
-	struct list_head link;
+	struct hlist_node hash;
+	struct list_head link;		/* on uid_pending until in /proc */
 	uid_t uid;
 	atomic_t tcp_rcv;
 	atomic_t tcp_snd;
+#ifdef CONFIG_UID_STAT_IO
+	atomic64_t io_read;
+	atomic64_t io_write;
+	atomic64_t io_dirtied;
+	atomic64_t io_wait_us;
+	atomic64_t io_throttle_us;
+	int io_background;
+	spinlock_t io_lock;
+	s64 io_tokens;			/* bytes, negative when in debt */
+	unsigned long io_stamp;		/* jiffies of the last refill */
+#endif
 };
 
+/*
+ * Entries are never freed, so lookups only need RCU against concurrent
+ * insertion and may run from any context.
+ */
 static struct uid_stat *find_uid_stat(uid_t uid) {
-	unsigned long flags;
 	struct uid_stat *entry;
+	struct hlist_node *pos;
 
-	spin_lock_irqsave(&uid_lock, flags);
-	list_for_each_entry(entry, &uid_list, link) {
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(entry, pos,
+			&uid_hash[hash_long(uid, UID_HASH_BITS)], hash) {
 		if (entry->uid == uid) {
-			spin_unlock_irqrestore(&uid_lock, flags);
+			rcu_read_unlock();
 			return entry;
 		}
 	}
-	spin_unlock_irqrestore(&uid_lock, flags);
+	rcu_read_unlock();
 	return NULL;
 }
 
@@ -88,46 +115,124 @@ static int tcp_rcv_read_proc(char *page, char **start, off_t off,
 	return len;
 }
 
-/* Create a new entry for tracking the specified uid. */
-static struct uid_stat *create_stat(uid_t uid) {
+#ifdef CONFIG_UID_STAT_IO
+static int io_read_proc(char *page, char **start, off_t off,
+				int count, int *eof, void *data)
+{
+	int len;
+	char *p = page;
+	struct uid_stat *uid_entry = (struct uid_stat *) data;
+	if (!data)
+		return 0;
+
+	p += sprintf(p, "read_bytes: %llu\n",
+		atomic64_read(&uid_entry->io_read));
+	p += sprintf(p, "write_bytes: %llu\n",
+		atomic64_read(&uid_entry->io_write));
+	p += sprintf(p, "dirtied_pages: %llu\n",
+		atomic64_read(&uid_entry->io_dirtied));
+	p += sprintf(p, "iowait_us: %llu\n",
+		atomic64_read(&uid_entry->io_wait_us));
+	p += sprintf(p, "throttled_us: %llu\n",
+		atomic64_read(&uid_entry->io_throttle_us));
+	p += sprintf(p, "background: %d\n", uid_entry->io_background);
+	len = (p - page) - off;
+	*eof = (len <= count) ? 1 : 0;
+	*start = page + off;
+	return len;
+}
+#endif
+
+/*
+ * /proc entries can only be made from process context while the I/O
+ * hooks run with interrupts off, so the directories of new uids are
+ * populated from a work item.
+ */
+static void uid_proc_work_fn(struct work_struct *work)
+{
 	unsigned long flags;
 	char uid_s[32];
-	struct uid_stat *new_uid;
+	struct uid_stat *uid_entry;
 	struct proc_dir_entry *entry;
 
-	/* Create the uid stat struct and append it to the list. */
-	if ((new_uid = kmalloc(sizeof(struct uid_stat), GFP_KERNEL)) == NULL)
+	if (!parent)
+		return;
+
+	spin_lock_irqsave(&uid_lock, flags);
+	while (!list_empty(&uid_pending)) {
+		uid_entry = list_first_entry(&uid_pending, struct uid_stat,
+					     link);
+		list_del(&uid_entry->link);
+		spin_unlock_irqrestore(&uid_lock, flags);
+
+		sprintf(uid_s, "%d", uid_entry->uid);
+		entry = proc_mkdir(uid_s, parent);
+
+		/* Keep reference to uid_stat so we know what uid to read stats from. */
+		create_proc_read_entry("tcp_snd", S_IRUGO, entry,
+			tcp_snd_read_proc, (void *) uid_entry);
+
+		create_proc_read_entry("tcp_rcv", S_IRUGO, entry,
+			tcp_rcv_read_proc, (void *) uid_entry);
+#ifdef CONFIG_UID_STAT_IO
+		create_proc_read_entry("io", S_IRUGO, entry,
+			io_read_proc, (void *) uid_entry);
+#endif
+
+		spin_lock_irqsave(&uid_lock, flags);
+	}
+	spin_unlock_irqrestore(&uid_lock, flags);
+}
+
+static DECLARE_WORK(uid_proc_work, uid_proc_work_fn);
+
+/* Create a new entry for tracking the specified uid. */
+static struct uid_stat *create_stat(uid_t uid) {
+	unsigned long flags;
+	struct uid_stat *new_uid, *entry;
+
+	/* Create the uid stat struct and add it to the hash. */
+	if ((new_uid = kzalloc(sizeof(struct uid_stat), GFP_ATOMIC)) == NULL)
 		return NULL;
 
 	new_uid->uid = uid;
 	/* Counters start at INT_MIN, so we can track 4GB of network traffic. */
 	atomic_set(&new_uid->tcp_rcv, INT_MIN);
 	atomic_set(&new_uid->tcp_snd, INT_MIN);
+#ifdef CONFIG_UID_STAT_IO
+	spin_lock_init(&new_uid->io_lock);
+	new_uid->io_stamp = jiffies;
+#endif
 
 	spin_lock_irqsave(&uid_lock, flags);
-	list_add_tail(&new_uid->link, &uid_list);
+	/* Lost a race against another cpu adding the same uid. */
+	if ((entry = find_uid_stat(uid)) != NULL) {
+		spin_unlock_irqrestore(&uid_lock, flags);
+		kfree(new_uid);
+		return entry;
+	}
+	hlist_add_head_rcu(&new_uid->hash,
+			&uid_hash[hash_long(uid, UID_HASH_BITS)]);
+	list_add_tail(&new_uid->link, &uid_pending);
 	spin_unlock_irqrestore(&uid_lock, flags);
 
-	sprintf(uid_s, "%d", uid);
-	entry = proc_mkdir(uid_s, parent);
-
-	/* Keep reference to uid_stat so we know what uid to read stats from. */
-	create_proc_read_entry("tcp_snd", S_IRUGO, entry , tcp_snd_read_proc,
-		(void *) new_uid);
+	schedule_work(&uid_proc_work);
+	return new_uid;
+}
 
-	create_proc_read_entry("tcp_rcv", S_IRUGO, entry, tcp_rcv_read_proc,
-		(void *) new_uid);
+static inline struct uid_stat *get_uid_stat(uid_t uid) {
+	struct uid_stat *entry;
 
-	return new_uid;
+	if ((entry = find_uid_stat(uid)) == NULL)
+		entry = create_stat(uid);
+	return entry;
 }
 
 int uid_stat_tcp_snd(uid_t uid, int size) {
 	struct uid_stat *entry;
 	activity_stats_update();
-	if ((entry = find_uid_stat(uid)) == NULL &&
-		((entry = create_stat(uid)) == NULL)) {
-			return -1;
-	}
+	if ((entry = get_uid_stat(uid)) == NULL)
+		return -1;
 	atomic_add(size, &entry->tcp_snd);
 	return 0;
 }
@@ -135,21 +240,203 @@ int uid_stat_tcp_snd(uid_t uid, int size) {
 int uid_stat_tcp_rcv(uid_t uid, int size) {
 	struct uid_stat *entry;
 	activity_stats_update();
-	if ((entry = find_uid_stat(uid)) == NULL &&
-		((entry = create_stat(uid)) == NULL)) {
-			return -1;
-	}
+	if ((entry = get_uid_stat(uid)) == NULL)
+		return -1;
 	atomic_add(size, &entry->tcp_rcv);
 	return 0;
 }
 
+#ifdef CONFIG_UID_STAT_IO
+/*
+ * Bandwidth cap, in KB/s, shared by every uid marked as background
+ * through /proc/uid_stat/io_background.  0 disables throttling.
+ */
+static unsigned int io_bg_kbps;
+module_param(io_bg_kbps, uint, S_IRUGO | S_IWUSR);
+
+/*
+ * Token bucket holding at most one second worth of bandwidth.  Called
+ * with entry->io_lock held.
+ */
+static void uid_io_refill(struct uid_stat *entry, u64 rate)
+{
+	unsigned long elapsed = jiffies - entry->io_stamp;
+
+	if (elapsed > HZ)
+		elapsed = HZ;
+	entry->io_stamp = jiffies;
+	entry->io_tokens += div_u64(rate * elapsed, HZ);
+	if (entry->io_tokens > (s64)rate)
+		entry->io_tokens = rate;
+}
+
+static void uid_io_charge(struct uid_stat *entry, unsigned int bytes)
+{
+	unsigned long flags;
+	u64 rate = (u64)io_bg_kbps << 10;
+
+	if (!rate || !entry->io_background)
+		return;
+
+	spin_lock_irqsave(&entry->io_lock, flags);
+	uid_io_refill(entry, rate);
+	entry->io_tokens -= bytes;
+	spin_unlock_irqrestore(&entry->io_lock, flags);
+}
+
+void uid_stat_io_read(uid_t uid, unsigned int bytes)
+{
+	struct uid_stat *entry;
+
+	if ((entry = get_uid_stat(uid)) == NULL)
+		return;
+	atomic64_add(bytes, &entry->io_read);
+	uid_io_charge(entry, bytes);
+}
+
+/*
+ * Bytes written by @uid as the submitter of the bio; writeback is
+ * charged to whoever flushes it.  uid_stat_io_dirtied() accounts for
+ * buffered writes at dirtying time.
+ */
+void uid_stat_io_write(uid_t uid, unsigned int bytes)
+{
+	struct uid_stat *entry;
+
+	if ((entry = get_uid_stat(uid)) == NULL)
+		return;
+	atomic64_add(bytes, &entry->io_write);
+}
+
+void uid_stat_io_dirtied(uid_t uid)
+{
+	struct uid_stat *entry;
+
+	if ((entry = get_uid_stat(uid)) == NULL)
+		return;
+	atomic64_inc(&entry->io_dirtied);
+	uid_io_charge(entry, PAGE_CACHE_SIZE);
+}
+
+u64 uid_stat_io_wait_start(void)
+{
+	return local_clock();
+}
+
+/*
+ * Called on every io_schedule(), so only look the uid up: a uid that
+ * has never read, written or dirtied anything has nothing to wait on.
+ */
+void uid_stat_io_wait_end(u64 start)
+{
+	struct uid_stat *entry;
+
+	if ((entry = find_uid_stat(current_uid())) == NULL)
+		return;
+	atomic64_add(div_u64(local_clock() - start, NSEC_PER_USEC),
+		&entry->io_wait_us);
+}
+
+/*
+ * Make a background uid pay off its I/O debt.  Reads and dirtied pages
+ * are charged where they happen, which may be atomic; the sleep happens
+ * here, from points where the caller holds no locks.
+ */
+void uid_stat_io_throttle(void)
+{
+	unsigned long flags;
+	long delay = 0;
+	struct uid_stat *entry;
+	u64 rate = (u64)io_bg_kbps << 10;
+
+	if (!rate)
+		return;
+	if ((entry = find_uid_stat(current_uid())) == NULL ||
+			!entry->io_background)
+		return;
+
+	spin_lock_irqsave(&entry->io_lock, flags);
+	uid_io_refill(entry, rate);
+	if (entry->io_tokens < 0)
+		delay = div64_u64(-entry->io_tokens * HZ, rate) + 1;
+	spin_unlock_irqrestore(&entry->io_lock, flags);
+
+	if (!delay)
+		return;
+	/* Sleep in slices so a heavily indebted task stays responsive. */
+	if (delay > HZ / 4)
+		delay = HZ / 4;
+	schedule_timeout_killable(delay);
+	atomic64_add(jiffies_to_usecs(delay), &entry->io_throttle_us);
+}
+
+static int io_background_read_proc(char *page, char **start, off_t off,
+				int count, int *eof, void *data)
+{
+	int i, len;
+	char *p = page;
+	struct uid_stat *entry;
+	struct hlist_node *pos;
+
+	rcu_read_lock();
+	for (i = 0; i < ARRAY_SIZE(uid_hash); i++) {
+		hlist_for_each_entry_rcu(entry, pos, &uid_hash[i], hash) {
+			if (entry->io_background &&
+					p - page < PAGE_SIZE - 16)
+				p += sprintf(p, "%u\n", entry->uid);
+		}
+	}
+	rcu_read_unlock();
+	len = (p - page) - off;
+	*eof = (len <= count) ? 1 : 0;
+	*start = page + off;
+	return len;
+}
+
+/* Takes "<uid> <0|1>" to clear or set the background flag of a uid. */
+static int io_background_write_proc(struct file *file,
+		const char __user *buffer, unsigned long count, void *data)
+{
+	char buf[32];
+	unsigned int uid;
+	int background;
+	struct uid_stat *entry;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, buffer, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (sscanf(buf, "%u %d", &uid, &background) != 2)
+		return -EINVAL;
+	if ((entry = get_uid_stat(uid)) == NULL)
+		return -ENOMEM;
+	entry->io_background = !!background;
+	return count;
+}
+#endif
+
 static int __init uid_stat_init(void)
 {
+#ifdef CONFIG_UID_STAT_IO
+	struct proc_dir_entry *entry;
+#endif
+
 	parent = proc_mkdir("uid_stat", NULL);
 	if (!parent) {
 		pr_err("uid_stat: failed to create proc entry\n");
 		return -1;
 	}
+#ifdef CONFIG_UID_STAT_IO
+	entry = create_proc_entry("io_background", S_IRUGO | S_IWUSR, parent);
+	if (entry) {
+		entry->read_proc = io_background_read_proc;
+		entry->write_proc = io_background_write_proc;
+	}
+#endif
+	/* Pick up uids that did network or disk I/O before we got here. */
+	schedule_work(&uid_proc_work);
 	return 0;
 }
 
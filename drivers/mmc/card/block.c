@@ -33,6 +33,8 @@
 #include <linux/string_helpers.h>
 #include <linux/genhd.h>
 #include <linux/delay.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <linux/mmc/card.h>
 #include <linux/mmc/host.h>
@@ -69,6 +71,28 @@ static int max_devices;
 /* 256 minors, so at most 256 separate devices */
 static DECLARE_BITMAP(dev_use, 256);
 
+struct mmc_blk_request {
+	struct mmc_request	mrq;
+	struct mmc_command	cmd;
+	struct mmc_command	stop;
+	struct mmc_data		data;
+};
+
+/*
+ * A packed write carries a one block header with an (arg, address) pair
+ * per request after the first pair, which holds the header itself.
+ */
+#define MMC_BLK_PACKED_HDR_SZ	512
+#define MMC_BLK_PACKED_MAX_REQS	(MMC_BLK_PACKED_HDR_SZ / 8 - 1)
+
+struct mmc_blk_packed_stats {
+	unsigned long	packed_cmds;	/* packed write commands issued */
+	unsigned long	packed_reqs;	/* requests sent in those */
+	unsigned long	single_wr;	/* write requests sent on their own */
+	unsigned long	rel_wr;		/* requests packed as reliable writes */
+	unsigned long	fallbacks;	/* packed commands that failed */
+};
+
 /*
  * There is one mmc_blk_data per slot.
  */
@@ -77,6 +101,16 @@ struct mmc_blk_data {
 	struct gendisk	*disk;
 	struct mmc_queue queue;
 
+	/* next request, built and mapped while the current one is active */
+	struct mmc_blk_request	next_brq;
+	struct request		*next_prepared;
+
+	/* packed writes, only set up for cards that support them */
+	u32			*packed_hdr;
+	struct list_head	packed_list;
+	struct mmc_blk_packed_stats packed_stats;
+	struct dentry		*packed_dentry;
+
 	unsigned int	usage;
 	unsigned int	read_only;
 };
@@ -113,6 +147,7 @@ static void mmc_blk_put(struct mmc_blk_data *md)
 		__clear_bit(devidx, dev_use);
 
 		put_disk(md->disk);
+		kfree(md->packed_hdr);
 		kfree(md);
 	}
 	mutex_unlock(&open_lock);
@@ -165,13 +200,6 @@ static const struct block_device_operations mmc_bdops = {
 	.owner			= THIS_MODULE,
 };
 
-struct mmc_blk_request {
-	struct mmc_request	mrq;
-	struct mmc_command	cmd;
-	struct mmc_command	stop;
-	struct mmc_data		data;
-};
-
 static u32 mmc_sd_num_wr_blocks(struct mmc_card *card)
 {
 	int err;
@@ -368,6 +396,192 @@ out:
 	return err ? 0 : 1;
 }
 
+/* Start address of @req as sent to the card */
+static inline u32 mmc_blk_rq_arg(struct mmc_card *card, struct request *req)
+{
+	u32 arg = blk_rq_pos(req);
+
+	if (!mmc_card_blockaddr(card))
+		arg <<= 9;
+	return arg;
+}
+
+/*
+ * On eMMC boot boards the radio partitions must never be written from
+ * here.  @arg is the start address as sent with the write command.
+ */
+static int mmc_blk_radio_wr(struct mmc_card *card, u32 arg)
+{
+#if defined(CONFIG_ARCH_MSM7X30)
+	if (board_emmc_boot() && mmc_card_mmc(card)) {
+		/* should not write any value before 131073 */
+		if (arg < 131073)
+			return 1;
+#if defined(CONFIG_ARCH_MSM7230)
+		if ((arg > 143361) && (arg < 163328))
+			return 1;
+#endif
+	}
+#endif
+	return 0;
+}
+
+/*
+ * Build the MMC request for (the head of) a block request.  The sg list
+ * must already hold the mapped request.
+ */
+static int mmc_blk_rw_rq_prep(struct mmc_blk_request *brq,
+			      struct mmc_card *card, struct request *req,
+			      struct scatterlist *sgl, unsigned int sg_len,
+			      int disable_multi)
+{
+	u32 readcmd, writecmd;
+
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
+
+	brq->cmd.arg = blk_rq_pos(req);
+	if (!mmc_card_blockaddr(card))
+		brq->cmd.arg <<= 9;
+	brq->cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+	brq->data.blksz = 512;
+	brq->stop.opcode = MMC_STOP_TRANSMISSION;
+	brq->stop.arg = 0;
+	brq->stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
+	brq->data.blocks = blk_rq_sectors(req);
+
+	/*
+	 * The block layer doesn't support all sector count
+	 * restrictions, so we need to be prepared for too big
+	 * requests.
+	 */
+	if (brq->data.blocks > card->host->max_blk_count)
+		brq->data.blocks = card->host->max_blk_count;
+
+	/*
+	 * After a read error, we redo the request one sector at a time
+	 * in order to accurately determine which sectors can be read
+	 * successfully.
+	 */
+	if (disable_multi && brq->data.blocks > 1)
+		brq->data.blocks = 1;
+
+	if (brq->data.blocks > 1) {
+		/* SPI multiblock writes terminate using a special
+		 * token, not a STOP_TRANSMISSION request.
+		 */
+		if (!mmc_host_is_spi(card->host)
+				|| rq_data_dir(req) == READ)
+			brq->mrq.stop = &brq->stop;
+		readcmd = MMC_READ_MULTIPLE_BLOCK;
+		writecmd = MMC_WRITE_MULTIPLE_BLOCK;
+	} else {
+		brq->mrq.stop = NULL;
+		readcmd = MMC_READ_SINGLE_BLOCK;
+		writecmd = MMC_WRITE_BLOCK;
+	}
+	if (rq_data_dir(req) == READ) {
+		brq->cmd.opcode = readcmd;
+		brq->data.flags |= MMC_DATA_READ;
+	} else {
+		brq->cmd.opcode = writecmd;
+		brq->data.flags |= MMC_DATA_WRITE;
+
+		if (mmc_blk_radio_wr(card, brq->cmd.arg)) {
+			pr_err("%s: pid %d(tgid %d)(%s)\n", __func__,
+				(unsigned)(current->pid), (unsigned)(current->tgid),
+				current->comm);
+			pr_err("ERROR! Attemp to write radio partition start %d size %d\n"
+				, brq->cmd.arg, blk_rq_sectors(req));
+			BUG();
+
+			return -EPERM;
+		}
+	}
+
+	mmc_set_data_timeout(&brq->data, card);
+
+	brq->data.sg = sgl;
+	brq->data.sg_len = sg_len;
+
+	/*
+	 * Adjust the sg list so it is the same size as the
+	 * request.
+	 */
+	if (brq->data.blocks != blk_rq_sectors(req)) {
+		int i, data_size = brq->data.blocks << 9;
+		struct scatterlist *sg;
+
+		for_each_sg(brq->data.sg, sg, brq->data.sg_len, i) {
+			data_size -= sg->length;
+			if (data_size <= 0) {
+				sg->length += data_size;
+				i++;
+				break;
+			}
+		}
+		brq->data.sg_len = i;
+	}
+
+	return 0;
+}
+
+/*
+ * Take over the request that mmc_blk_prep_next() built while the
+ * previous request was being transferred.
+ */
+static void mmc_blk_take_prepared(struct mmc_blk_data *md,
+				  struct mmc_blk_request *brq)
+{
+	*brq = md->next_brq;
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
+	if (brq->mrq.stop)
+		brq->mrq.stop = &brq->stop;
+	md->next_prepared = NULL;
+}
+
+/*
+ * Undo mmc_blk_prep_next() for a request that fails before it is issued.
+ */
+static void mmc_blk_drop_prepared(struct mmc_blk_data *md,
+				  struct request *req)
+{
+	if (md->next_prepared != req)
+		return;
+	mmc_post_req(md->queue.card->host, &md->next_brq.mrq, -EIO);
+	md->next_prepared = NULL;
+}
+
+/*
+ * Fetch the next read/write request and let the host do its DMA mapping
+ * and cache maintenance now, while the current request is on the bus.
+ * Called with the host claimed.
+ */
+static void mmc_blk_prep_next(struct mmc_queue *mq)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct request *next;
+	unsigned int sg_len;
+
+	if (md->next_prepared)
+		return;
+
+	next = mmc_queue_fetch_next(mq);
+	if (!next)
+		return;
+
+	sg_len = mmc_queue_map_next_sg(mq);
+	if (mmc_blk_rw_rq_prep(&md->next_brq, card, next, mq->next_sg,
+			       sg_len, 0))
+		return;
+
+	mmc_pre_req(card->host, &md->next_brq.mrq, false);
+	md->next_prepared = next;
+}
+
 static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 {
 	struct mmc_blk_data *md = mq->data;
@@ -384,6 +598,7 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 		if (err) {
 			if (mmc_card_sd(card))
 				remove_card(card->host);
+			mmc_blk_drop_prepared(md, req);
 			spin_lock_irq(&md->lock);
 			__blk_end_request_all(req, -EIO);
 			spin_unlock_irq(&md->lock);
@@ -434,6 +649,7 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 
 	if (mmc_bus_fails_resume(card->host) || card_no_ready ||
 		!retries) {
+		mmc_blk_drop_prepared(md, req);
 		spin_lock_irq(&md->lock);
 		__blk_end_request_all(req, -EIO);
 		spin_unlock_irq(&md->lock);
@@ -446,117 +662,23 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 
 	do {
 		struct mmc_command cmd;
-		u32 readcmd, writecmd, status = 0;
-
-		memset(&brq, 0, sizeof(struct mmc_blk_request));
-		brq.mrq.cmd = &brq.cmd;
-		brq.mrq.data = &brq.data;
-
-		brq.cmd.arg = blk_rq_pos(req);
-		if (!mmc_card_blockaddr(card))
-			brq.cmd.arg <<= 9;
-		brq.cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
-		brq.data.blksz = 512;
-		brq.stop.opcode = MMC_STOP_TRANSMISSION;
-		brq.stop.arg = 0;
-		brq.stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
-		brq.data.blocks = blk_rq_sectors(req);
-
-		/*
-		 * The block layer doesn't support all sector count
-		 * restrictions, so we need to be prepared for too big
-		 * requests.
-		 */
-		if (brq.data.blocks > card->host->max_blk_count)
-			brq.data.blocks = card->host->max_blk_count;
-
-		/*
-		 * After a read error, we redo the request one sector at a time
-		 * in order to accurately determine which sectors can be read
-		 * successfully.
-		 */
-		if (disable_multi && brq.data.blocks > 1)
-			brq.data.blocks = 1;
-
-		if (brq.data.blocks > 1) {
-			/* SPI multiblock writes terminate using a special
-			 * token, not a STOP_TRANSMISSION request.
-			 */
-			if (!mmc_host_is_spi(card->host)
-					|| rq_data_dir(req) == READ)
-				brq.mrq.stop = &brq.stop;
-			readcmd = MMC_READ_MULTIPLE_BLOCK;
-			writecmd = MMC_WRITE_MULTIPLE_BLOCK;
-		} else {
-			brq.mrq.stop = NULL;
-			readcmd = MMC_READ_SINGLE_BLOCK;
-			writecmd = MMC_WRITE_BLOCK;
-		}
-		if (rq_data_dir(req) == READ) {
-			brq.cmd.opcode = readcmd;
-			brq.data.flags |= MMC_DATA_READ;
-		} else {
-			brq.cmd.opcode = writecmd;
-			brq.data.flags |= MMC_DATA_WRITE;
-
-#if defined(CONFIG_ARCH_MSM7X30)
-		if (board_emmc_boot())
-			if (mmc_card_mmc(card)) {
-				if (brq.cmd.arg < 131073) {/* should not write any value before 131073 */
-					pr_err("%s: pid %d(tgid %d)(%s)\n", __func__,
-						(unsigned)(current->pid), (unsigned)(current->tgid),
-						current->comm);
-					pr_err("ERROR! Attemp to write radio partition start %d size %d\n"
-						, brq.cmd.arg, blk_rq_sectors(req));
-					BUG();
-
-					return 0;
-				}
-#if defined(CONFIG_ARCH_MSM7230)
-				if ((brq.cmd.arg > 143361) && (brq.cmd.arg < 163328)) {
-
-					pr_err("%s: pid %d(tgid %d)(%s)\n", __func__,
-						(unsigned)(current->pid), (unsigned)(current->tgid),
-						current->comm);
-					pr_err("ERROR! Attemp to write radio partition start %d size %d\n"
-						, brq.cmd.arg, blk_rq_sectors(req));
-					BUG();
-
-
-					return 0;
-				}
-#endif
-			}
-#endif
-		}
-
-		mmc_set_data_timeout(&brq.data, card);
-
-		brq.data.sg = mq->sg;
-		brq.data.sg_len = mmc_queue_map_sg(mq);
-
-		/*
-		 * Adjust the sg list so it is the same size as the
-		 * request.
-		 */
-		if (brq.data.blocks != blk_rq_sectors(req)) {
-			int i, data_size = brq.data.blocks << 9;
-			struct scatterlist *sg;
-
-			for_each_sg(brq.data.sg, sg, brq.data.sg_len, i) {
-				data_size -= sg->length;
-				if (data_size <= 0) {
-					sg->length += data_size;
-					i++;
-					break;
-				}
-			}
-			brq.data.sg_len = i;
+		struct completion complete;
+		u32 status = 0;
+
+		if (md->next_prepared == req) {
+			mmc_blk_take_prepared(md, &brq);
+		} else if (mmc_blk_rw_rq_prep(&brq, card, req, mq->sg,
+					      mmc_queue_map_sg(mq),
+					      disable_multi)) {
+			return 0;
 		}
 
 		mmc_queue_bounce_pre(mq);
 
-		mmc_wait_for_req(card->host, &brq.mrq);
+		mmc_start_req(card->host, &brq.mrq, &complete);
+		mmc_blk_prep_next(mq);
+		mmc_wait_for_req_done(&brq.mrq);
+		mmc_post_req(card->host, &brq.mrq, 0);
 
 		mmc_queue_bounce_post(mq);
 
@@ -769,14 +891,305 @@ recovery:
 	return 0;
 }
 
+static inline int mmc_blk_packed_wr_enabled(struct mmc_blk_data *md)
+{
+	return md->packed_hdr && md->queue.card->ext_csd.packed_event_en;
+}
+
+/*
+ * Pull further write requests off the queue, to go out in one packed
+ * command together with @req.  Returns the number of requests on
+ * md->packed_list, or 0 (with the list empty) if there is nothing to
+ * pack @req with.
+ */
+static unsigned int mmc_blk_prep_packed_list(struct mmc_queue *mq,
+					     struct request *req)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct request_queue *q = mq->queue;
+	struct request *next;
+	unsigned int max_nr, max_blocks, max_segs;
+	unsigned int nr = 1, blocks, segs;
+
+	/* The prefetched request must go next, don't reorder around it */
+	if (mq->next_req)
+		return 0;
+
+#ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
+	/* Resume and its card checks happen on the unpacked path */
+	if (mmc_bus_needs_resume(card->host) ||
+	    mmc_bus_fails_resume(card->host))
+		return 0;
+#endif
+
+	/* Writes near the radio partitions take the guarded path */
+	if (mmc_blk_radio_wr(card, mmc_blk_rq_arg(card, req)))
+		return 0;
+
+	/* One block and one segment go to the header */
+	max_nr = min_t(unsigned int, card->ext_csd.max_packed_writes,
+		       MMC_BLK_PACKED_MAX_REQS);
+	max_blocks = card->host->max_blk_count - 1;
+	max_segs = card->host->max_segs - 1;
+
+	blocks = blk_rq_sectors(req);
+	segs = req->nr_phys_segments;
+	if (blocks > max_blocks || segs > max_segs)
+		return 0;
+
+	INIT_LIST_HEAD(&md->packed_list);
+	list_add_tail(&req->queuelist, &md->packed_list);
+
+	spin_lock_irq(q->queue_lock);
+	while (nr < max_nr && !blk_queue_stopped(q)) {
+		next = blk_peek_request(q);
+		if (!next || rq_data_dir(next) != WRITE ||
+		    (next->cmd_flags & (REQ_DISCARD | REQ_HARDBARRIER)))
+			break;
+		if (blocks + blk_rq_sectors(next) > max_blocks ||
+		    segs + next->nr_phys_segments > max_segs)
+			break;
+		if (mmc_blk_radio_wr(card, mmc_blk_rq_arg(card, next)))
+			break;
+
+		blk_start_request(next);
+		list_add_tail(&next->queuelist, &md->packed_list);
+		blocks += blk_rq_sectors(next);
+		segs += next->nr_phys_segments;
+		nr++;
+	}
+	spin_unlock_irq(q->queue_lock);
+
+	if (nr == 1) {
+		list_del_init(&req->queuelist);
+		return 0;
+	}
+	return nr;
+}
+
+/*
+ * Poll the card until it has left the programming state, returning its
+ * last status in @status.
+ */
+static int mmc_blk_wait_ready(struct mmc_card *card, u32 *status)
+{
+	struct mmc_command cmd;
+	unsigned long timeout = jiffies + 10 * HZ;
+	int err;
+
+	do {
+		memset(&cmd, 0, sizeof(struct mmc_command));
+		cmd.opcode = MMC_SEND_STATUS;
+		cmd.arg = card->rca << 16;
+		cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
+		err = mmc_wait_for_cmd(card->host, &cmd, 5);
+		if (err)
+			return err;
+		*status = cmd.resp[0];
+		if (time_after(jiffies, timeout))
+			return -ETIMEDOUT;
+	} while (!(cmd.resp[0] & R1_READY_FOR_DATA) ||
+		 (R1_CURRENT_STATE(cmd.resp[0]) == 7));
+
+	return 0;
+}
+
+/*
+ * After a failed packed write, ask the card which request it failed
+ * on.  Returns the 1-based index in the packed header, or 0 if the card
+ * could not tell, in which case nothing is known to have been written.
+ */
+static unsigned int mmc_blk_packed_fail_index(struct mmc_card *card)
+{
+	unsigned int idx = 0;
+	u8 *ext_csd;
+
+	ext_csd = kmalloc(512, GFP_KERNEL);
+	if (!ext_csd)
+		return 0;
+
+	if (!mmc_send_ext_csd(card, ext_csd) &&
+	    (ext_csd[EXT_CSD_EXP_EVENTS_STATUS] & EXT_CSD_PACKED_FAILURE) &&
+	    (ext_csd[EXT_CSD_PACKED_CMD_STATUS] &
+	     EXT_CSD_PACKED_INDEXED_ERROR))
+		idx = ext_csd[EXT_CSD_PACKED_FAILURE_INDEX];
+
+	kfree(ext_csd);
+	return idx;
+}
+
+/*
+ * Send the requests on md->packed_list as one packed write: CMD23 with
+ * the packed flag, then a single CMD25 carrying the header block followed
+ * by the data of every request.  Requests marked FUA or META are written
+ * reliably if the card supports enhanced reliable write.  On failure the
+ * requests the card reports as written are completed, and the rest are
+ * sent again one by one through mmc_blk_issue_rw_rq().
+ */
+static int mmc_blk_issue_packed_wr(struct mmc_queue *mq, struct request *req,
+				   unsigned int nr)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_blk_request brq;
+	struct mmc_command cmd;
+	struct completion complete;
+	struct request *prq, *tmp;
+	u32 *hdr = md->packed_hdr;
+	unsigned int i, sg_len, blocks = 0, done = nr;
+	int rel_wr = card->ext_csd.rel_param & EXT_CSD_WR_REL_PARAM_EN;
+	u32 status = 0;
+	int err, ret = 1;
+
+	mmc_blk_drop_prepared(md, req);
+
+	memset(hdr, 0, MMC_BLK_PACKED_HDR_SZ);
+	hdr[0] = (nr << 16) | (MMC_PACKED_CMD_WR << 8) | MMC_PACKED_CMD_VER;
+
+	sg_init_table(mq->sg, card->host->max_segs);
+	sg_set_buf(&mq->sg[0], hdr, MMC_BLK_PACKED_HDR_SZ);
+	sg_len = 1;
+
+	i = 1;
+	list_for_each_entry(prq, &md->packed_list, queuelist) {
+		hdr[i * 2] = blk_rq_sectors(prq);
+		if (rel_wr && (prq->cmd_flags & (REQ_FUA | REQ_META))) {
+			hdr[i * 2] |= MMC_CMD23_ARG_REL_WR;
+			md->packed_stats.rel_wr++;
+		}
+		hdr[i * 2 + 1] = mmc_blk_rq_arg(card, prq);
+
+		blocks += blk_rq_sectors(prq);
+		sg_unmark_end(&mq->sg[sg_len - 1]);
+		sg_len += blk_rq_map_sg(mq->queue, prq, &mq->sg[sg_len]);
+		i++;
+	}
+
+	memset(&brq, 0, sizeof(struct mmc_blk_request));
+	brq.mrq.cmd = &brq.cmd;
+	brq.mrq.data = &brq.data;
+
+	brq.cmd.opcode = MMC_WRITE_MULTIPLE_BLOCK;
+	brq.cmd.arg = mmc_blk_rq_arg(card, req);
+	brq.cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+	brq.data.blksz = 512;
+	brq.data.blocks = blocks + 1;
+	brq.data.flags = MMC_DATA_WRITE;
+	brq.data.sg = mq->sg;
+	brq.data.sg_len = sg_len;
+	mmc_set_data_timeout(&brq.data, card);
+
+	memset(&cmd, 0, sizeof(struct mmc_command));
+	cmd.opcode = MMC_SET_BLOCK_COUNT;
+	cmd.arg = (blocks + 1) | MMC_CMD23_ARG_PACKED;
+	cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_AC;
+
+	mmc_claim_host(card->host);
+
+	md->packed_stats.packed_cmds++;
+	md->packed_stats.packed_reqs += nr;
+
+	err = mmc_wait_for_cmd(card->host, &cmd, 0);
+	if (!err) {
+		mmc_start_req(card->host, &brq.mrq, &complete);
+		mmc_blk_prep_next(mq);
+		mmc_wait_for_req_done(&brq.mrq);
+		mmc_post_req(card->host, &brq.mrq, 0);
+
+		err = mmc_blk_wait_ready(card, &status);
+		if (!err && (brq.cmd.error || brq.data.error ||
+			     (status & (R1_EXP_EVENT | R1_ERROR))))
+			err = -EIO;
+	}
+
+	if (err) {
+		printk(KERN_WARNING "%s: packed write of %u requests failed "
+		       "(%d, cmd %d, data %d, status %#x), retrying unpacked\n",
+		       req->rq_disk->disk_name, nr, err, brq.cmd.error,
+		       brq.data.error, status);
+		md->packed_stats.fallbacks++;
+		done = mmc_blk_packed_fail_index(card);
+		if (done)
+			done--;
+	}
+
+	mmc_release_host(card->host);
+
+	i = 0;
+	list_for_each_entry_safe(prq, tmp, &md->packed_list, queuelist) {
+		list_del_init(&prq->queuelist);
+		if (i++ < done) {
+			spin_lock_irq(&md->lock);
+			__blk_end_request_all(prq, 0);
+			spin_unlock_irq(&md->lock);
+		} else {
+			mq->req = prq;
+			if (!mmc_blk_issue_rw_rq(mq, prq))
+				ret = 0;
+		}
+	}
+	mq->req = req;
+
+	return ret;
+}
+
+static int mmc_blk_packed_stats_show(struct seq_file *s, void *data)
+{
+	struct mmc_blk_data *md = s->private;
+	struct mmc_blk_packed_stats *st = &md->packed_stats;
+
+	seq_printf(s, "packed_cmds: %lu\n", st->packed_cmds);
+	seq_printf(s, "packed_reqs: %lu\n", st->packed_reqs);
+	seq_printf(s, "single_writes: %lu\n", st->single_wr);
+	seq_printf(s, "reliable_writes: %lu\n", st->rel_wr);
+	seq_printf(s, "fallbacks: %lu\n", st->fallbacks);
+	return 0;
+}
+
+static int mmc_blk_packed_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_blk_packed_stats_show, inode->i_private);
+}
+
+static ssize_t mmc_blk_packed_stats_write(struct file *file,
+		const char __user *ubuf, size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct mmc_blk_data *md = s->private;
+
+	/* Any write resets the counters */
+	memset(&md->packed_stats, 0, sizeof(md->packed_stats));
+	return count;
+}
+
+static const struct file_operations mmc_blk_packed_stats_fops = {
+	.open		= mmc_blk_packed_stats_open,
+	.read		= seq_read,
+	.write		= mmc_blk_packed_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 {
+	struct mmc_blk_data *md = mq->data;
+
 	if (req->cmd_flags & REQ_DISCARD) {
 		if (req->cmd_flags & REQ_SECURE)
 			return mmc_blk_issue_secdiscard_rq(mq, req);
 		else
 			return mmc_blk_issue_discard_rq(mq, req);
 	} else {
+		if (rq_data_dir(req) == WRITE) {
+			unsigned int nr = 0;
+
+			if (mmc_blk_packed_wr_enabled(md))
+				nr = mmc_blk_prep_packed_list(mq, req);
+			if (nr)
+				return mmc_blk_issue_packed_wr(mq, req, nr);
+			md->packed_stats.single_wr++;
+		}
 		return mmc_blk_issue_rw_rq(mq, req);
 	}
 }
@@ -901,6 +1314,16 @@ static int mmc_blk_probe(struct mmc_card *card)
 		md->disk->disk_name, mmc_card_id(card), mmc_card_name(card),
 		cap_str, md->read_only ? "(ro)" : "");
 
+	if (card->ext_csd.max_packed_writes &&
+	    (card->host->caps & MMC_CAP_PACKED_WR) &&
+	    card->host->max_segs > 1) {
+		md->packed_hdr = kmalloc(MMC_BLK_PACKED_HDR_SZ, GFP_KERNEL);
+		if (md->packed_hdr && card->debugfs_root)
+			md->packed_dentry = debugfs_create_file("packed_stats",
+					S_IRUSR | S_IWUSR, card->debugfs_root,
+					md, &mmc_blk_packed_stats_fops);
+	}
+
 	mmc_set_drvdata(card, md);
 	mmc_init_bus_resume_flags(card->host);
 #ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
@@ -961,6 +1384,9 @@ static void mmc_blk_remove(struct mmc_card *card)
 	struct mmc_blk_data *md = mmc_get_drvdata(card);
 
 	if (md) {
+		debugfs_remove(md->packed_dentry);
+		md->packed_dentry = NULL;
+
 		/* Stop new requests from getting into the queue */
 		if (mmc_card_sd(card))
 			del_gendisk_async(md->disk);
@@ -28,6 +28,9 @@
 
 #define MMC_QUEUE_SUSPENDED	(1 << 0)
 
+/* Idle time before deferred discards are sent to the card */
+#define MMC_QUEUE_DISCARD_IDLE_MS	500
+
 /*
  * Prepare a MMC request. This just filters out odd stuff.
  */
@@ -60,7 +63,15 @@ static int mmc_queue_thread(void *d)
 
 		spin_lock_irq(q->queue_lock);
 		set_current_state(TASK_INTERRUPTIBLE);
-		if (!blk_queue_plugged(q))
+		if (mq->next_req) {
+			/*
+			 * Already fetched (and possibly mapped by the host)
+			 * while the previous request was being transferred.
+			 */
+			req = mq->next_req;
+			mq->next_req = NULL;
+			swap(mq->sg, mq->next_sg);
+		} else if (!blk_queue_plugged(q))
 			req = blk_fetch_request(q);
 		mq->req = req;
 		spin_unlock_irq(q->queue_lock);
@@ -171,9 +182,12 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card, spinlock_t *lock
 
 	mq->queue->queuedata = mq;
 	mq->req = NULL;
+	mq->next_req = NULL;
 
 	blk_queue_prep_rq(mq->queue, mmc_prep_request);
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, mq->queue);
+	if (card->pref_erase)
+		blk_queue_io_opt(mq->queue, card->pref_erase << 9);
 	if (mmc_can_erase(card)) {
 		queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, mq->queue);
 		mq->queue->limits.max_discard_sectors = UINT_MAX;
@@ -188,6 +202,13 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card, spinlock_t *lock
 		if (mmc_can_secure_erase_trim(card))
 			queue_flag_set_unlocked(QUEUE_FLAG_SECDISCARD,
 						mq->queue);
+		/*
+		 * Erases keep the card busy for a long time, keep them out
+		 * of the way of real I/O.  The discard path only looks at
+		 * the request's position and size, so it copes with the
+		 * bio-less requests the block layer issues them with.
+		 */
+		blk_queue_discard_defer(mq->queue, MMC_QUEUE_DISCARD_IDLE_MS);
 	}
 
 #ifdef CONFIG_MMC_BLOCK_BOUNCE
@@ -251,6 +272,21 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card, spinlock_t *lock
 			goto cleanup_queue;
 		}
 		sg_init_table(mq->sg, host->max_segs);
+
+		/*
+		 * A second sg list lets the next request be mapped while
+		 * the current one is on the bus.  Bounced queues serialise
+		 * on the bounce buffer, so they don't get one.
+		 */
+		if (host->ops->pre_req) {
+			mq->next_sg = kmalloc(sizeof(struct scatterlist) *
+				host->max_segs, GFP_KERNEL);
+			if (!mq->next_sg) {
+				ret = -ENOMEM;
+				goto cleanup_queue;
+			}
+			sg_init_table(mq->next_sg, host->max_segs);
+		}
 	}
 
 	sema_init(&mq->thread_sem, 1);
@@ -281,6 +317,8 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card, spinlock_t *lock
  	if (mq->sg)
 		kfree(mq->sg);
 	mq->sg = NULL;
+	kfree(mq->next_sg);
+	mq->next_sg = NULL;
 	if (mq->bounce_buf)
 		kfree(mq->bounce_buf);
 	mq->bounce_buf = NULL;
@@ -312,6 +350,9 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
 	kfree(mq->sg);
 	mq->sg = NULL;
 
+	kfree(mq->next_sg);
+	mq->next_sg = NULL;
+
 	if (mq->bounce_buf)
 		kfree(mq->bounce_buf);
 	mq->bounce_buf = NULL;
@@ -392,6 +433,42 @@ unsigned int mmc_queue_map_sg(struct mmc_queue *mq)
 	return 1;
 }
 
+/*
+ * Fetch the next read/write request while the current one is still in
+ * progress, so that it can be prepared ahead of time.  Returns NULL if
+ * the queue is not set up for that, or there is nothing suitable to
+ * fetch.  The request is handed to the queue thread through next_req.
+ */
+struct request *mmc_queue_fetch_next(struct mmc_queue *mq)
+{
+	struct request_queue *q = mq->queue;
+	struct request *req = NULL;
+
+	if (!mq->next_sg || mq->next_req)
+		return NULL;
+
+	spin_lock_irq(q->queue_lock);
+	if (!blk_queue_plugged(q) && !blk_queue_stopped(q)) {
+		req = blk_peek_request(q);
+		if (req && (req->cmd_flags & REQ_DISCARD))
+			req = NULL;
+		if (req)
+			blk_start_request(req);
+	}
+	mq->next_req = req;
+	spin_unlock_irq(q->queue_lock);
+
+	return req;
+}
+
+/*
+ * Map the request fetched by mmc_queue_fetch_next() into the spare sg list
+ */
+unsigned int mmc_queue_map_next_sg(struct mmc_queue *mq)
+{
+	return blk_rq_map_sg(mq->queue, mq->next_req, mq->next_sg);
+}
+
 /*
  * If writing, bounce the data to the buffer before the request
  * is sent to the host driver
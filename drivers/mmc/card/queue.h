@@ -10,10 +10,12 @@ struct mmc_queue {
 	struct semaphore	thread_sem;
 	unsigned int		flags;
 	struct request		*req;
+	struct request		*next_req;	/* fetched while req is active */
 	int			(*issue_fn)(struct mmc_queue *, struct request *);
 	void			*data;
 	struct request_queue	*queue;
 	struct scatterlist	*sg;
+	struct scatterlist	*next_sg;
 	char			*bounce_buf;
 	struct scatterlist	*bounce_sg;
 	unsigned int		bounce_sg_len;
@@ -28,6 +30,8 @@ extern void mmc_queue_suspend(struct mmc_queue *);
 extern void mmc_queue_resume(struct mmc_queue *);
 
 extern unsigned int mmc_queue_map_sg(struct mmc_queue *);
+extern struct request *mmc_queue_fetch_next(struct mmc_queue *);
+extern unsigned int mmc_queue_map_next_sg(struct mmc_queue *);
 extern void mmc_queue_bounce_pre(struct mmc_queue *);
 extern void mmc_queue_bounce_post(struct mmc_queue *);
 
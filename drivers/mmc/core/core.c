@@ -261,6 +261,68 @@ void mmc_wait_for_req(struct mmc_host *host, struct mmc_request *mrq)
 
 EXPORT_SYMBOL(mmc_wait_for_req);
 
+/**
+ *	mmc_start_req - start a request without waiting for it
+ *	@host: MMC host to start the request on
+ *	@mrq: MMC request to start
+ *	@done: completion signalled when the request has finished
+ *
+ *	Start a request and return immediately, so that the caller can
+ *	prepare the next request while this one is on the bus.  The caller
+ *	must then wait with mmc_wait_for_req_done().
+ */
+void mmc_start_req(struct mmc_host *host, struct mmc_request *mrq,
+		   struct completion *done)
+{
+	init_completion(done);
+	mrq->done_data = done;
+	mrq->done = mmc_wait_done;
+
+	mmc_start_request(host, mrq);
+}
+EXPORT_SYMBOL(mmc_start_req);
+
+/**
+ *	mmc_wait_for_req_done - wait for a request started by mmc_start_req
+ *	@mrq: MMC request to wait for
+ */
+void mmc_wait_for_req_done(struct mmc_request *mrq)
+{
+	wait_for_completion_io(mrq->done_data);
+}
+EXPORT_SYMBOL(mmc_wait_for_req_done);
+
+/**
+ *	mmc_pre_req - prepare a request before it is started
+ *	@host: MMC host to prepare the request for
+ *	@mrq: MMC request to prepare
+ *	@is_first_req: true if no other request is in flight on @host
+ *
+ *	Let the host driver do the costly per-request setup, such as DMA
+ *	mapping and cache maintenance, ahead of time.  Typically called
+ *	while the previous request is still being transferred.
+ */
+void mmc_pre_req(struct mmc_host *host, struct mmc_request *mrq,
+		 bool is_first_req)
+{
+	if (host->ops->pre_req)
+		host->ops->pre_req(host, mrq, is_first_req);
+}
+EXPORT_SYMBOL(mmc_pre_req);
+
+/**
+ *	mmc_post_req - undo what mmc_pre_req did
+ *	@host: MMC host the request was prepared for
+ *	@mrq: MMC request that has completed or is being dropped
+ *	@err: 0 if the request completed, an error if it was never started
+ */
+void mmc_post_req(struct mmc_host *host, struct mmc_request *mrq, int err)
+{
+	if (host->ops->post_req)
+		host->ops->post_req(host, mrq, err);
+}
+EXPORT_SYMBOL(mmc_post_req);
+
 /**
  *	mmc_wait_for_cmd - start a command and wait for completion
  *	@host: MMC host to start command
@@ -37,6 +37,10 @@
 #include <linux/debugfs.h>
 #include <linux/io.h>
 #include <linux/memory.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
+#include <linux/seq_file.h>
 
 #include <asm/cacheflush.h>
 #include <asm/div64.h>
@@ -51,12 +55,14 @@
 
 #include "msm_sdcc.h"
 
+#define CREATE_TRACE_POINTS
+#include "msm_sdcc_trace.h"
+
 #define DRIVER_NAME "msm-sdcc"
 
 #define IRQ_DEBUG 0
 
 #define BUSCLK_PWRSAVE 1
-#define BUSCLK_TIMEOUT (HZ)
 #define SQN_BUSCLK_TIMEOUT (5 * HZ)
 
 static unsigned int msmsdcc_fmin = 144000;
@@ -67,6 +73,35 @@ static unsigned int msmsdcc_piopoll = 1;
 static unsigned int msmsdcc_sdioirq = 1;
 static unsigned long msmsdcc_irqtime;
 
+/* Bounds for the adaptive bus clock idle timeout, min <= max */
+static unsigned int msmsdcc_busclk_min_ms = 10;
+static unsigned int msmsdcc_busclk_max_ms = 1000;
+
+static int msmsdcc_set_busclk_min(const char *val, struct kernel_param *kp)
+{
+	unsigned long ms;
+
+	if (strict_strtoul(val, 0, &ms) || ms > msmsdcc_busclk_max_ms)
+		return -EINVAL;
+	msmsdcc_busclk_min_ms = ms;
+	return 0;
+}
+module_param_call(busclk_min_ms, msmsdcc_set_busclk_min, param_get_uint,
+		  &msmsdcc_busclk_min_ms, 0644);
+
+static int msmsdcc_set_busclk_max(const char *val, struct kernel_param *kp)
+{
+	unsigned long ms;
+
+	if (strict_strtoul(val, 0, &ms) || ms > UINT_MAX / USEC_PER_MSEC ||
+	    ms < msmsdcc_busclk_min_ms)
+		return -EINVAL;
+	msmsdcc_busclk_max_ms = ms;
+	return 0;
+}
+module_param_call(busclk_max_ms, msmsdcc_set_busclk_max, param_get_uint,
+		  &msmsdcc_busclk_max_ms, 0644);
+
 #define DUMMY_52_STATE_NONE		0
 #define DUMMY_52_STATE_SENT		1
 
@@ -193,7 +228,7 @@ static int is_wimax_platform(struct mmc_platform_data *plat)
 static inline void
 msmsdcc_disable_clocks(struct msmsdcc_host *host, int deferr)
 {
-	u32 delay = BUSCLK_TIMEOUT;
+	u32 delay = usecs_to_jiffies(host->busclk_timeout_us);
 
 	if (is_svlte_platform(host->plat))
 			return;
@@ -220,6 +255,7 @@ msmsdcc_disable_clocks(struct msmsdcc_host *host, int deferr)
 	}
 
 	if (deferr) {
+		host->t_last_req_end = ktime_get();
 		mod_timer(&host->busclk_timer, jiffies + delay);
 	} else {
 		del_timer_sync(&host->busclk_timer);
@@ -235,6 +271,13 @@ msmsdcc_disable_clocks(struct msmsdcc_host *host, int deferr)
 			clk_disable(host->clk);
 			clk_disable(host->pclk);
 			host->clks_on = 0;
+			host->stats.clk_off++;
+			host->stats.t_clk_off = ktime_get();
+			if (host->t_last_req_end.tv64)
+				host->stats.clk_idle_on_us += ktime_us_delta(
+					host->stats.t_clk_off,
+					host->t_last_req_end);
+			trace_msmsdcc_clk_gate(host->mmc, 0);
 		}
 	}
 }
@@ -250,6 +293,43 @@ msmsdcc_get_sdc_clocks(struct msmsdcc_host *host)
 }
 EXPORT_SYMBOL(msmsdcc_get_sdc_clocks);
 
+/*
+ * Adapt the bus clock idle timeout to the gaps between requests.  Gaps
+ * within a burst are averaged and the clocks are kept on for twice that
+ * average, so that back-to-back requests don't pay the clock enable
+ * latency, while the clocks are still gated soon after a burst ends.
+ * A gap longer than busclk_max_ms is a real idle period: it does not
+ * feed the average, and halves the timeout so that the next idle period
+ * is detected sooner.  Called with host->lock held, before the clocks
+ * are enabled for a new request.
+ */
+static void
+msmsdcc_busclk_update(struct msmsdcc_host *host, ktime_t now)
+{
+	unsigned int min_us = msmsdcc_busclk_min_ms * USEC_PER_MSEC;
+	unsigned int max_us = msmsdcc_busclk_max_ms * USEC_PER_MSEC;
+	unsigned int avg = host->busclk_avg_gap_us;
+	s64 gap;
+
+	if (!host->t_last_req_end.tv64)
+		return;
+
+	gap = ktime_us_delta(now, host->t_last_req_end);
+	if (!host->clks_on && gap < max_us)
+		host->stats.clk_early_gates++;
+
+	if (gap >= max_us) {
+		host->busclk_timeout_us = max(host->busclk_timeout_us / 2,
+					      min_us);
+		return;
+	}
+
+	avg = avg ? avg - (avg >> 3) + ((unsigned int)gap >> 3) :
+		    (unsigned int)gap;
+	host->busclk_avg_gap_us = avg;
+	host->busclk_timeout_us = clamp(2 * avg, min_us, max_us);
+}
+
 static void
 msmsdcc_busclk_expired(unsigned long _data)
 {
@@ -299,6 +379,11 @@ msmsdcc_enable_clocks(struct msmsdcc_host *host)
 		udelay(1 + ((3 * USEC_PER_SEC) /
 		       (host->clk_rate ? host->clk_rate : msmsdcc_fmin)));
 		host->clks_on = 1;
+		host->stats.clk_on++;
+		if (host->stats.t_clk_off.tv64)
+			host->stats.clk_gated_us += ktime_us_delta(ktime_get(),
+						host->stats.t_clk_off);
+		trace_msmsdcc_clk_gate(host->mmc, 1);
 	}
 	return 0;
 }
@@ -369,11 +454,64 @@ static void msmsdcc_reset_and_restore(struct msmsdcc_host *host)
 				mmc_hostname(host->mmc), host->clk_rate, ret);
 }
 
+static inline unsigned int msmsdcc_lat_bucket(s64 us)
+{
+	if (us <= 0)
+		return 0;
+	return min_t(unsigned int, fls64(us), MSMSDCC_LAT_BUCKETS - 1);
+}
+
+/*
+ * Account a finished request.  Requests with data are split into setup
+ * (up to the data transfer being started, including the command for
+ * writes), the transfer and the busy wait after it (stop command and
+ * programming).  Commands without data count entirely as transfer.
+ * Called with host->lock held.
+ */
+static void
+msmsdcc_lat_account(struct msmsdcc_host *host, struct mmc_request *mrq)
+{
+	struct msmsdcc_curr_req *curr = &host->curr;
+#if defined(CONFIG_DEBUG_FS)
+	struct msmsdcc_lat_stats *lat = &host->lat;
+	unsigned int op, i;
+#endif
+	ktime_t now = ktime_get();
+	ktime_t data_end;
+	s64 us[MSMSDCC_LAT_PHASES];
+
+	if (mrq->data && curr->t_data.tv64) {
+		data_end = curr->t_data_end.tv64 ? curr->t_data_end : now;
+		us[MSMSDCC_LAT_SETUP] = ktime_us_delta(curr->t_data,
+						       curr->t_start);
+		us[MSMSDCC_LAT_XFER] = ktime_us_delta(data_end, curr->t_data);
+		us[MSMSDCC_LAT_BUSY] = ktime_us_delta(now, data_end);
+	} else {
+		us[MSMSDCC_LAT_SETUP] = 0;
+		us[MSMSDCC_LAT_XFER] = ktime_us_delta(now, curr->t_start);
+		us[MSMSDCC_LAT_BUSY] = 0;
+	}
+
+	trace_msmsdcc_request_done(host->mmc, mrq, us[MSMSDCC_LAT_SETUP],
+				   us[MSMSDCC_LAT_XFER], us[MSMSDCC_LAT_BUSY]);
+
+#if defined(CONFIG_DEBUG_FS)
+	op = mrq->cmd->opcode & (MSMSDCC_LAT_OPCODES - 1);
+	lat->count[op]++;
+	for (i = 0; i < MSMSDCC_LAT_PHASES; i++) {
+		lat->total_us[op][i] += us[i];
+		lat->hist[op][i][msmsdcc_lat_bucket(us[i])]++;
+	}
+#endif
+}
+
 void
 msmsdcc_request_end(struct msmsdcc_host *host, struct mmc_request *mrq)
 {
 	BUG_ON(host->curr.data);
 
+	msmsdcc_lat_account(host, mrq);
+
 	host->curr.mrq = NULL;
 	host->curr.cmd = NULL;
 
@@ -398,6 +536,8 @@ EXPORT_SYMBOL(msmsdcc_request_end);
 void
 msmsdcc_stop_data(struct msmsdcc_host *host)
 {
+	if (host->curr.data)
+		host->curr.t_data_end = ktime_get();
 	host->curr.data = NULL;
 	host->curr.got_dataend = 0;
 }
@@ -476,8 +616,10 @@ msmsdcc_dma_complete_tlet(unsigned long data)
 		if (!mrq->data->error)
 			mrq->data->error = -EIO;
 	}
-	dma_unmap_sg(mmc_dev(host->mmc), host->dma.sg, host->dma.num_ents,
-		     host->dma.dir);
+	/* Prepared requests are unmapped by msmsdcc_post_req() */
+	if (!mrq->data->host_cookie)
+		dma_unmap_sg(mmc_dev(host->mmc), host->dma.sg,
+			     host->dma.num_ents, host->dma.dir);
 
 	if (host->curr.user_pages) {
 		struct scatterlist *sg = host->dma.sg;
@@ -507,6 +649,7 @@ msmsdcc_dma_complete_tlet(unsigned long data)
 		if (!mrq->data->error)
 			host->curr.data_xfered = host->curr.xfer_size;
 		if (!mrq->data->stop || mrq->cmd->error) {
+			msmsdcc_lat_account(host, mrq);
 			host->curr.mrq = NULL;
 			host->curr.cmd = NULL;
 			mrq->data->bytes_xfered = host->curr.data_xfered;
@@ -542,6 +685,18 @@ msmsdcc_dma_complete_func(struct msm_dmov_cmd *cmd,
 	tasklet_schedule(&host->dma_tlet);
 }
 
+static inline enum dma_data_direction msmsdcc_data_dir(struct mmc_data *data)
+{
+	return (data->flags & MMC_DATA_READ) ? DMA_FROM_DEVICE : DMA_TO_DEVICE;
+}
+
+static void msmsdcc_unmap_data(struct msmsdcc_host *host,
+			       struct mmc_data *data)
+{
+	dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
+		     msmsdcc_data_dir(data));
+}
+
 static int validate_dma(struct msmsdcc_host *host, struct mmc_data *data)
 {
 	if (host->dma.channel == -1)
@@ -590,6 +745,11 @@ static int msmsdcc_config_dma(struct msmsdcc_host *host, struct mmc_data *data)
 	else {
 		host->dma.sg = NULL;
 		host->dma.num_ents = 0;
+		/* Falling back to PIO: don't leave the buffer mapped */
+		if (data->host_cookie) {
+			msmsdcc_unmap_data(host, data);
+			data->host_cookie = 0;
+		}
 		return -ENOENT;
 	}
 
@@ -648,6 +808,16 @@ static int msmsdcc_config_dma(struct msmsdcc_host *host, struct mmc_data *data)
 	host->dma.hdr.complete_func = msmsdcc_dma_complete_func;
 	host->dma.hdr.crci_mask = msm_dmov_build_crci_mask(1, crci);
 
+	/*
+	 * Already mapped by msmsdcc_pre_req().  There is no dma_map_sg()
+	 * below to write nc out to memory then, so do it here before the
+	 * data mover is started on it.
+	 */
+	if (data->host_cookie) {
+		dsb();
+		return 0;
+	}
+
 	n = dma_map_sg(mmc_dev(host->mmc), host->dma.sg,
 			host->dma.num_ents, host->dma.dir);
 	/* dsb inside dma_map_sg will write nc out to mem as well */
@@ -783,6 +953,7 @@ msmsdcc_start_data(struct msmsdcc_host *host, struct mmc_data *data,
 			msmsdcc_start_command(host, cmd, c);
 		}
 	}
+	host->curr.t_data = ktime_get();
 }
 
 static void
@@ -1306,8 +1477,24 @@ msmsdcc_request(struct mmc_host *mmc, struct mmc_request *mrq)
 		return;
 	}
 
-	if (!is_svlte_platform(host->plat))
-		msmsdcc_enable_clocks(host);
+	trace_msmsdcc_request_start(mmc, mrq);
+	host->curr.t_start = ktime_get();
+	host->curr.t_data = ktime_set(0, 0);
+	host->curr.t_data_end = ktime_set(0, 0);
+
+	if (!is_svlte_platform(host->plat)) {
+#if BUSCLK_PWRSAVE
+		msmsdcc_busclk_update(host, host->curr.t_start);
+#endif
+		if (!host->clks_on) {
+			host->stats.clk_wake_reqs++;
+			msmsdcc_enable_clocks(host);
+			host->stats.clk_wake_us += ktime_us_delta(ktime_get(),
+							host->curr.t_start);
+		} else {
+			msmsdcc_enable_clocks(host);
+		}
+	}
 
 	host->curr.mrq = mrq;
 
@@ -1486,10 +1673,15 @@ int msmsdcc_set_pwrsave(struct mmc_host *mmc, int pwrsave)
 
 	clk = readl(host->base + MMCICLOCK);
 	pr_debug("Changing to pwr_save=%d", pwrsave);
-	if (pwrsave && msmsdcc_is_pwrsave(host))
+	if (pwrsave && msmsdcc_is_pwrsave(host)) {
+		if (!(clk & MCI_CLK_PWRSAVE))
+			host->stats.pwrsave_on++;
 		clk |= MCI_CLK_PWRSAVE;
-	else
+	} else {
+		if (clk & MCI_CLK_PWRSAVE)
+			host->stats.pwrsave_off++;
 		clk &= ~MCI_CLK_PWRSAVE;
+	}
 	writel(clk, host->base + MMCICLOCK);
 
 	return 0;
@@ -1516,8 +1708,55 @@ static void msmsdcc_enable_sdio_irq(struct mmc_host *mmc, int enable)
 	spin_unlock_irqrestore(&host->lock, flags);
 }
 
+/*
+ * Map the data of a request that is queued behind the one currently on
+ * the bus, so that the cache maintenance overlaps with that transfer.
+ * Requests that will go through PIO are left alone.
+ */
+static void
+msmsdcc_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+		bool is_first_req)
+{
+	struct msmsdcc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+	unsigned int n;
+
+	if (!data)
+		return;
+
+	data->host_cookie = 0;
+	if (validate_dma(host, data) || data->sg_len > NR_SG)
+		return;
+
+	n = dma_map_sg(mmc_dev(mmc), data->sg, data->sg_len,
+		       msmsdcc_data_dir(data));
+	if (n != data->sg_len) {
+		if (n)
+			dma_unmap_sg(mmc_dev(mmc), data->sg, n,
+				     msmsdcc_data_dir(data));
+		return;
+	}
+
+	data->host_cookie = 1;
+}
+
+static void
+msmsdcc_post_req(struct mmc_host *mmc, struct mmc_request *mrq, int err)
+{
+	struct msmsdcc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+
+	if (!data || !data->host_cookie)
+		return;
+
+	msmsdcc_unmap_data(host, data);
+	data->host_cookie = 0;
+}
+
 static const struct mmc_host_ops msmsdcc_ops = {
 	.request	= msmsdcc_request,
+	.pre_req	= msmsdcc_pre_req,
+	.post_req	= msmsdcc_post_req,
 	.set_ios	= msmsdcc_set_ios,
 	.enable_sdio_irq = msmsdcc_enable_sdio_irq,
 
@@ -1533,6 +1772,8 @@ static int msmsdcc_sdc_get_status(struct mmc_host *mmc) {
 
 static const struct mmc_host_ops msmsdcc_ops_sd = {
 	.request	= msmsdcc_request,
+	.pre_req	= msmsdcc_pre_req,
+	.post_req	= msmsdcc_post_req,
 	.set_ios	= msmsdcc_set_ios,
 	.enable_sdio_irq = msmsdcc_enable_sdio_irq,
 	.get_cd = msmsdcc_sdc_get_status,
@@ -1804,6 +2045,7 @@ msmsdcc_probe(struct platform_device *pdev)
 		mmc->caps |= MMC_CAP_SDIO_IRQ;
 
 	mmc->caps |= MMC_CAP_MMC_HIGHSPEED | MMC_CAP_SD_HIGHSPEED;
+	mmc->caps |= MMC_CAP_PACKED_WR;
 
 	mmc->max_segs = NR_SG;
 	mmc->max_blk_size = 4096;	/* MCI_DATA_CTL BLOCKSIZE up to 4096 */
@@ -1868,6 +2110,7 @@ msmsdcc_probe(struct platform_device *pdev)
 	init_timer(&host->busclk_timer);
 	host->busclk_timer.data = (unsigned long) host;
 	host->busclk_timer.function = msmsdcc_busclk_expired;
+	host->busclk_timeout_us = msmsdcc_busclk_max_ms * USEC_PER_MSEC;
 #endif
 
 	ret = request_irq(cmd_irqres->start, msmsdcc_irq, IRQF_SHARED,
@@ -2091,8 +2334,7 @@ static void __exit msmsdcc_exit(void)
 	platform_driver_unregister(&msmsdcc_driver);
 
 #if defined(CONFIG_DEBUG_FS)
-	debugfs_remove(debugfs_file);
-	debugfs_remove(debugfs_dir);
+	debugfs_remove_recursive(debugfs_dir);
 #endif
 }
 
@@ -2190,12 +2432,86 @@ static const struct file_operations msmsdcc_dbg_state_ops = {
 	.open	= msmsdcc_dbg_state_open,
 };
 
+static const char *msmsdcc_lat_phase_names[MSMSDCC_LAT_PHASES] = {
+	"setup", "xfer", "busy",
+};
+
+static int msmsdcc_dbg_lat_show(struct seq_file *s, void *data)
+{
+	struct msmsdcc_host *host = s->private;
+	struct msmsdcc_lat_stats *lat = &host->lat;
+	struct msmsdcc_stats *st = &host->stats;
+	unsigned int op, ph, b;
+
+	seq_printf(s, "clk_on %u clk_off %u gated_us %llu\n",
+		   st->clk_on, st->clk_off, st->clk_gated_us);
+	seq_printf(s, "pwrsave_on %u pwrsave_off %u\n",
+		   st->pwrsave_on, st->pwrsave_off);
+	seq_printf(s, "busclk timeout_us %u avg_gap_us %u\n",
+		   host->busclk_timeout_us, host->busclk_avg_gap_us);
+	seq_printf(s, "wake_reqs %u early_gates %u wake_us %llu "
+		   "idle_on_us %llu\n", st->clk_wake_reqs,
+		   st->clk_early_gates, st->clk_wake_us, st->clk_idle_on_us);
+
+	/* Bucket n: [2^(n-1), 2^n) us */
+	for (op = 0; op < MSMSDCC_LAT_OPCODES; op++) {
+		if (!lat->count[op])
+			continue;
+		seq_printf(s, "CMD%u count %lu\n", op, lat->count[op]);
+		for (ph = 0; ph < MSMSDCC_LAT_PHASES; ph++) {
+			seq_printf(s, "  %-5s avg_us %llu:",
+				   msmsdcc_lat_phase_names[ph],
+				   div64_u64(lat->total_us[op][ph],
+					     lat->count[op]));
+			for (b = 0; b < MSMSDCC_LAT_BUCKETS; b++)
+				seq_printf(s, " %u", lat->hist[op][ph][b]);
+			seq_putc(s, '\n');
+		}
+	}
+	return 0;
+}
+
+static int msmsdcc_dbg_lat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, msmsdcc_dbg_lat_show, inode->i_private);
+}
+
+static ssize_t
+msmsdcc_dbg_lat_write(struct file *file, const char __user *ubuf,
+		      size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct msmsdcc_host *host = s->private;
+	unsigned long flags;
+
+	/* Any write clears the histograms */
+	spin_lock_irqsave(&host->lock, flags);
+	memset(&host->lat, 0, sizeof(host->lat));
+	spin_unlock_irqrestore(&host->lock, flags);
+	return count;
+}
+
+static const struct file_operations msmsdcc_dbg_lat_ops = {
+	.open		= msmsdcc_dbg_lat_open,
+	.read		= seq_read,
+	.write		= msmsdcc_dbg_lat_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static void msmsdcc_dbg_createhost(struct msmsdcc_host *host)
 {
+	char name[32];
+
 	if (debugfs_dir) {
 		debugfs_file = debugfs_create_file(mmc_hostname(host->mmc),
 							0644, debugfs_dir, host,
 							&msmsdcc_dbg_state_ops);
+
+		snprintf(name, sizeof(name), "%s-latency",
+			 mmc_hostname(host->mmc));
+		debugfs_create_file(name, 0644, debugfs_dir, host,
+				    &msmsdcc_dbg_lat_ops);
 	}
 }
 
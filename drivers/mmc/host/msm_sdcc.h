@@ -209,6 +209,9 @@ struct msmsdcc_curr_req {
 	unsigned int		data_xfered;	/* Bytes acked by BLKEND irq */
 	int			got_dataend;
 	int			user_pages;
+	ktime_t			t_start;	/* request accepted */
+	ktime_t			t_data;		/* data transfer started */
+	ktime_t			t_data_end;	/* data transfer finished */
 };
 
 struct msmsdcc_stats {
@@ -216,6 +219,39 @@ struct msmsdcc_stats {
 	unsigned int cmds;
 	unsigned int cmdpoll_hits;
 	unsigned int cmdpoll_misses;
+	unsigned int clk_on;		/* bus clock gating transitions */
+	unsigned int clk_off;
+	unsigned int pwrsave_on;	/* MCI_CLK_PWRSAVE transitions */
+	unsigned int pwrsave_off;
+	u64 clk_gated_us;		/* time spent with clocks gated */
+	ktime_t t_clk_off;
+	unsigned int clk_wake_reqs;	/* requests that found clocks gated */
+	unsigned int clk_early_gates;	/* of those, gated mid-burst */
+	u64 clk_wake_us;		/* time those spent enabling clocks */
+	u64 clk_idle_on_us;		/* idle time before clocks got gated */
+};
+
+/*
+ * Per-opcode latency histograms, split into the time to get the data
+ * transfer going, the transfer itself and the busy wait after it.
+ * Bucket n counts latencies in [2^(n-1), 2^n) microseconds; the last
+ * bucket is open-ended.
+ */
+#define MSMSDCC_LAT_OPCODES	64
+#define MSMSDCC_LAT_BUCKETS	20
+
+enum {
+	MSMSDCC_LAT_SETUP,
+	MSMSDCC_LAT_XFER,
+	MSMSDCC_LAT_BUSY,
+	MSMSDCC_LAT_PHASES,
+};
+
+struct msmsdcc_lat_stats {
+	unsigned long	count[MSMSDCC_LAT_OPCODES];
+	u64		total_us[MSMSDCC_LAT_OPCODES][MSMSDCC_LAT_PHASES];
+	unsigned int	hist[MSMSDCC_LAT_OPCODES][MSMSDCC_LAT_PHASES]
+			    [MSMSDCC_LAT_BUCKETS];
 };
 
 struct msmsdcc_host {
@@ -235,6 +271,9 @@ struct msmsdcc_host {
 	struct clk		*pclk;		/* SDCC peripheral bus clock */
 	unsigned int		clks_on;	/* set if clocks are enabled */
 	struct timer_list	busclk_timer;
+	unsigned int		busclk_timeout_us; /* adaptive idle timeout */
+	unsigned int		busclk_avg_gap_us; /* in-burst request gap */
+	ktime_t			t_last_req_end;
 
 	unsigned int		eject;		/* eject state */
 
@@ -254,6 +293,9 @@ struct msmsdcc_host {
 	struct msmsdcc_pio_data	pio;
 	int			cmdpoll;
 	struct msmsdcc_stats	stats;
+#if defined(CONFIG_DEBUG_FS)
+	struct msmsdcc_lat_stats lat;
+#endif
 #ifdef CONFIG_HAS_EARLYSUSPEND
 	struct early_suspend early_suspend;
 	int polling_enabled;
@@ -0,0 +1,108 @@
+/*
+ *  linux/drivers/mmc/host/msm_sdcc_trace.h - QCT MSM7K SDC Controller
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Tracepoints for per-request latency and bus clock gating, so that
+ * controller activity can be lined up with blktrace timelines.
+ */
+
+#if !defined(_MSM_SDCC_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _MSM_SDCC_TRACE_H
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM msmsdcc
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE msm_sdcc_trace
+
+#include <linux/tracepoint.h>
+#include <linux/mmc/host.h>
+#include <linux/mmc/core.h>
+
+TRACE_EVENT(msmsdcc_request_start,
+
+	TP_PROTO(struct mmc_host *mmc, struct mmc_request *mrq),
+
+	TP_ARGS(mmc, mrq),
+
+	TP_STRUCT__entry(
+		__field(int, host)
+		__field(u32, opcode)
+		__field(u32, arg)
+		__field(unsigned int, blocks)
+		__field(unsigned int, flags)
+	),
+
+	TP_fast_assign(
+		__entry->host = mmc->index;
+		__entry->opcode = mrq->cmd->opcode;
+		__entry->arg = mrq->cmd->arg;
+		__entry->blocks = mrq->data ? mrq->data->blocks : 0;
+		__entry->flags = mrq->data ? mrq->data->flags : 0;
+	),
+
+	TP_printk("mmc%d: CMD%u arg=%08x blocks=%u%s",
+		__entry->host, __entry->opcode, __entry->arg, __entry->blocks,
+		(__entry->flags & MMC_DATA_WRITE) ? " write" :
+		(__entry->flags & MMC_DATA_READ) ? " read" : "")
+);
+
+TRACE_EVENT(msmsdcc_request_done,
+
+	TP_PROTO(struct mmc_host *mmc, struct mmc_request *mrq,
+		 s64 setup_us, s64 xfer_us, s64 busy_us),
+
+	TP_ARGS(mmc, mrq, setup_us, xfer_us, busy_us),
+
+	TP_STRUCT__entry(
+		__field(int, host)
+		__field(u32, opcode)
+		__field(int, error)
+		__field(s64, setup_us)
+		__field(s64, xfer_us)
+		__field(s64, busy_us)
+	),
+
+	TP_fast_assign(
+		__entry->host = mmc->index;
+		__entry->opcode = mrq->cmd->opcode;
+		__entry->error = mrq->cmd->error ? mrq->cmd->error :
+			(mrq->data ? mrq->data->error : 0);
+		__entry->setup_us = setup_us;
+		__entry->xfer_us = xfer_us;
+		__entry->busy_us = busy_us;
+	),
+
+	TP_printk("mmc%d: CMD%u err=%d setup=%lldus xfer=%lldus busy=%lldus",
+		__entry->host, __entry->opcode, __entry->error,
+		__entry->setup_us, __entry->xfer_us, __entry->busy_us)
+);
+
+TRACE_EVENT(msmsdcc_clk_gate,
+
+	TP_PROTO(struct mmc_host *mmc, int on),
+
+	TP_ARGS(mmc, on),
+
+	TP_STRUCT__entry(
+		__field(int, host)
+		__field(int, on)
+	),
+
+	TP_fast_assign(
+		__entry->host = mmc->index;
+		__entry->on = on;
+	),
+
+	TP_printk("mmc%d: clocks %s", __entry->host,
+		__entry->on ? "on" : "off")
+);
+
+#endif /* _MSM_SDCC_TRACE_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
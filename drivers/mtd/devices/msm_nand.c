@@ -23,6 +23,7 @@
 #include <linux/dma-mapping.h>
 #include <linux/io.h>
 #include <linux/moduleparam.h>
+#include <linux/mutex.h>
 #include <linux/stat.h>
 
 #include <asm/dma.h>
@@ -50,6 +51,8 @@ struct msm_nand_chip {
 	unsigned dma_channel;
 	uint8_t *dma_buffer;
 	dma_addr_t dma_addr;
+	uint8_t *bounce_buf;
+	struct mutex bounce_lock;
 	unsigned CFG0, CFG1;
 	unsigned page_shift;
 	unsigned last_sector;
@@ -331,6 +334,23 @@ msm_nand_dma_map(struct device *dev, void *addr, size_t size,
 	return dma_map_page(dev, page, offset, size, dir);
 }
 
+/*
+ * Page cache and kmalloc buffers can be handed to the data mover as they
+ * are.  Buffers that are not physically contiguous (vmalloc, as used by
+ * UBI) or that share cache lines with unrelated data on the way in from
+ * the device go through the bounce page instead.
+ */
+static int msm_nand_dma_direct(void *addr, size_t size,
+			       enum dma_data_direction dir)
+{
+	if (!virt_addr_valid(addr) || !virt_addr_valid(addr + size - 1))
+		return 0;
+	if (dir != DMA_TO_DEVICE &&
+	    !IS_ALIGNED((unsigned long)addr | size, dma_get_cache_alignment()))
+		return 0;
+	return 1;
+}
+
 static int msm_nand_check_empty(struct mtd_info *mtd, struct mtd_oob_ops *ops,
 				unsigned long *uncorrected)
 {
@@ -369,6 +389,11 @@ static int msm_nand_check_empty(struct mtd_info *mtd, struct mtd_oob_ops *ops,
 	return true;
 }
 
+static int msm_nand_read_oob_bounce(struct mtd_info *mtd, loff_t from,
+				    struct mtd_oob_ops *ops);
+static int msm_nand_write_oob_bounce(struct mtd_info *mtd, loff_t to,
+				     struct mtd_oob_ops *ops);
+
 static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 			     struct mtd_oob_ops *ops)
 {
@@ -468,6 +493,10 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 	pr_info("msm_nand_read_oob %llx %p %x %p %x\n",
 		from, ops->datbuf, ops->len, ops->oobbuf, ops->ooblen);
 #endif
+	if (ops->datbuf &&
+	    !msm_nand_dma_direct(ops->datbuf, ops->len, DMA_FROM_DEVICE))
+		return msm_nand_read_oob_bounce(mtd, from, ops);
+
 	if (ops->datbuf) {
 		/* memset(ops->datbuf, 0x55, ops->len); */
 		data_dma_addr_curr = data_dma_addr =
@@ -700,6 +729,8 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 			/* not thread safe */
 			mtd->ecc_stats.corrected += page_corrected;
 		}
+		mtd_eb_stats_read(mtd, (loff_t)page << chip->page_shift,
+				  page_corrected);
 		if (pageerr && (pageerr != -EUCLEAN || err == 0))
 			err = pageerr;
 
@@ -860,6 +891,9 @@ msm_nand_write_oob(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops)
 		return -EINVAL;
 	}
 
+	if (!msm_nand_dma_direct(ops->datbuf, ops->len, DMA_TO_DEVICE))
+		return msm_nand_write_oob_bounce(mtd, to, ops);
+
 	if (ops->datbuf) {
 		data_dma_addr_curr = data_dma_addr =
 			msm_nand_dma_map(chip->dev, ops->datbuf,
@@ -1102,6 +1136,107 @@ err_dma_map_oobbuf_failed:
 	return err;
 }
 
+/*
+ * Slow path for buffers msm_nand_dma_direct() refuses: transfer one page at
+ * a time through chip->bounce_buf, which is always safe to map directly.
+ */
+static int msm_nand_read_oob_bounce(struct mtd_info *mtd, loff_t from,
+				    struct mtd_oob_ops *ops)
+{
+	struct msm_nand_chip *chip = mtd->priv;
+	struct mtd_oob_ops sub;
+	size_t pagesz = mtd->writesize;
+	size_t oobsz;
+	int err = 0;
+	int ret;
+
+	if (ops->mode == MTD_OOB_RAW)
+		pagesz += mtd->oobsize;
+	oobsz = (ops->mode == MTD_OOB_AUTO) ? mtd->oobavail : mtd->oobsize;
+
+	ops->retlen = 0;
+	ops->oobretlen = 0;
+
+	mutex_lock(&chip->bounce_lock);
+	while (ops->retlen < ops->len) {
+		sub.mode = ops->mode;
+		sub.len = pagesz;
+		sub.retlen = 0;
+		sub.datbuf = chip->bounce_buf;
+		sub.ooboffs = ops->ooboffs;
+		sub.ooblen = 0;
+		sub.oobretlen = 0;
+		sub.oobbuf = NULL;
+		if (ops->oobbuf && ops->oobretlen < ops->ooblen) {
+			sub.ooblen = min(ops->ooblen - ops->oobretlen, oobsz);
+			sub.oobbuf = ops->oobbuf + ops->oobretlen;
+		}
+
+		ret = msm_nand_read_oob(mtd, from, &sub);
+		if (ret && ret != -EUCLEAN && ret != -EBADMSG) {
+			err = ret;
+			break;
+		}
+		if (ret && err != -EBADMSG)
+			err = ret;
+
+		memcpy(ops->datbuf + ops->retlen, chip->bounce_buf, sub.retlen);
+		ops->retlen += sub.retlen;
+		ops->oobretlen += sub.oobretlen;
+		if (sub.retlen != pagesz)
+			break;
+		from += mtd->writesize;
+	}
+	mutex_unlock(&chip->bounce_lock);
+
+	return err;
+}
+
+static int msm_nand_write_oob_bounce(struct mtd_info *mtd, loff_t to,
+				     struct mtd_oob_ops *ops)
+{
+	struct msm_nand_chip *chip = mtd->priv;
+	struct mtd_oob_ops sub;
+	size_t pagesz = mtd->writesize;
+	size_t oobsz;
+	int err = 0;
+
+	if (ops->mode == MTD_OOB_RAW)
+		pagesz += mtd->oobsize;
+	oobsz = (ops->mode == MTD_OOB_AUTO) ? mtd->oobavail : mtd->oobsize;
+
+	ops->retlen = 0;
+	ops->oobretlen = 0;
+
+	mutex_lock(&chip->bounce_lock);
+	while (ops->retlen < ops->len) {
+		memcpy(chip->bounce_buf, ops->datbuf + ops->retlen, pagesz);
+
+		sub.mode = ops->mode;
+		sub.len = pagesz;
+		sub.retlen = 0;
+		sub.datbuf = chip->bounce_buf;
+		sub.ooboffs = ops->ooboffs;
+		sub.ooblen = 0;
+		sub.oobretlen = 0;
+		sub.oobbuf = NULL;
+		if (ops->oobbuf && ops->oobretlen < ops->ooblen) {
+			sub.ooblen = min(ops->ooblen - ops->oobretlen, oobsz);
+			sub.oobbuf = ops->oobbuf + ops->oobretlen;
+		}
+
+		err = msm_nand_write_oob(mtd, to, &sub);
+		ops->retlen += sub.retlen;
+		ops->oobretlen += sub.oobretlen;
+		if (err)
+			break;
+		to += mtd->writesize;
+	}
+	mutex_unlock(&chip->bounce_lock);
+
+	return err;
+}
+
 static int msm_nand_write(struct mtd_info *mtd, loff_t to, size_t len,
 			  size_t *retlen, const u_char *buf)
 {
@@ -1211,6 +1346,7 @@ msm_nand_erase(struct mtd_info *mtd, struct erase_info *instr)
 		instr->fail_addr = instr->addr;
 		instr->state = MTD_ERASE_FAILED;
 	} else {
+		mtd_eb_stats_erase(mtd, instr->addr);
 		instr->state = MTD_ERASE_DONE;
 		instr->fail_addr = 0xffffffff;
 		mtd_erase_callback(instr);
@@ -1600,6 +1736,7 @@ static int __devinit msm_nand_probe(struct platform_device *pdev)
 	info->msm_nand.dev = &pdev->dev;
 
 	init_waitqueue_head(&info->msm_nand.wait_queue);
+	mutex_init(&info->msm_nand.bounce_lock);
 
 	info->msm_nand.dma_channel = pdev->resource[0].start;
 	/* this currently fails if dev is passed in */
@@ -1623,6 +1760,17 @@ static int __devinit msm_nand_probe(struct platform_device *pdev)
 		goto out_free_dma_buffer;
 	}
 
+	info->msm_nand.bounce_buf =
+		kmalloc(info->mtd.writesize + info->mtd.oobsize, GFP_KERNEL);
+	if (info->msm_nand.bounce_buf == NULL) {
+		err = -ENOMEM;
+		goto out_free_dma_buffer;
+	}
+
+	err = mtd_eb_stats_init(&info->mtd);
+	if (err)
+		goto out_free_bounce_buf;
+
 #ifdef CONFIG_MTD_PARTITIONS
 	err = parse_mtd_partitions(&info->mtd, part_probes, &info->parts, 0);
 	if (err > 0)
@@ -1641,6 +1789,8 @@ static int __devinit msm_nand_probe(struct platform_device *pdev)
 
 	return 0;
 
+out_free_bounce_buf:
+	kfree(info->msm_nand.bounce_buf);
 out_free_dma_buffer:
 	dma_free_coherent(/*dev*/ NULL, SZ_4K, info->msm_nand.dma_buffer,
 			  info->msm_nand.dma_addr);
@@ -1665,6 +1815,8 @@ static int __devexit msm_nand_remove(struct platform_device *pdev)
 			del_mtd_device(&info->mtd);
 
 		msm_nand_release(&info->mtd);
+		mtd_eb_stats_free(&info->mtd);
+		kfree(info->msm_nand.bounce_buf);
 		dma_free_coherent(/*dev*/ NULL, SZ_4K,
 				  info->msm_nand.dma_buffer,
 				  info->msm_nand.dma_addr);
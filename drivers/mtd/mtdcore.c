@@ -35,6 +35,9 @@
 #include <linux/idr.h>
 #include <linux/backing-dev.h>
 #include <linux/gfp.h>
+#include <linux/debugfs.h>
+#include <linux/vmalloc.h>
+#include <linux/uaccess.h>
 
 #include <linux/mtd/mtd.h>
 
@@ -278,6 +281,102 @@ static struct device_type mtd_devtype = {
 	.release	= mtd_release,
 };
 
+#ifdef CONFIG_MTD_EB_STATS
+static struct dentry *mtd_debugfs_root;
+
+/**
+ *	mtd_eb_stats_init - allocate per-eraseblock counters
+ *	@mtd: master MTD device, before it or its partitions are added
+ *
+ *	Drivers which update the counters with mtd_eb_stats_read() and
+ *	mtd_eb_stats_erase() call this from probe.  Partitions added later
+ *	share the master's array.
+ */
+int mtd_eb_stats_init(struct mtd_info *mtd)
+{
+	size_t size = mtd_div_by_eb(mtd->size, mtd) * sizeof(*mtd->eb_stats);
+
+	mtd->eb_stats = vmalloc(size);
+	if (!mtd->eb_stats)
+		return -ENOMEM;
+	memset(mtd->eb_stats, 0, size);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mtd_eb_stats_init);
+
+void mtd_eb_stats_free(struct mtd_info *mtd)
+{
+	vfree(mtd->eb_stats);
+	mtd->eb_stats = NULL;
+}
+EXPORT_SYMBOL_GPL(mtd_eb_stats_free);
+
+static ssize_t mtd_eb_stats_read_file(struct file *file, char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	struct mtd_info *mtd = file->private_data;
+	struct mtd_eb_stats_hdr hdr;
+	loff_t pos;
+	ssize_t ret, done = 0;
+
+	hdr.magic = MTD_EB_STATS_MAGIC;
+	hdr.version = MTD_EB_STATS_VERSION;
+	hdr.blocks = mtd_div_by_eb(mtd->size, mtd);
+	hdr.erasesize = mtd->erasesize;
+
+	if (*ppos < sizeof(hdr)) {
+		done = simple_read_from_buffer(buf, count, ppos, &hdr,
+					       sizeof(hdr));
+		if (done < 0 || *ppos < sizeof(hdr))
+			return done;
+		buf += done;
+		count -= done;
+	}
+
+	pos = *ppos - sizeof(hdr);
+	ret = simple_read_from_buffer(buf, count, &pos, mtd->eb_stats,
+				      hdr.blocks * sizeof(*mtd->eb_stats));
+	if (ret < 0)
+		return done ? done : ret;
+
+	*ppos = pos + sizeof(hdr);
+	return done + ret;
+}
+
+static int mtd_eb_stats_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+static const struct file_operations mtd_eb_stats_fops = {
+	.owner	= THIS_MODULE,
+	.open	= mtd_eb_stats_open,
+	.read	= mtd_eb_stats_read_file,
+};
+
+static void mtd_eb_stats_add(struct mtd_info *mtd)
+{
+	char name[16];
+
+	if (!mtd->eb_stats || IS_ERR_OR_NULL(mtd_debugfs_root))
+		return;
+
+	snprintf(name, sizeof(name), "mtd%d_ebstats", mtd->index);
+	mtd->eb_stats_dentry = debugfs_create_file(name, S_IRUSR,
+				mtd_debugfs_root, mtd, &mtd_eb_stats_fops);
+}
+
+static void mtd_eb_stats_del(struct mtd_info *mtd)
+{
+	debugfs_remove(mtd->eb_stats_dentry);
+	mtd->eb_stats_dentry = NULL;
+}
+#else
+static inline void mtd_eb_stats_add(struct mtd_info *mtd) { }
+static inline void mtd_eb_stats_del(struct mtd_info *mtd) { }
+#endif /* CONFIG_MTD_EB_STATS */
+
 /**
  *	add_mtd_device - register an MTD device
  *	@mtd: pointer to new MTD device info structure
@@ -360,6 +459,8 @@ int add_mtd_device(struct mtd_info *mtd)
 			      MTD_DEVT(i) + 1,
 			      NULL, "mtd%dro", i);
 
+	mtd_eb_stats_add(mtd);
+
 	DEBUG(0, "mtd: Giving out device %d to %s\n", i, mtd->name);
 	/* No need to get a refcount on the module containing
 	   the notifier, since we hold the mtd_table_mutex */
@@ -413,6 +514,7 @@ int del_mtd_device (struct mtd_info *mtd)
 		       mtd->index, mtd->name, mtd->usecount);
 		ret = -EBUSY;
 	} else {
+		mtd_eb_stats_del(mtd);
 		device_unregister(&mtd->dev);
 
 		idr_remove(&mtd_idr, mtd->index);
@@ -737,6 +839,9 @@ static int __init init_mtd(void)
 	if ((proc_mtd = create_proc_entry( "mtd", 0, NULL )))
 		proc_mtd->read_proc = mtd_read_proc;
 #endif /* CONFIG_PROC_FS */
+#ifdef CONFIG_MTD_EB_STATS
+	mtd_debugfs_root = debugfs_create_dir("mtd", NULL);
+#endif
 	return 0;
 
 err_bdi3:
@@ -756,6 +861,9 @@ static void __exit cleanup_mtd(void)
         if (proc_mtd)
 		remove_proc_entry( "mtd", NULL);
 #endif /* CONFIG_PROC_FS */
+#ifdef CONFIG_MTD_EB_STATS
+	debugfs_remove(mtd_debugfs_root);
+#endif
 	class_unregister(&mtd_class);
 	bdi_destroy(&mtd_bdi_unmappable);
 	bdi_destroy(&mtd_bdi_ro_mappable);
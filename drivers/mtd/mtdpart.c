@@ -522,6 +522,13 @@ static struct mtd_part *allocate_partition(struct mtd_info *master,
 			part->name);
 	}
 
+#ifdef CONFIG_MTD_EB_STATS
+	/* Share the master's counters if the partition is block aligned */
+	if (master->eb_stats && !mtd_mod_by_eb(slave->offset, master))
+		slave->mtd.eb_stats = master->eb_stats +
+			mtd_div_by_eb(slave->offset, master);
+#endif
+
 	slave->mtd.ecclayout = master->ecclayout;
 	if (master->block_isbad) {
 		uint64_t offs = 0;
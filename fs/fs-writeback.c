@@ -579,14 +579,21 @@ static void __writeback_inodes_sb(struct super_block *sb,
  */
 #define MAX_WRITEBACK_PAGES     1024
 
-static inline bool over_bground_thresh(void)
+static inline bool over_bground_thresh(struct backing_dev_info *bdi)
 {
 	unsigned long background_thresh, dirty_thresh;
 
 	global_dirty_limits(&background_thresh, &dirty_thresh);
 
-	return (global_page_state(NR_FILE_DIRTY) +
-		global_page_state(NR_UNSTABLE_NFS) > background_thresh);
+	if (global_page_state(NR_FILE_DIRTY) +
+	    global_page_state(NR_UNSTABLE_NFS) > background_thresh)
+		return true;
+
+	/*
+	 * Keep going on a slow bdi holding more than half of what it can
+	 * write back in its dirty_time_ms, or its dirtiers get throttled.
+	 */
+	return bdi_stat(bdi, BDI_RECLAIMABLE) > bdi_bandwidth_limit(bdi) / 2;
 }
 
 /*
@@ -650,7 +657,7 @@ static long wb_writeback(struct bdi_writeback *wb,
 		 * For background writeout, stop when we are below the
 		 * background dirty threshold
 		 */
-		if (work->for_background && !over_bground_thresh())
+		if (work->for_background && !over_bground_thresh(wb->bdi))
 			break;
 
 		wbc.more_io = 0;
@@ -666,6 +673,7 @@ static long wb_writeback(struct bdi_writeback *wb,
 
 		work->nr_pages -= write_chunk - wbc.nr_to_write;
 		wrote += write_chunk - wbc.nr_to_write;
+		bdi_update_write_bandwidth(wb->bdi);
 
 		/*
 		 * If we consumed everything, see if we have more
@@ -286,6 +286,36 @@ ssize_t part_inflight_show(struct device *dev,
 	return sprintf(buf, "%8u %8u\n", p->in_flight[0], p->in_flight[1]);
 }
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+ssize_t part_lat_hist_show(struct device *dev,
+			   struct device_attribute *attr, char *buf)
+{
+	struct hd_struct *p = dev_to_part(dev);
+	unsigned int lower;
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < BLK_LAT_BUCKETS; i++) {
+		lower = i ? 1U << (BLK_LAT_MIN_SHIFT + i - 1) : 0;
+		len += sprintf(buf + len, "%8u %8lu %8lu %8lu %8lu\n", lower,
+			       part_stat_read(p, lat_hist[BLK_LAT_READ][i]),
+			       part_stat_read(p, lat_hist[BLK_LAT_WRITE][i]),
+			       part_stat_read(p, lat_hist[BLK_LAT_DISCARD][i]),
+			       part_stat_read(p, lat_hist[BLK_LAT_FLUSH][i]));
+	}
+
+	return len;
+}
+
+ssize_t part_lat_hist_store(struct device *dev,
+			    struct device_attribute *attr,
+			    const char *buf, size_t count)
+{
+	part_lat_hist_reset(dev_to_part(dev));
+	return count;
+}
+#endif
+
 ssize_t part_partition_name_show(struct device *dev,
 			struct device_attribute *attr, char *buf)
 {
@@ -325,6 +355,10 @@ static DEVICE_ATTR(discard_alignment, S_IRUGO, part_discard_alignment_show,
 static DEVICE_ATTR(stat, S_IRUGO, part_stat_show, NULL);
 static DEVICE_ATTR(inflight, S_IRUGO, part_inflight_show, NULL);
 static DEVICE_ATTR(partition_name, S_IRUGO, part_partition_name_show, NULL);
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static DEVICE_ATTR(latency_hist, S_IRUGO|S_IWUSR, part_lat_hist_show,
+		   part_lat_hist_store);
+#endif
 
 #ifdef CONFIG_FAIL_MAKE_REQUEST
 static struct device_attribute dev_attr_fail =
@@ -340,6 +374,9 @@ static struct attribute *part_attrs[] = {
 	&dev_attr_stat.attr,
 	&dev_attr_inflight.attr,
 	&dev_attr_partition_name.attr,
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	&dev_attr_latency_hist.attr,
+#endif
 #ifdef CONFIG_FAIL_MAKE_REQUEST
 	&dev_attr_fail.attr,
 #endif
@@ -47,11 +47,15 @@
 #include <linux/string.h>
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/highmem.h>
+#include <linux/bitmap.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs_fs_i.h"
 #include "squashfs.h"
+#include "page_actor.h"
 
 /*
  * Locate cache slot in range [offset, index] for specified inode.  If
@@ -371,11 +375,111 @@ static int read_blocklist(struct inode *inode, int index, u64 *block)
 }
 
 
-static int squashfs_readpage(struct file *file, struct page *page)
+/*
+ * Decompress the datablock <block, bsize> directly into the page cache
+ * pages it covers.  Pages which are already uptodate are decompressed
+ * into scratch pages which are then thrown away.  If a page can't be
+ * grabbed, most likely because another reader is filling the same
+ * block, -EAGAIN is returned and the caller goes through the read_page
+ * cache instead, so that the block is only decompressed once.  On
+ * success target_page is uptodate and unlocked, on failure it is left
+ * locked for the caller.
+ */
+static int squashfs_readpage_block(struct page *target_page, u64 block,
+	int bsize)
+{
+	struct inode *inode = target_page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int file_end = (i_size_read(inode) - 1) >> PAGE_CACHE_SHIFT;
+	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
+	int start_index = target_page->index & ~mask;
+	int end_index = start_index | mask;
+	int i, n, pages, bytes, res = -ENOMEM;
+	DECLARE_BITMAP(scratch, SQUASHFS_FILE_MAX_SIZE >> PAGE_CACHE_SHIFT);
+	struct squashfs_page_actor *actor;
+	struct page **page;
+	void *pageaddr;
+
+	if (end_index > file_end)
+		end_index = file_end;
+	pages = end_index - start_index + 1;
+
+	page = kmalloc(pages * sizeof(*page), GFP_KERNEL);
+	if (page == NULL)
+		return res;
+
+	actor = squashfs_page_actor_init_special(page, pages, 0);
+	if (actor == NULL)
+		goto out;
+
+	bitmap_zero(scratch, pages);
+	for (i = 0, n = start_index; i < pages; i++, n++) {
+		page[i] = (n == target_page->index) ? target_page :
+			grab_cache_page_nowait(target_page->mapping, n);
+
+		if (page[i] == NULL) {
+			res = -EAGAIN;
+			goto release_pages;
+		}
+
+		if (PageUptodate(page[i])) {
+			unlock_page(page[i]);
+			page_cache_release(page[i]);
+			page[i] = alloc_page(GFP_KERNEL);
+			if (page[i] == NULL)
+				goto release_pages;
+			__set_bit(i, scratch);
+		}
+	}
+
+	res = squashfs_read_data(inode->i_sb, block, bsize, NULL, actor);
+	if (res < 0)
+		goto release_pages;
+
+	/* Last page may have trailing bytes not filled */
+	bytes = res % PAGE_CACHE_SIZE;
+	if (bytes) {
+		pageaddr = kmap_atomic(page[pages - 1], KM_USER0);
+		memset(pageaddr + bytes, 0, PAGE_CACHE_SIZE - bytes);
+		kunmap_atomic(pageaddr, KM_USER0);
+	}
+
+	for (i = 0; i < pages; i++) {
+		if (test_bit(i, scratch)) {
+			__free_page(page[i]);
+			continue;
+		}
+		flush_dcache_page(page[i]);
+		SetPageUptodate(page[i]);
+		unlock_page(page[i]);
+		if (page[i] != target_page)
+			page_cache_release(page[i]);
+	}
+	res = 0;
+	goto out;
+
+release_pages:
+	while (i--) {
+		if (test_bit(i, scratch))
+			__free_page(page[i]);
+		else if (page[i] != target_page) {
+			unlock_page(page[i]);
+			page_cache_release(page[i]);
+		}
+	}
+
+out:
+	kfree(actor);
+	kfree(page);
+	return res;
+}
+
+
+static int __squashfs_readpage(struct page *page)
 {
 	struct inode *inode = page->mapping->host;
 	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
-	int bytes, i, offset = 0, sparse = 0;
+	int bytes, i, res, offset = 0, sparse = 0;
 	struct squashfs_cache_entry *buffer = NULL;
 	void *pageaddr;
 
@@ -410,14 +514,23 @@ static int squashfs_readpage(struct file *file, struct page *page)
 			sparse = 1;
 		} else {
 			/*
-			 * Read and decompress datablock.
+			 * Decompress datablock straight into the page cache,
+			 * or failing that read it through the read_page cache.
 			 */
-			buffer = squashfs_get_datablock(inode->i_sb,
+			res = squashfs_readpage_block(page, block, bsize);
+			if (res == 0)
+				return 0;
+
+			if (res == -EAGAIN) {
+				buffer = squashfs_get_datablock(inode->i_sb,
 								block, bsize);
-			if (buffer->error) {
+				res = buffer->error;
+				if (res)
+					squashfs_cache_put(buffer);
+			}
+			if (res) {
 				ERROR("Unable to read page, block %llx, size %x"
 					"\n", block, bsize);
-				squashfs_cache_put(buffer);
 				goto error_out;
 			}
 			bytes = buffer->length;
@@ -443,10 +556,10 @@ static int squashfs_readpage(struct file *file, struct page *page)
 	}
 
 	/*
-	 * Loop copying datablock into pages.  As the datablock likely covers
-	 * many PAGE_CACHE_SIZE pages (default block size is 128 KiB) explicitly
-	 * grab the pages from the page cache, except for the page that we've
-	 * been called to fill.
+	 * Loop copying datablock or fragment (or zeroing hole) into pages.
+	 * As the block likely covers many PAGE_CACHE_SIZE pages (default
+	 * block size is 128 KiB) explicitly grab the pages from the page
+	 * cache, except for the page that we've been called to fill.
 	 */
 	for (i = start_index; i <= end_index && bytes > 0; i++,
 			bytes -= PAGE_CACHE_SIZE, offset += PAGE_CACHE_SIZE) {
@@ -496,6 +609,96 @@ out:
 }
 
 
+static struct workqueue_struct *squashfs_readahead_wq;
+
+struct squashfs_readahead {
+	struct work_struct	work;
+	struct page		*page;
+};
+
+
+static void squashfs_readahead_work(struct work_struct *work)
+{
+	struct squashfs_readahead *ra = container_of(work,
+		struct squashfs_readahead, work);
+
+	__squashfs_readpage(ra->page);
+	page_cache_release(ra->page);
+	kfree(ra);
+}
+
+
+/*
+ * Queue the datablocks following block index for decompression on the
+ * readahead workqueue.  The first page of each block is locked in the page
+ * cache here, so a foreground read of that block waits for the
+ * asynchronous one rather than decompressing the block a second time.
+ */
+static void squashfs_readahead(struct inode *inode, int index)
+{
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_CACHE_SHIFT;
+	int file_end = i_size_read(inode) >> msblk->block_log;
+	int last = min(index + CONFIG_SQUASHFS_READAHEAD_BLOCKS, file_end - 1);
+
+	for (index++; index <= last; index++) {
+		struct squashfs_readahead *ra;
+		struct page *page = grab_cache_page_nowait(inode->i_mapping,
+			(pgoff_t) index << shift);
+
+		if (page == NULL)
+			continue;
+
+		if (PageUptodate(page))
+			goto release;
+
+		ra = kmalloc(sizeof(*ra), GFP_NOFS);
+		if (ra == NULL)
+			goto release;
+
+		INIT_WORK(&ra->work, squashfs_readahead_work);
+		ra->page = page;
+		queue_work(squashfs_readahead_wq, &ra->work);
+		continue;
+
+release:
+		unlock_page(page);
+		page_cache_release(page);
+	}
+}
+
+
+static int squashfs_readpage(struct file *file, struct page *page)
+{
+	struct inode *inode = page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int index = page->index >> (msblk->block_log - PAGE_CACHE_SHIFT);
+
+	if (CONFIG_SQUASHFS_READAHEAD_BLOCKS)
+		squashfs_readahead(inode, index);
+
+	return __squashfs_readpage(page);
+}
+
+
+int __init squashfs_readahead_init(void)
+{
+	if (CONFIG_SQUASHFS_READAHEAD_BLOCKS == 0)
+		return 0;
+
+	squashfs_readahead_wq = alloc_workqueue("squashfs_ra", WQ_UNBOUND, 0);
+
+	return squashfs_readahead_wq ? 0 : -ENOMEM;
+}
+
+
+void squashfs_readahead_destroy(void)
+{
+	if (squashfs_readahead_wq)
+		destroy_workqueue(squashfs_readahead_wq);
+}
+
+
 const struct address_space_operations squashfs_aops = {
 	.readpage = squashfs_readpage
 };
@@ -43,6 +43,20 @@
 
 /* Robustification (if it ever comes about...) */
 static void yaffs_RetireBlock(yaffs_Device *dev, int blockInNAND);
+/*
+ * The block still reads fine but is wearing (read disturb, corrected
+ * bitflips building up).  Prioritise it for gc so its data gets moved,
+ * without counting a strike against it.
+ */
+void yaffs_HandleBlockRefresh(yaffs_Device *dev, yaffs_BlockInfo *bi)
+{
+	if (!bi->gcPrioritise) {
+		bi->gcPrioritise = 1;
+		dev->hasPendingPrioritisedGCs = 1;
+		T(YAFFS_TRACE_GC, (TSTR("yaffs: Block needs refresh" TENDSTR)));
+	}
+}
+
 static void yaffs_HandleWriteChunkError(yaffs_Device *dev, int chunkInNAND,
 		int erasedOk);
 static void yaffs_HandleWriteChunkOk(yaffs_Device *dev, int chunkInNAND,
@@ -575,6 +575,8 @@ struct yaffs_DeviceParamStruct {
 	int (*markNANDBlockBad) (struct yaffs_DeviceStruct *dev, int blockNo);
 	int (*queryNANDBlock) (struct yaffs_DeviceStruct *dev, int blockNo,
 			       yaffs_BlockState *state, __u32 *sequenceNumber);
+	/* Optional: report blocks the driver thinks should be rewritten */
+	int (*blockNeedsRefresh) (struct yaffs_DeviceStruct *dev, int blockNo);
 #endif
 
 	/* The removeObjectCallback function must be supplied by OS flavours that
@@ -925,6 +927,7 @@ void yaffs_GutsTest(yaffs_Device *dev);
 void yaffs_DeleteChunk(yaffs_Device *dev, int chunkId, int markNAND, int lyn);
 int yaffs_CheckFF(__u8 *buffer, int nBytes);
 void yaffs_HandleChunkError(yaffs_Device *dev, yaffs_BlockInfo *bi);
+void yaffs_HandleBlockRefresh(yaffs_Device *dev, yaffs_BlockInfo *bi);
 
 __u8 *yaffs_GetTempBuffer(yaffs_Device *dev, int lineNo);
 void yaffs_ReleaseTempBuffer(yaffs_Device *dev, __u8 *buffer, int lineNo);
@@ -255,3 +255,32 @@ int nandmtd2_QueryNANDBlock(struct yaffs_DeviceStruct *dev, int blockNo,
 		return YAFFS_FAIL;
 }
 
+/*
+ * Ask the MTD per-eraseblock counters whether this block has served so
+ * many reads, or needed so many bitflips corrected since it was last
+ * erased, that its data should be moved before the ECC gives up.
+ */
+int nandmtd2_BlockNeedsRefresh(struct yaffs_DeviceStruct *dev, int blockNo)
+{
+#ifdef CONFIG_MTD_EB_STATS
+	struct mtd_info *mtd = yaffs_DeviceToMtd(dev);
+	loff_t addr = (loff_t)blockNo * dev->param.nChunksPerBlock *
+			dev->param.totalBytesPerChunk;
+	struct mtd_eb_stats *st;
+
+	if (addr >= mtd->size)
+		return 0;
+
+	st = mtd_eb_stats_get(mtd, addr);
+	if (!st)
+		return 0;
+
+	if (yaffs_refresh_bitflips && st->corrected >= yaffs_refresh_bitflips)
+		return 1;
+	if (yaffs_refresh_reads && st->read_count >= yaffs_refresh_reads)
+		return 1;
+	return 0;
+#else
+	return 0;
+#endif
+}
@@ -25,5 +25,6 @@ int nandmtd2_ReadChunkWithTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
 int nandmtd2_MarkNANDBlockBad(struct yaffs_DeviceStruct *dev, int blockNo);
 int nandmtd2_QueryNANDBlock(struct yaffs_DeviceStruct *dev, int blockNo,
 			yaffs_BlockState *state, __u32 *sequenceNumber);
+int nandmtd2_BlockNeedsRefresh(struct yaffs_DeviceStruct *dev, int blockNo);
 
 #endif
@@ -47,6 +47,16 @@ int yaffs_ReadChunkWithTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
 		bi = yaffs_GetBlockInfo(dev, chunkInNAND/dev->param.nChunksPerBlock);
 		yaffs_HandleChunkError(dev, bi);
 	}
+#ifdef CONFIG_YAFFS_YAFFS2
+	else if (dev->param.blockNeedsRefresh &&
+		 dev->param.blockNeedsRefresh(dev,
+			realignedChunkInNAND / dev->param.nChunksPerBlock)) {
+
+		yaffs_BlockInfo *bi;
+		bi = yaffs_GetBlockInfo(dev, chunkInNAND/dev->param.nChunksPerBlock);
+		yaffs_HandleBlockRefresh(dev, bi);
+	}
+#endif
 
 	return result;
 }
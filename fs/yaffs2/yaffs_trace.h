@@ -19,6 +19,8 @@
 
 extern unsigned int yaffs_traceMask;
 extern unsigned int yaffs_wr_attempts;
+extern unsigned int yaffs_refresh_bitflips;
+extern unsigned int yaffs_refresh_reads;
 
 /*
  * Tracing flags.
@@ -40,6 +40,7 @@ typedef int (congested_fn)(void *, int);
 enum bdi_stat_item {
 	BDI_RECLAIMABLE,
 	BDI_WRITEBACK,
+	BDI_WRITTEN,
 	NR_BDI_STAT_ITEMS
 };
 
@@ -79,6 +80,15 @@ struct backing_dev_info {
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
 
+	/*
+	 * Writeback bandwidth estimated from completed writeback, and the
+	 * dirty limit it implies: no more than dirty_time_ms worth of it.
+	 */
+	unsigned long bw_time_stamp;	/* last bandwidth update */
+	unsigned long written_stamp;	/* BDI_WRITTEN at bw_time_stamp */
+	unsigned long write_bandwidth;	/* pages/s */
+	unsigned int dirty_time_ms;	/* 0 disables the limit */
+
 	struct bdi_writeback wb;  /* default writeback info for this bdi */
 	spinlock_t wb_lock;	  /* protects work_list */
 
@@ -108,6 +118,8 @@ int bdi_writeback_thread(void *data);
 int bdi_has_dirty_io(struct backing_dev_info *bdi);
 void bdi_arm_supers_timer(void);
 void bdi_wakeup_thread_delayed(struct backing_dev_info *bdi);
+void bdi_update_write_bandwidth(struct backing_dev_info *bdi);
+unsigned long bdi_bandwidth_limit(struct backing_dev_info *bdi);
 
 extern spinlock_t bdi_lock;
 extern struct list_head bdi_list;
@@ -119,6 +119,9 @@ struct request {
 #ifdef CONFIG_BLK_CGROUP
 	unsigned long long start_time_ns;
 	unsigned long long io_start_time_ns;    /* when passed to hardware */
+#endif
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	unsigned long long lat_start_ns;	/* sched_clock() at allocation */
 #endif
 	/* Number of scatter-gather DMA addr+len pairs after
 	 * physical address coalescing is performed.
@@ -380,6 +383,11 @@ struct request_queue
 	/* Throttle data */
 	struct throtl_data *td;
 #endif
+
+#ifdef CONFIG_BLK_DEV_DISCARD_DEFER
+	/* Deferred discard backlog */
+	struct discard_data *dd;
+#endif
 };
 
 #define QUEUE_FLAG_QUEUED	1	/* uses generic tag queueing */
@@ -402,6 +410,7 @@ struct request_queue
 #define QUEUE_FLAG_NOXMERGES   17	/* No extended merges */
 #define QUEUE_FLAG_ADD_RANDOM  18	/* Contributes to random pool */
 #define QUEUE_FLAG_SECDISCARD  19	/* supports SECDISCARD */
+#define QUEUE_FLAG_DISCARD_DEFER 20	/* handles bio-less DISCARD requests */
 
 #define QUEUE_FLAG_DEFAULT	((1 << QUEUE_FLAG_IO_STAT) |		\
 				 (1 << QUEUE_FLAG_STACKABLE)	|	\
@@ -487,6 +496,8 @@ static inline void queue_flag_clear(unsigned int flag, struct request_queue *q)
 #define blk_queue_discard(q)	test_bit(QUEUE_FLAG_DISCARD, &(q)->queue_flags)
 #define blk_queue_secdiscard(q)	(blk_queue_discard(q) && \
 	test_bit(QUEUE_FLAG_SECDISCARD, &(q)->queue_flags))
+#define blk_queue_discard_deferrable(q)	\
+	test_bit(QUEUE_FLAG_DISCARD_DEFER, &(q)->queue_flags)
 
 #define blk_noretry_request(rq) \
 	((rq)->cmd_flags & (REQ_FAILFAST_DEV|REQ_FAILFAST_TRANSPORT| \
@@ -863,6 +874,46 @@ struct request_queue *blk_alloc_queue(gfp_t);
 struct request_queue *blk_alloc_queue_node(gfp_t, int);
 extern void blk_put_queue(struct request_queue *);
 
+/*
+ * blk_plug lets a task build up a batch of related requests without
+ * taking the queue lock for each bio.  Requests are kept on a private
+ * list, merged there, and handed to the elevator in one go when the
+ * task calls blk_finish_plug() or goes to sleep.
+ */
+struct blk_plug {
+	unsigned long magic;
+	struct list_head list;
+	unsigned int should_sort;
+};
+#define BLK_PLUG_MAGIC	0x91827364
+
+extern void blk_start_plug(struct blk_plug *);
+extern void blk_finish_plug(struct blk_plug *);
+extern void blk_flush_plug_list(struct blk_plug *, bool);
+
+static inline void blk_flush_plug(struct task_struct *tsk)
+{
+	struct blk_plug *plug = tsk->plug;
+
+	if (plug)
+		blk_flush_plug_list(plug, false);
+}
+
+static inline void blk_schedule_flush_plug(struct task_struct *tsk)
+{
+	struct blk_plug *plug = tsk->plug;
+
+	if (plug)
+		blk_flush_plug_list(plug, true);
+}
+
+static inline bool blk_needs_flush_plug(struct task_struct *tsk)
+{
+	struct blk_plug *plug = tsk->plug;
+
+	return plug && !list_empty(&plug->list);
+}
+
 /*
  * tag stuff
  */
@@ -1155,6 +1206,24 @@ static inline void throtl_schedule_delayed_work(struct request_queue *q, unsigne
 static inline void throtl_shutdown_timer_wq(struct request_queue *q) {}
 #endif /* CONFIG_BLK_DEV_THROTTLING */
 
+#ifdef CONFIG_BLK_DEV_DISCARD_DEFER
+extern int blk_discard_init(struct request_queue *q);
+extern void blk_discard_exit(struct request_queue *q);
+extern int blk_discard_bio(struct request_queue *q, struct bio **bio);
+extern void blk_discard_shutdown(struct request_queue *q);
+extern void blk_queue_discard_defer(struct request_queue *q, unsigned int msecs);
+#else /* CONFIG_BLK_DEV_DISCARD_DEFER */
+static inline int blk_discard_bio(struct request_queue *q, struct bio **bio)
+{
+	return 0;
+}
+
+static inline int blk_discard_init(struct request_queue *q) { return 0; }
+static inline void blk_discard_exit(struct request_queue *q) {}
+static inline void blk_discard_shutdown(struct request_queue *q) {}
+static inline void blk_queue_discard_defer(struct request_queue *q, unsigned int msecs) {}
+#endif /* CONFIG_BLK_DEV_DISCARD_DEFER */
+
 #define MODULE_ALIAS_BLOCKDEV(major,minor) \
 	MODULE_ALIAS("block-major-" __stringify(major) "-" __stringify(minor))
 #define MODULE_ALIAS_BLOCKDEV_MAJOR(major) \
@@ -1273,6 +1342,9 @@ struct block_device_operations {
 extern int __blkdev_driver_ioctl(struct block_device *, fmode_t, unsigned int,
 				 unsigned long);
 #else /* CONFIG_BLOCK */
+
+struct task_struct;
+
 /*
  * stubs for when the block layer is configured out
  */
@@ -1283,6 +1355,30 @@ static inline long nr_blockdev_pages(void)
 	return 0;
 }
 
+struct blk_plug {
+};
+
+static inline void blk_start_plug(struct blk_plug *plug)
+{
+}
+
+static inline void blk_finish_plug(struct blk_plug *plug)
+{
+}
+
+static inline void blk_flush_plug(struct task_struct *task)
+{
+}
+
+static inline void blk_schedule_flush_plug(struct task_struct *task)
+{
+}
+
+static inline bool blk_needs_flush_plug(struct task_struct *tsk)
+{
+	return false;
+}
+
 #endif /* CONFIG_BLOCK */
 
 #endif
@@ -81,6 +81,24 @@ struct partition {
 	__le32 nr_sects;		/* nr of sectors in partition */
 } __attribute__((packed));
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+enum {
+	BLK_LAT_READ,
+	BLK_LAT_WRITE,
+	BLK_LAT_DISCARD,
+	BLK_LAT_FLUSH,
+	BLK_LAT_TYPES,
+};
+
+/*
+ * Bucket 0 counts requests done in under 64us, bucket n > 0 those
+ * taking [64us << (n - 1), 64us << n), and the last one everything
+ * from about one second up.
+ */
+#define BLK_LAT_BUCKETS		16
+#define BLK_LAT_MIN_SHIFT	6
+#endif
+
 struct disk_stats {
 	unsigned long sectors[2];	/* READs and WRITEs */
 	unsigned long ios[2];
@@ -88,6 +106,9 @@ struct disk_stats {
 	unsigned long ticks[2];
 	unsigned long io_ticks;
 	unsigned long time_in_queue;
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	unsigned long lat_hist[BLK_LAT_TYPES][BLK_LAT_BUCKETS];
+#endif
 };
 
 #define PARTITION_META_INFO_VOLNAMELTH	64
@@ -308,6 +329,17 @@ static inline void part_stat_set_all(struct hd_struct *part, int value)
 				sizeof(struct disk_stats));
 }
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static inline void part_lat_hist_reset(struct hd_struct *part)
+{
+	int i;
+
+	for_each_possible_cpu(i)
+		memset(per_cpu_ptr(part->dkstats, i)->lat_hist, 0,
+				sizeof(part->dkstats->lat_hist));
+}
+#endif
+
 static inline int init_part_stats(struct hd_struct *part)
 {
 	part->dkstats = alloc_percpu(struct disk_stats);
@@ -335,6 +367,13 @@ static inline void part_stat_set_all(struct hd_struct *part, int value)
 	memset(&part->dkstats, value, sizeof(struct disk_stats));
 }
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static inline void part_lat_hist_reset(struct hd_struct *part)
+{
+	memset(part->dkstats.lat_hist, 0, sizeof(part->dkstats.lat_hist));
+}
+#endif
+
 static inline int init_part_stats(struct hd_struct *part)
 {
 	return 1;
@@ -606,6 +645,13 @@ extern ssize_t part_stat_show(struct device *dev,
 			      struct device_attribute *attr, char *buf);
 extern ssize_t part_inflight_show(struct device *dev,
 			      struct device_attribute *attr, char *buf);
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+extern ssize_t part_lat_hist_show(struct device *dev,
+				  struct device_attribute *attr, char *buf);
+extern ssize_t part_lat_hist_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count);
+#endif
 #ifdef CONFIG_FAIL_MAKE_REQUEST
 extern ssize_t part_fail_show(struct device *dev,
 			      struct device_attribute *attr, char *buf);
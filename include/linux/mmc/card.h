@@ -54,6 +54,9 @@ struct mmc_ext_csd {
 	unsigned int		sec_trim_mult;	/* Secure trim multiplier  */
 	unsigned int		sec_erase_mult;	/* Secure erase multiplier */
 	unsigned int		trim_timeout;		/* In milliseconds */
+	u8			rel_param;		/* WR_REL_PARAM */
+	u8			max_packed_writes;
+	bool			packed_event_en;	/* packed writes usable */
 };
 
 struct sd_scr {
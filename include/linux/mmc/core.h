@@ -117,6 +117,7 @@ struct mmc_data {
 
 	unsigned int		sg_len;		/* size of scatter list */
 	struct scatterlist	*sg;		/* I/O scatter list */
+	s32			host_cookie;	/* host private data */
 };
 
 struct mmc_request {
@@ -130,8 +131,14 @@ struct mmc_request {
 
 struct mmc_host;
 struct mmc_card;
+struct completion;
 
 extern void mmc_wait_for_req(struct mmc_host *, struct mmc_request *);
+extern void mmc_start_req(struct mmc_host *, struct mmc_request *,
+			  struct completion *);
+extern void mmc_wait_for_req_done(struct mmc_request *);
+extern void mmc_pre_req(struct mmc_host *, struct mmc_request *, bool);
+extern void mmc_post_req(struct mmc_host *, struct mmc_request *, int);
 extern int mmc_wait_for_cmd(struct mmc_host *, struct mmc_command *, int);
 extern int mmc_wait_for_app_cmd(struct mmc_host *, struct mmc_card *,
 	struct mmc_command *, int);
@@ -154,6 +161,7 @@ extern int mmc_erase_group_aligned(struct mmc_card *card, unsigned int from,
 				   unsigned int nr);
 
 extern int mmc_set_blocklen(struct mmc_card *card, unsigned int blocklen);
+extern int mmc_send_ext_csd(struct mmc_card *card, u8 *ext_csd);
 
 extern void mmc_set_data_timeout(struct mmc_data *, const struct mmc_card *);
 extern unsigned int mmc_align_data_size(struct mmc_card *, unsigned int);
@@ -90,6 +90,18 @@ struct mmc_host_ops {
 	int (*enable)(struct mmc_host *host);
 	int (*disable)(struct mmc_host *host, int lazy);
 	void	(*request)(struct mmc_host *host, struct mmc_request *req);
+	/*
+	 * It is optional for the host to implement pre_req and post_req in
+	 * order to support double buffering of requests (prepare one
+	 * request while another request is active).  pre_req may mark the
+	 * data as prepared through data->host_cookie; post_req is called
+	 * once the request has completed, or with an error if a prepared
+	 * request is dropped without being started.
+	 */
+	void	(*post_req)(struct mmc_host *host, struct mmc_request *req,
+			    int err);
+	void	(*pre_req)(struct mmc_host *host, struct mmc_request *req,
+			   bool is_first_req);
 	/*
 	 * Avoid calling these three functions too often or in a "fast path",
 	 * since underlaying controller might implement them in an expensive
@@ -169,6 +181,7 @@ struct mmc_host {
 						/* DDR mode at 1.8V */
 #define MMC_CAP_1_2V_DDR	(1 << 12)	/* can support */
 						/* DDR mode at 1.2V */
+#define MMC_CAP_PACKED_WR	(1 << 13)	/* Allow packed write commands */
 
 	mmc_pm_flag_t		pm_caps;	/* supported pm features */
 
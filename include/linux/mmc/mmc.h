@@ -132,6 +132,7 @@
 #define R1_CURRENT_STATE(x)	((x & 0x00001E00) >> 9)	/* sx, b (4 bits) */
 #define R1_READY_FOR_DATA	(1 << 8)	/* sx, a */
 #define R1_SWITCH_ERROR		(1 << 7)	/* sx, c */
+#define R1_EXP_EVENT		(1 << 6)	/* sr, a */
 #define R1_APP_CMD		(1 << 5)	/* sr, c */
 
 /*
@@ -253,10 +254,22 @@ struct _mmc_csd {
 #define CSD_SPEC_VER_3      3           /* Implements system specification 3.1 - 3.2 - 3.31 */
 #define CSD_SPEC_VER_4      4           /* Implements system specification 4.0 - 4.1 */
 
+/*
+ * MMC_SET_BLOCK_COUNT argument flags
+ */
+
+#define MMC_CMD23_ARG_REL_WR	(1 << 31)
+#define MMC_CMD23_ARG_PACKED	(1 << 30)
+
 /*
  * EXT_CSD fields
  */
 
+#define EXT_CSD_PACKED_FAILURE_INDEX	35	/* RO */
+#define EXT_CSD_PACKED_CMD_STATUS	36	/* RO */
+#define EXT_CSD_EXP_EVENTS_STATUS	54	/* RO, 2 bytes */
+#define EXT_CSD_EXP_EVENTS_CTRL		56	/* R/W, 2 bytes */
+#define EXT_CSD_WR_REL_PARAM		166	/* RO */
 #define EXT_CSD_ERASE_GROUP_DEF		175	/* R/W */
 #define EXT_CSD_ERASED_MEM_CONT		181	/* RO */
 #define EXT_CSD_BUS_WIDTH		183	/* R/W */
@@ -273,6 +286,8 @@ struct _mmc_csd {
 #define EXT_CSD_SEC_ERASE_MULT		230	/* RO */
 #define EXT_CSD_SEC_FEATURE_SUPPORT	231	/* RO */
 #define EXT_CSD_TRIM_MULT		232	/* RO */
+#define EXT_CSD_MAX_PACKED_WRITES	500	/* RO */
+#define EXT_CSD_MAX_PACKED_READS	501	/* RO */
 
 /*
  * EXT_CSD field definitions
@@ -302,6 +317,21 @@ struct _mmc_csd {
 #define EXT_CSD_SEC_BD_BLK_EN	BIT(2)
 #define EXT_CSD_SEC_GB_CL_EN	BIT(4)
 
+#define EXT_CSD_WR_REL_PARAM_EN	BIT(2)	/* Enhanced reliable write */
+
+#define EXT_CSD_PACKED_EVENT_EN	BIT(3)	/* EXP_EVENTS_CTRL */
+#define EXT_CSD_PACKED_FAILURE	BIT(3)	/* EXP_EVENTS_STATUS */
+
+#define EXT_CSD_PACKED_GENERIC_ERROR	BIT(0)	/* PACKED_CMD_STATUS */
+#define EXT_CSD_PACKED_INDEXED_ERROR	BIT(1)
+
+/*
+ * Packed command header (first block of a packed write)
+ */
+
+#define MMC_PACKED_CMD_VER	0x01
+#define MMC_PACKED_CMD_WR	0x02
+
 /*
  * MMC_SWITCH access modes
  */
@@ -261,6 +261,12 @@ struct mtd_info {
 	/* Subpage shift (NAND) */
 	int subpage_sft;
 
+#ifdef CONFIG_MTD_EB_STATS
+	/* Per-eraseblock counters, see mtd_eb_stats_init() */
+	struct mtd_eb_stats *eb_stats;
+	struct dentry *eb_stats_dentry;
+#endif
+
 	void *priv;
 
 	struct module *owner;
@@ -310,6 +316,57 @@ static inline uint32_t mtd_mod_by_ws(uint64_t sz, struct mtd_info *mtd)
 	return do_div(sz, mtd->writesize);
 }
 
+#ifdef CONFIG_MTD_EB_STATS
+extern int mtd_eb_stats_init(struct mtd_info *mtd);
+extern void mtd_eb_stats_free(struct mtd_info *mtd);
+
+static inline struct mtd_eb_stats *mtd_eb_stats_get(struct mtd_info *mtd,
+						    loff_t ofs)
+{
+	if (!mtd->eb_stats)
+		return NULL;
+	return &mtd->eb_stats[mtd_div_by_eb(ofs, mtd)];
+}
+
+/*
+ * The counters are updated by the driver without locking; like ecc_stats
+ * they are statistics and may miss the odd concurrent update.
+ */
+static inline void mtd_eb_stats_read(struct mtd_info *mtd, loff_t ofs,
+				     unsigned int corrected)
+{
+	struct mtd_eb_stats *st = mtd_eb_stats_get(mtd, ofs);
+
+	if (st) {
+		st->read_count++;
+		st->corrected += corrected;
+		st->corrected_total += corrected;
+	}
+}
+
+static inline void mtd_eb_stats_erase(struct mtd_info *mtd, loff_t ofs)
+{
+	struct mtd_eb_stats *st = mtd_eb_stats_get(mtd, ofs);
+
+	if (st) {
+		st->erase_count++;
+		st->read_count = 0;
+		st->corrected = 0;
+	}
+}
+#else
+static inline int mtd_eb_stats_init(struct mtd_info *mtd) { return 0; }
+static inline void mtd_eb_stats_free(struct mtd_info *mtd) { }
+static inline struct mtd_eb_stats *mtd_eb_stats_get(struct mtd_info *mtd,
+						    loff_t ofs)
+{
+	return NULL;
+}
+static inline void mtd_eb_stats_read(struct mtd_info *mtd, loff_t ofs,
+				     unsigned int corrected) { }
+static inline void mtd_eb_stats_erase(struct mtd_info *mtd, loff_t ofs) { }
+#endif
+
 	/* Kernel-side ioctl definitions */
 
 extern int add_mtd_device(struct mtd_info *mtd);
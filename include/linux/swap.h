@@ -185,6 +185,9 @@ struct swap_info_struct {
 	struct block_device *bdev;	/* swap device or bdev of swap file */
 	struct file *swap_file;		/* seldom referenced */
 	unsigned int old_block_size;	/* seldom referenced */
+	atomic_t ra_hits;		/* readahead pages used since last fault */
+	unsigned int ra_order;		/* log2 of last readahead window */
+	unsigned long ra_prev_offset;	/* offset of last swapin fault */
 };
 
 struct swap_list_t {
@@ -328,6 +331,7 @@ extern void si_swapinfo(struct sysinfo *);
 extern swp_entry_t get_swap_page(void);
 extern swp_entry_t get_swap_page_of_type(int);
 extern int valid_swaphandles(swp_entry_t, unsigned long *);
+extern struct swap_info_struct *swp_swap_info(swp_entry_t);
 extern int add_swap_count_continuation(swp_entry_t, gfp_t);
 extern void swap_shmem_alloc(swp_entry_t);
 extern int swap_duplicate(swp_entry_t);
@@ -18,6 +18,8 @@
 
 /* Contains definitions for resource tracking per uid. */
 
+#include <linux/types.h>
+
 #ifdef CONFIG_UID_STAT
 int uid_stat_tcp_snd(uid_t uid, int size);
 int uid_stat_tcp_rcv(uid_t uid, int size);
@@ -26,4 +28,20 @@ int uid_stat_tcp_rcv(uid_t uid, int size);
 #define uid_stat_tcp_rcv(uid, size) do {} while (0);
 #endif
 
+#ifdef CONFIG_UID_STAT_IO
+void uid_stat_io_read(uid_t uid, unsigned int bytes);
+void uid_stat_io_write(uid_t uid, unsigned int bytes);
+void uid_stat_io_dirtied(uid_t uid);
+u64 uid_stat_io_wait_start(void);
+void uid_stat_io_wait_end(u64 start);
+void uid_stat_io_throttle(void);
+#else
+static inline void uid_stat_io_read(uid_t uid, unsigned int bytes) {}
+static inline void uid_stat_io_write(uid_t uid, unsigned int bytes) {}
+static inline void uid_stat_io_dirtied(uid_t uid) {}
+static inline u64 uid_stat_io_wait_start(void) { return 0; }
+static inline void uid_stat_io_wait_end(u64 start) {}
+static inline void uid_stat_io_throttle(void) {}
+#endif
+
 #endif /* _LINUX_UID_STAT_H */
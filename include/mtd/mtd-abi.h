@@ -176,6 +176,39 @@ struct mtd_ecc_stats {
 	__u32 bbtblocks;
 };
 
+#define MTD_EB_STATS_MAGIC	0x45425354	/* "EBST" */
+#define MTD_EB_STATS_VERSION	1
+
+/**
+ * struct mtd_eb_stats_hdr - header of the debugfs mtd/mtdN_ebstats file
+ *
+ * @magic:	MTD_EB_STATS_MAGIC
+ * @version:	MTD_EB_STATS_VERSION
+ * @blocks:	number of struct mtd_eb_stats following the header
+ * @erasesize:	size of each eraseblock
+ */
+struct mtd_eb_stats_hdr {
+	__u32 magic;
+	__u32 version;
+	__u32 blocks;
+	__u32 erasesize;
+};
+
+/**
+ * struct mtd_eb_stats - per-eraseblock wear and read-disturb counters
+ *
+ * @erase_count:	number of erases since boot
+ * @read_count:		number of pages read since the last erase
+ * @corrected:		number of bitflips corrected since the last erase
+ * @corrected_total:	number of bitflips corrected since boot
+ */
+struct mtd_eb_stats {
+	__u32 erase_count;
+	__u32 read_count;
+	__u32 corrected;
+	__u32 corrected_total;
+};
+
 /*
  * Read/write file modes for access to MTD
  */
@@ -73,6 +73,7 @@
 #include <linux/ftrace.h>
 #include <linux/slab.h>
 #include <linux/cpuacct.h>
+#include <linux/uid_stat.h>
 
 #include <asm/tlb.h>
 #include <asm/irq_regs.h>
@@ -4007,6 +4008,14 @@ asmlinkage void __sched schedule(void)
 	struct rq *rq;
 	int cpu;
 
+	/*
+	 * If we are going to sleep and we have plugged IO queued, make
+	 * sure to submit it to avoid deadlocks.
+	 */
+	if (current->state && !(preempt_count() & PREEMPT_ACTIVE) &&
+	    blk_needs_flush_plug(current))
+		blk_schedule_flush_plug(current);
+
 need_resched:
 	preempt_disable();
 	cpu = smp_processor_id();
@@ -5415,6 +5424,7 @@ EXPORT_SYMBOL(yield);
 void __sched io_schedule(void)
 {
 	struct rq *rq = raw_rq();
+	u64 start = uid_stat_io_wait_start();
 
 	delayacct_blkio_start();
 	atomic_inc(&rq->nr_iowait);
@@ -5423,12 +5433,14 @@ void __sched io_schedule(void)
 	current->in_iowait = 0;
 	atomic_dec(&rq->nr_iowait);
 	delayacct_blkio_end();
+	uid_stat_io_wait_end(start);
 }
 EXPORT_SYMBOL(io_schedule);
 
 long __sched io_schedule_timeout(long timeout)
 {
 	struct rq *rq = raw_rq();
+	u64 start = uid_stat_io_wait_start();
 	long ret;
 
 	delayacct_blkio_start();
@@ -5438,6 +5450,7 @@ long __sched io_schedule_timeout(long timeout)
 	current->in_iowait = 0;
 	atomic_dec(&rq->nr_iowait);
 	delayacct_blkio_end();
+	uid_stat_io_wait_end(start);
 	return ret;
 }
 
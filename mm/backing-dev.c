@@ -90,6 +90,7 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "BdiWriteback:     %8lu kB\n"
 		   "BdiReclaimable:   %8lu kB\n"
 		   "BdiDirtyThresh:   %8lu kB\n"
+		   "BdiWriteBandwidth:%8lu kBps\n"
 		   "DirtyThresh:      %8lu kB\n"
 		   "BackgroundThresh: %8lu kB\n"
 		   "b_dirty:          %8lu\n"
@@ -99,7 +100,7 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "state:            %8lx\n",
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITEBACK)),
 		   (unsigned long) K(bdi_stat(bdi, BDI_RECLAIMABLE)),
-		   K(bdi_thresh), K(dirty_thresh),
+		   K(bdi_thresh), K(bdi->write_bandwidth), K(dirty_thresh),
 		   K(background_thresh), nr_dirty, nr_io, nr_more_io,
 		   !list_empty(&bdi->bdi_list), bdi->state);
 #undef K
@@ -210,12 +211,33 @@ static ssize_t max_ratio_store(struct device *dev,
 }
 BDI_SHOW(max_ratio, bdi->max_ratio)
 
+static ssize_t dirty_time_ms_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct backing_dev_info *bdi = dev_get_drvdata(dev);
+	char *end;
+	unsigned long msecs;
+	ssize_t ret = -EINVAL;
+
+	msecs = simple_strtoul(buf, &end, 10);
+	if (*buf && (end[0] == '\0' || (end[0] == '\n' && end[1] == '\0'))) {
+		bdi->dirty_time_ms = msecs;
+		ret = count;
+	}
+	return ret;
+}
+BDI_SHOW(dirty_time_ms, bdi->dirty_time_ms)
+
+BDI_SHOW(write_bandwidth_kb, K(bdi->write_bandwidth))
+
 #define __ATTR_RW(attr) __ATTR(attr, 0644, attr##_show, attr##_store)
 
 static struct device_attribute bdi_dev_attrs[] = {
 	__ATTR_RW(read_ahead_kb),
 	__ATTR_RW(min_ratio),
 	__ATTR_RW(max_ratio),
+	__ATTR_RW(dirty_time_ms),
+	__ATTR(write_bandwidth_kb, 0444, write_bandwidth_kb_show, NULL),
 	__ATTR_NULL,
 };
 
@@ -638,6 +660,13 @@ static void bdi_wb_init(struct bdi_writeback *wb, struct backing_dev_info *bdi)
 	setup_timer(&wb->wakeup_timer, wakeup_timer_fn, (unsigned long)bdi);
 }
 
+/*
+ * Start from a bandwidth no device will be limited by, until writeback
+ * has been observed, and cap each bdi at 3s worth of its writeback.
+ */
+#define INIT_BW			((100 << 20) >> PAGE_SHIFT)
+#define BDI_DIRTY_TIME_MS	3000
+
 int bdi_init(struct backing_dev_info *bdi)
 {
 	int i, err;
@@ -647,6 +676,11 @@ int bdi_init(struct backing_dev_info *bdi)
 	bdi->min_ratio = 0;
 	bdi->max_ratio = 100;
 	bdi->max_prop_frac = PROP_FRAC_BASE;
+
+	bdi->bw_time_stamp = jiffies;
+	bdi->written_stamp = 0;
+	bdi->write_bandwidth = INIT_BW;
+	bdi->dirty_time_ms = BDI_DIRTY_TIME_MS;
 	spin_lock_init(&bdi->wb_lock);
 	INIT_LIST_HEAD(&bdi->bdi_list);
 	INIT_LIST_HEAD(&bdi->work_list);
@@ -23,6 +23,7 @@
 #include <linux/init.h>
 #include <linux/backing-dev.h>
 #include <linux/task_io_accounting_ops.h>
+#include <linux/uid_stat.h>
 #include <linux/blkdev.h>
 #include <linux/mpage.h>
 #include <linux/rmap.h>
@@ -219,6 +220,7 @@ int dirty_bytes_handler(struct ctl_table *table, int write,
  */
 static inline void __bdi_writeout_inc(struct backing_dev_info *bdi)
 {
+	__inc_bdi_stat(bdi, BDI_WRITTEN);
 	__prop_inc_percpu_max(&vm_completions, &bdi->completions,
 			      bdi->max_prop_frac);
 }
@@ -437,6 +439,55 @@ void global_dirty_limits(unsigned long *pbackground, unsigned long *pdirty)
 	*pdirty = dirty;
 }
 
+/*
+ * Sample the writeback bandwidth of @bdi at most every BANDWIDTH_INTERVAL.
+ * Only called while the bdi is busy writing (from the flusher, or from a
+ * throttled dirtier), a gap longer than a second means it went idle in
+ * between and only restarts the measurement.
+ */
+#define BANDWIDTH_INTERVAL	max(HZ/5, 1)
+
+void bdi_update_write_bandwidth(struct backing_dev_info *bdi)
+{
+	unsigned long now = jiffies;
+	unsigned long stamp = bdi->bw_time_stamp;
+	unsigned long elapsed = now - stamp;
+	unsigned long written;
+	u64 bw;
+
+	if (elapsed < BANDWIDTH_INTERVAL)
+		return;
+	/* one updater at a time */
+	if (cmpxchg(&bdi->bw_time_stamp, stamp, now) != stamp)
+		return;
+
+	written = bdi_stat(bdi, BDI_WRITTEN);
+	if (elapsed <= HZ) {
+		bw = (u64)(written - bdi->written_stamp) * HZ;
+		do_div(bw, elapsed);
+		bdi->write_bandwidth = (bdi->write_bandwidth * 7 + bw) >> 3;
+	}
+	bdi->written_stamp = written;
+}
+EXPORT_SYMBOL(bdi_update_write_bandwidth);
+
+/*
+ * The dirty pages @bdi can write back within dirty_time_ms.  Never less
+ * than a megabyte, so a stalled device still makes progress.
+ */
+unsigned long bdi_bandwidth_limit(struct backing_dev_info *bdi)
+{
+	u64 limit;
+
+	if (!bdi->dirty_time_ms || !bdi_cap_writeback_dirty(bdi))
+		return ULONG_MAX;
+
+	limit = (u64)bdi->write_bandwidth * bdi->dirty_time_ms;
+	do_div(limit, MSEC_PER_SEC);
+
+	return max_t(unsigned long, limit, (1 << 20) >> PAGE_SHIFT);
+}
+
 /*
  * bdi_dirty_limit - @bdi's share of dirty throttling threshold
  *
@@ -465,6 +516,13 @@ unsigned long bdi_dirty_limit(struct backing_dev_info *bdi, unsigned long dirty)
 	if (bdi_dirty > (dirty * bdi->max_ratio) / 100)
 		bdi_dirty = dirty * bdi->max_ratio / 100;
 
+	/*
+	 * A slow device should not hold more dirty pages than it can
+	 * write back in reasonable time, whatever its share.
+	 */
+	bdi_dirty = min_t(u64, bdi_dirty, bdi_bandwidth_limit(bdi));
+	bdi_dirty = max_t(u64, bdi_dirty, (dirty * bdi->min_ratio) / 100);
+
 	return bdi_dirty;
 }
 
@@ -483,6 +541,7 @@ static void balance_dirty_pages(struct address_space *mapping,
 	unsigned long background_thresh;
 	unsigned long dirty_thresh;
 	unsigned long bdi_thresh;
+	unsigned long bdi_bw_thresh;
 	unsigned long pages_written = 0;
 	unsigned long pause = 1;
 	bool dirty_exceeded = false;
@@ -501,14 +560,20 @@ static void balance_dirty_pages(struct address_space *mapping,
 		nr_writeback = global_page_state(NR_WRITEBACK);
 
 		global_dirty_limits(&background_thresh, &dirty_thresh);
+		bdi_bw_thresh = bdi_bandwidth_limit(bdi);
 
 		/*
 		 * Throttle it only when the background writeback cannot
 		 * catch-up. This avoids (excessively) small writeouts
-		 * when the bdi limits are ramping up.
+		 * when the bdi limits are ramping up.  A bdi over its
+		 * bandwidth limit is throttled regardless, a slow device
+		 * must not fill up the global dirty memory first.
 		 */
 		if (nr_reclaimable + nr_writeback <=
-				(background_thresh + dirty_thresh) / 2)
+				(background_thresh + dirty_thresh) / 2 &&
+		    (bdi_bw_thresh == ULONG_MAX ||
+		     bdi_stat(bdi, BDI_RECLAIMABLE) +
+		     bdi_stat(bdi, BDI_WRITEBACK) <= bdi_bw_thresh))
 			break;
 
 		bdi_thresh = bdi_dirty_limit(bdi, dirty_thresh);
@@ -568,6 +633,7 @@ static void balance_dirty_pages(struct address_space *mapping,
 		trace_wbc_balance_dirty_wait(&wbc, bdi);
 		__set_current_state(TASK_INTERRUPTIBLE);
 		io_schedule_timeout(pause);
+		bdi_update_write_bandwidth(bdi);
 
 		/*
 		 * Increase the delay for each loop, up to our previous
@@ -593,7 +659,8 @@ static void balance_dirty_pages(struct address_space *mapping,
 	 * background_thresh, to keep the amount of dirty memory low.
 	 */
 	if ((laptop_mode && pages_written) ||
-	    (!laptop_mode && (nr_reclaimable > background_thresh)))
+	    (!laptop_mode && (nr_reclaimable > background_thresh ||
+	     bdi_stat(bdi, BDI_RECLAIMABLE) > bdi_bw_thresh / 2)))
 		bdi_start_background_writeback(bdi);
 }
 
@@ -629,6 +696,8 @@ void balance_dirty_pages_ratelimited_nr(struct address_space *mapping,
 	unsigned long ratelimit;
 	unsigned long *p;
 
+	uid_stat_io_throttle();
+
 	ratelimit = ratelimit_pages;
 	if (mapping->backing_dev_info->dirty_exceeded)
 		ratelimit = 8;
@@ -1039,11 +1108,17 @@ static int __writepage(struct page *page, struct writeback_control *wbc,
 int generic_writepages(struct address_space *mapping,
 		       struct writeback_control *wbc)
 {
+	struct blk_plug plug;
+	int ret;
+
 	/* deal with chardevs and other special file */
 	if (!mapping->a_ops->writepage)
 		return 0;
 
-	return write_cache_pages(mapping, wbc, __writepage, mapping);
+	blk_start_plug(&plug);
+	ret = write_cache_pages(mapping, wbc, __writepage, mapping);
+	blk_finish_plug(&plug);
+	return ret;
 }
 
 EXPORT_SYMBOL(generic_writepages);
@@ -1122,6 +1197,7 @@ void account_page_dirtied(struct page *page, struct address_space *mapping)
 		__inc_bdi_stat(mapping->backing_dev_info, BDI_RECLAIMABLE);
 		task_dirty_inc(current);
 		task_io_account_write(PAGE_CACHE_SIZE);
+		uid_stat_io_dirtied(current_uid());
 	}
 }
 EXPORT_SYMBOL(account_page_dirtied);
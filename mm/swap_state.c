@@ -16,6 +16,7 @@
 #include <linux/pagemap.h>
 #include <linux/buffer_head.h>
 #include <linux/backing-dev.h>
+#include <linux/blkdev.h>
 #include <linux/pagevec.h>
 #include <linux/migrate.h>
 #include <linux/page_cgroup.h>
@@ -263,21 +264,26 @@ struct page * lookup_swap_cache(swp_entry_t entry)
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		if (unlikely(TestClearPageReadahead(page))) {
+			atomic_inc(&swp_swap_info(entry)->ra_hits);
+			count_vm_event(SWAP_RA_HIT);
+		}
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
 }
 
-/* 
- * Locate a page of swap in physical memory, reserving swap cache space
- * and reading the disk if it is not already cached.
- * A failure return means that either the page allocation failed or that
- * the swap entry is no longer in use.
+/*
+ * As read_swap_cache_async(), but with @readahead set a page that this
+ * call actually reads from swap is marked PG_readahead; pages that were
+ * already in the swap cache are left alone.
  */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+static struct page *__read_swap_cache_async(swp_entry_t entry,
+			gfp_t gfp_mask, struct vm_area_struct *vma,
+			unsigned long addr, int readahead)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
@@ -330,6 +336,10 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 			/*
 			 * Initiate read into locked page and return.
 			 */
+			if (readahead) {
+				SetPageReadahead(new_page);
+				count_vm_event(SWAP_RA);
+			}
 			lru_cache_add_anon(new_page);
 			swap_readpage(new_page);
 			return new_page;
@@ -349,6 +359,18 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+/* 
+ * Locate a page of swap in physical memory, reserving swap cache space
+ * and reading the disk if it is not already cached.
+ * A failure return means that either the page allocation failed or that
+ * the swap entry is no longer in use.
+ */
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	return __read_swap_cache_async(entry, gfp_mask, vma, addr, 0);
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -359,10 +381,14 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
  * Returns the struct page for entry and addr, after queueing swapin.
  *
  * Primitive swap readahead code. We simply read an aligned block of
- * (1 << page_cluster) entries in the swap area. This method is chosen
+ * up to (1 << page_cluster) entries in the swap area. This method is chosen
  * because it doesn't cost us any seek time.  We also make sure to queue
  * the 'original' request together with the readahead ones...
  *
+ * Pages this readahead reads in, other than the faulting one, are marked
+ * PG_readahead; lookup_swap_cache() counts the ones that get used, and
+ * valid_swaphandles() sizes the next window from that count.
+ *
  * This has been extended to use the NUMA policies from the mm triggering
  * the readahead.
  *
@@ -375,6 +401,8 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	struct page *page;
 	unsigned long offset;
 	unsigned long end_offset;
+	unsigned long target = swp_offset(entry);
+	struct blk_plug plug;
 
 	/*
 	 * Get starting offset for readaround, and number of pages to read.
@@ -384,14 +412,17 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	 * so use the same "addr" to choose the same node for each swap read.
 	 */
 	nr_pages = valid_swaphandles(entry, &offset);
+	blk_start_plug(&plug);
 	for (end_offset = offset + nr_pages; offset < end_offset; offset++) {
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
+		page = __read_swap_cache_async(swp_entry(swp_type(entry),
+						offset), gfp_mask, vma, addr,
+						offset != target);
 		if (!page)
 			break;
 		page_cache_release(page);
 	}
+	blk_finish_plug(&plug);
 	lru_add_drain();	/* Push any new pages onto the LRU now */
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
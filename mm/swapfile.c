@@ -2289,6 +2289,45 @@ int swapcache_prepare(swp_entry_t entry)
 	return __swap_duplicate(entry, SWAP_HAS_CACHE);
 }
 
+struct swap_info_struct *swp_swap_info(swp_entry_t entry)
+{
+	return swap_info[swp_type(entry)];
+}
+
+/*
+ * Size the readahead window from how well the previous one was used:
+ * every readahead page that was faulted in since the last miss counts
+ * as a hit.  With no hits the window collapses to the faulting page
+ * alone, unless the faults look sequential on a rotating disk; with
+ * hits it grows towards page_cluster.  The window only shrinks by one
+ * order per fault, so that one stray miss does not kill readahead for a
+ * stream that is otherwise being used.  Called with swap_lock held.
+ */
+static int swapin_ra_order(struct swap_info_struct *si, pgoff_t target,
+			   int max_order)
+{
+	unsigned int hits, pages, order;
+
+	hits = atomic_xchg(&si->ra_hits, 0);
+	pages = hits + 2;
+	if (!hits) {
+		if ((si->flags & SWP_SOLIDSTATE) ||
+		    (target != si->ra_prev_offset + 1 &&
+		     target != si->ra_prev_offset - 1))
+			pages = 1;
+	}
+
+	order = 0;
+	while ((1U << order) < pages && order < max_order)
+		order++;
+	if (order + 1 < si->ra_order)
+		order = si->ra_order - 1;
+
+	si->ra_order = order;
+	si->ra_prev_offset = target;
+	return order;
+}
+
 /*
  * swap_lock prevents swap_map being freed. Don't grab an extra
  * reference on the swaphandle, it doesn't matter if it becomes unused.
@@ -2306,12 +2345,19 @@ int valid_swaphandles(swp_entry_t entry, unsigned long *offset)
 
 	si = swap_info[swp_type(entry)];
 	target = swp_offset(entry);
+
+	spin_lock(&swap_lock);
+	our_page_cluster = swapin_ra_order(si, target, our_page_cluster);
+	if (!our_page_cluster) {
+		spin_unlock(&swap_lock);
+		return 0;
+	}
+
 	base = (target >> our_page_cluster) << our_page_cluster;
 	end = base + (1 << our_page_cluster);
 	if (!base)		/* first page is swap header */
 		base++;
 
-	spin_lock(&swap_lock);
 	if (end > si->max)	/* don't go beyond end of map */
 		end = si->max;
 